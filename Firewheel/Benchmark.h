@@ -0,0 +1,313 @@
+//
+//  Benchmark.h
+//  Firewheel
+//
+//  Reproducible performance runs: a scripted camera path, sampled on the same
+//  fixed timestep the animation is stepped on, and a recorder that keeps each
+//  frame's CPU, GPU and whole-frame times along with its draw counters, then
+//  writes them out as CSV or JSON for comparing one build with another.
+//
+
+#ifndef Firewheel_Benchmark_h
+#define Firewheel_Benchmark_h
+
+#include <GLTools.h>
+#include <GLFrame.h>
+#include <StopWatch.h>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "GPUTimer.h"
+
+/* ----------- */
+/* Camera path */
+
+/* Where the camera is at a given time, and what it's looking at */
+struct CameraKey
+{
+  float       time;
+  M3DVector3f vPosition;
+  M3DVector3f vTarget;
+};
+
+/* Catmull-Rom through the keys' positions and targets, so the camera neither
+   stops nor turns sharply at a key. Keys must be in time order; past the last
+   one the path starts over.
+
+     CameraPath path(KEYS, NBR_KEYS);
+     path.Apply(simulatedTime, cameraFrame); */
+class CameraPath
+{
+public:
+  CameraPath(const CameraKey keys[], int count) : pKeys(keys), nbrKeys(count) {}
+
+  float GetDuration() const { return (nbrKeys > 0) ? pKeys[nbrKeys - 1].time : 0.0f; }
+  void  Apply(float time, GLFrame &frame) const;
+
+private:
+  static float Interpolate(float p0, float p1, float p2, float p3, float t);
+
+  const CameraKey *pKeys;
+  int              nbrKeys;
+};
+
+float CameraPath::Interpolate(float p0, float p1, float p2, float p3, float t)
+{
+  return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t * t +
+                 (3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t * t);
+}
+
+/* GLFrame wants its up vector at right angles to its forward one */
+void CameraPath::Apply(float time, GLFrame &frame) const
+{
+  if (nbrKeys == 0)
+    return;
+
+  float duration = GetDuration();
+  if (duration > 0.0f)
+    time -= duration * floorf(time / duration);
+
+  int key = 0;
+  while (key < nbrKeys - 2 && pKeys[key + 1].time <= time)
+    key++;
+  int k0 = (key > 0) ? key - 1 : 0;
+  int k2 = (key + 1 < nbrKeys) ? key + 1 : key;
+  int k3 = (k2 + 1 < nbrKeys) ? k2 + 1 : k2;
+  float span = pKeys[k2].time - pKeys[key].time;
+  float t = (span > 0.0f) ? (time - pKeys[key].time) / span : 0.0f;
+  t = (t < 0.0f) ? 0.0f : ((t > 1.0f) ? 1.0f : t);
+
+  M3DVector3f vPosition, vTarget, vForward, vUp;
+  for (int i = 0; i < 3; i++)
+  {
+    vPosition[i] = Interpolate(pKeys[k0].vPosition[i], pKeys[key].vPosition[i], pKeys[k2].vPosition[i], pKeys[k3].vPosition[i], t);
+    vTarget[i] = Interpolate(pKeys[k0].vTarget[i], pKeys[key].vTarget[i], pKeys[k2].vTarget[i], pKeys[k3].vTarget[i], t);
+  }
+  m3dSubtractVectors3(vForward, vTarget, vPosition);
+  m3dNormalizeVector3(vForward);
+
+  M3DVector3f vWorldUp = { 0.0f, 1.0f, 0.0f }, vAlong;
+  m3dCopyVector3(vAlong, vForward);
+  m3dScaleVector3(vAlong, m3dDotProduct3(vWorldUp, vForward));
+  m3dSubtractVectors3(vUp, vWorldUp, vAlong);
+  m3dNormalizeVector3(vUp);
+
+  frame.SetOrigin(vPosition);
+  frame.SetForwardVector(vForward);
+  frame.SetUpVector(vUp);
+}
+
+/* ------------------ */
+/* Benchmark recorder */
+
+/* What a frame drew, as the caller counts it */
+struct BenchmarkCounters
+{
+  int draws;            /* after culling */
+  int calls;            /* draw calls, a multi-draw counting once */
+  int programSwitches;
+  int textureSwitches;
+  int meshSwitches;
+  int culled;           /* by the frustum: rides from the BVH and the parts under them */
+  int occlusionSaved;   /* draws skipped for being hidden */
+};
+
+/* One line of the output; times in milliseconds, the GPU's -1 for a frame that wasn't timed */
+struct BenchmarkFrame
+{
+  int               frame;
+  float             time;       /* simulated, in seconds */
+  float             cpuMs;      /* update and draw calls, up to the end of submission */
+  float             gpuMs;      /* the GPU timers' frame section */
+  float             frameMs;    /* the whole frame, including the wait for the GPU */
+  BenchmarkCounters counters;
+};
+
+/* Typical frame, on the fixed timestep:
+     recorder.BeginFrame(time);
+     ... update and draw, between gpuTimers.BeginFrame() and EndFrame() ...
+     recorder.EndSubmit();
+     ... glFinish or swap ...
+     recorder.EndFrame(counters);
+
+   The GPU time is the section of the frame's GPUTimers given to SetGPUTimers,
+   picked up once the timers have collected the frame, so recording doesn't
+   stall the frames it measures. */
+class BenchmarkRecorder
+{
+public:
+  BenchmarkRecorder();
+
+  void SetGPUTimers(GPUTimers *pTimers, int frameSection);
+
+  void BeginFrame(float time);
+  void EndSubmit();
+  void EndFrame(const BenchmarkCounters &counters);
+
+  const std::vector<BenchmarkFrame> &GetFrames() const { return frames; }
+  bool HasGPUTimes() const { return pGPUTimers != NULL && pGPUTimers->IsSupported(); }
+
+  /* ".json" gets JSON, anything else CSV; waits for the GPU times still out */
+  bool Write(const char *szFileName);
+  void PrintSummary(const char *szName) const;
+
+private:
+  void Collect(bool wait);
+  bool WriteCSV(FILE *pFile) const;
+  bool WriteJSON(FILE *pFile) const;
+
+  std::vector<BenchmarkFrame> frames;
+  CStopWatch                  frameTimer;
+  float                       cpuSeconds;
+
+  GPUTimers       *pGPUTimers;
+  int              gpuSection;
+  std::vector<int> gpuFrameNumbers;   /* the timers' number for each frame */
+  size_t           nbrSettled;        /* frames whose GPU time is known, or known to be missing */
+};
+
+BenchmarkRecorder::BenchmarkRecorder()
+  : cpuSeconds(0.0f), pGPUTimers(NULL), gpuSection(0), nbrSettled(0)
+{
+}
+
+void BenchmarkRecorder::SetGPUTimers(GPUTimers *pTimers, int frameSection)
+{
+  pGPUTimers = pTimers;
+  gpuSection = frameSection;
+}
+
+void BenchmarkRecorder::BeginFrame(float time)
+{
+  BenchmarkFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.frame = (int)frames.size();
+  frame.time = time;
+  frame.gpuMs = -1.0f;
+  frames.push_back(frame);
+  gpuFrameNumbers.push_back(-1);
+  frameTimer.Reset();
+}
+
+void BenchmarkRecorder::EndSubmit()
+{
+  cpuSeconds = frameTimer.GetElapsedSeconds();
+  if (pGPUTimers != NULL)
+    gpuFrameNumbers.back() = pGPUTimers->GetFrameNumber();
+}
+
+void BenchmarkRecorder::EndFrame(const BenchmarkCounters &counters)
+{
+  BenchmarkFrame &frame = frames.back();
+  frame.frameMs = 1000.0f * frameTimer.GetElapsedSeconds();
+  frame.cpuMs = 1000.0f * cpuSeconds;
+  frame.counters = counters;
+  Collect(false);
+}
+
+/* The timers collect frames in order, so every frame up to the one they
+   collected last is settled: timed, or untimed and left at -1. */
+void BenchmarkRecorder::Collect(bool wait)
+{
+  if (!HasGPUTimes())
+    return;
+  if (wait)
+    pGPUTimers->Finish();
+
+  int collected = pGPUTimers->GetCollectedFrameNumber();
+  for (; nbrSettled < frames.size(); nbrSettled++)
+  {
+    int number = gpuFrameNumbers[nbrSettled];
+    if (number > collected && !wait)
+      break;
+    float ms;
+    if (number >= 0 && pGPUTimers->GetFrameMs(number, gpuSection, ms))
+      frames[nbrSettled].gpuMs = ms;
+  }
+}
+
+bool BenchmarkRecorder::Write(const char *szFileName)
+{
+  Collect(true);
+
+  FILE *pFile = fopen(szFileName, "w");
+  if (pFile == NULL)
+  {
+    fprintf(stderr, "%s: can't write\n", szFileName);
+    return false;
+  }
+  size_t length = strlen(szFileName);
+  bool json = (length >= 5 && strcmp(szFileName + length - 5, ".json") == 0);
+  bool written = json ? WriteJSON(pFile) : WriteCSV(pFile);
+  written = (fclose(pFile) == 0) && written;
+  if (!written)
+    fprintf(stderr, "%s: can't write\n", szFileName);
+  return written;
+}
+
+bool BenchmarkRecorder::WriteCSV(FILE *pFile) const
+{
+  fprintf(pFile, "frame,time,cpu_ms,gpu_ms,frame_ms,draws,calls,program_switches,texture_switches,mesh_switches,culled,occlusion_saved\n");
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    const BenchmarkFrame &f = frames[i];
+    fprintf(pFile, "%d,%.3f,%.4f,%.4f,%.4f,%d,%d,%d,%d,%d,%d,%d\n", f.frame, f.time, f.cpuMs, f.gpuMs, f.frameMs,
+            f.counters.draws, f.counters.calls, f.counters.programSwitches, f.counters.textureSwitches,
+            f.counters.meshSwitches, f.counters.culled, f.counters.occlusionSaved);
+  }
+  return ferror(pFile) == 0;
+}
+
+/* An array of frames, with null for a GPU time there isn't */
+bool BenchmarkRecorder::WriteJSON(FILE *pFile) const
+{
+  fprintf(pFile, "{\n  \"gpu_times\": %s,\n  \"frames\": [\n", HasGPUTimes() ? "true" : "false");
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    const BenchmarkFrame &f = frames[i];
+    char szGPU[32];
+    if (f.gpuMs >= 0.0f)
+      sprintf(szGPU, "%.4f", f.gpuMs);
+    else
+      strcpy(szGPU, "null");
+    fprintf(pFile, "    { \"frame\": %d, \"time\": %.3f, \"cpu_ms\": %.4f, \"gpu_ms\": %s, \"frame_ms\": %.4f, "
+            "\"draws\": %d, \"calls\": %d, \"program_switches\": %d, \"texture_switches\": %d, \"mesh_switches\": %d, "
+            "\"culled\": %d, \"occlusion_saved\": %d }%s\n", f.frame, f.time, f.cpuMs, szGPU, f.frameMs,
+            f.counters.draws, f.counters.calls, f.counters.programSwitches, f.counters.textureSwitches,
+            f.counters.meshSwitches, f.counters.culled, f.counters.occlusionSaved, (i + 1 < frames.size()) ? "," : "");
+  }
+  fprintf(pFile, "  ]\n}\n");
+  return ferror(pFile) == 0;
+}
+
+void BenchmarkRecorder::PrintSummary(const char *szName) const
+{
+  if (frames.empty())
+    return;
+
+  double cpu = 0.0, gpu = 0.0, frame = 0.0, calls = 0.0, culled = 0.0;
+  int nbrGPU = 0;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    cpu += frames[i].cpuMs;
+    frame += frames[i].frameMs;
+    calls += frames[i].counters.calls;
+    culled += frames[i].counters.culled;
+    if (frames[i].gpuMs >= 0.0f)
+    {
+      gpu += frames[i].gpuMs;
+      nbrGPU++;
+    }
+  }
+  double n = (double)frames.size();
+  if (nbrGPU > 0)
+    printf("%s: %d frames, mean cpu %.3f ms, gpu %.3f ms, frame %.3f ms, %.1f calls, %.1f culled\n",
+           szName, (int)frames.size(), cpu / n, gpu / nbrGPU, frame / n, calls / n, culled / n);
+  else
+    printf("%s: %d frames, mean cpu %.3f ms, frame %.3f ms, %.1f calls, %.1f culled\n",
+           szName, (int)frames.size(), cpu / n, frame / n, calls / n, culled / n);
+}
+
+#endif
@@ -22,6 +22,8 @@
 #include <StopWatch.h>
 #include <cmath>
 #include <ctime>
+#include "Culling.h"
+#include "DrawList.h"
 
 const GLfloat BAR_BASE_RADIUS = 0.003f;
 const GLfloat BAR_TOP_RADIUS  = 0.003f;
@@ -52,6 +54,9 @@ const GLfloat WALL_LENGTH      = 0.04f;
 const int WALL_NUMBER_SLICES   = 10;
 const int WALL_NUMBER_STACKS   = 10;
 
+// Everything hangs within this distance of the car's pivot on the wheel
+const GLfloat CAR_BOUNDING_RADIUS = POLE_LENGTH + WALL_LENGTH + WALL_BASE_RADIUS;
+
 const GLfloat WHITE_COLOR[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 const GLfloat LIGHT_POSITION[] = { 2.0f, 8.0f, 5.0f, 1.0f };
 
@@ -61,19 +66,22 @@ class Car
 		Car();
 		void SetupRenderingContext();
 		void Update();
-		void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline,
-			      M3DVector4f &vLightEyePos, GLfloat totalCarRot, GLuint wallTexture, GLuint carTexture[]);
+		void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList,
+			      M3DVector4f &vLightEyePos, GLfloat totalCarRot, GLuint wallTexture, GLuint carTexture[], int detailLevel = 0);
+		const BoundingSphere& GetBoundingSphere() const { return bounds; }
 	private:
 		GLTriangleBatch barBatch;
 		GLTriangleBatch roofBatch;
 		GLTriangleBatch poleBatch;
 		GLTriangleBatch floorBatch;
 		GLTriangleBatch wallBatch;
+		BoundingSphere bounds;
 };
 
 // Default Constructor
 Car::Car()
 {
+	SetBoundingSphere(bounds, 0.0f, 0.0f, 0.0f, CAR_BOUNDING_RADIUS);
 }
 
 // Set up all structures needed to render the Ferris wheel car objects.
@@ -92,9 +100,10 @@ void Car::Update()
 {
 }
 
-// Render the components of the Ferris wheel car.
-void Car::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline,
-	           M3DVector4f &vLightEyePos, GLfloat totalCarRot, GLuint wallTexture, GLuint carTexture[])
+// Render the components of the Ferris wheel car. Above detail level 0 the
+// thin bar and pole are left out; from a distance they are under a pixel wide.
+void Car::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList,
+	           M3DVector4f &vLightEyePos, GLfloat totalCarRot, GLuint wallTexture, GLuint carTexture[], int detailLevel)
 {
 	// Get the light position in eye space
 	M3DVector4f	vLightTransformed;
@@ -103,47 +112,38 @@ void Car::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, G
 	m3dTransformVector4(vLightTransformed, LIGHT_POSITION, mCamera);
 
 	modelViewMatrix.PushMatrix();
-		modelViewMatrix.PushMatrix();
-			glBindTexture(GL_TEXTURE_2D, carTexture[0]);
-			modelViewMatrix.Translate(0.0f, 0.0f, -0.5f * BAR_LENGTH);
-			shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-											transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_COLOR, 0);
-			barBatch.Draw();
-		modelViewMatrix.PopMatrix();
+		if (detailLevel == 0)
+		{
+			modelViewMatrix.PushMatrix();
+				modelViewMatrix.Translate(0.0f, 0.0f, -0.5f * BAR_LENGTH);
+				drawList.AddTexturedLit(barBatch, carTexture[0], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_COLOR);
+			modelViewMatrix.PopMatrix();
+		}
 
 		modelViewMatrix.Rotate(-totalCarRot, 0.0f, 0.0f, 1.0f);
 		modelViewMatrix.Rotate(90.0f, 1.0f, 0.0f, 0.0f);
 		modelViewMatrix.PushMatrix();
-		glBindTexture(GL_TEXTURE_2D, carTexture[1]);
-		shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-											transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_COLOR, 0);
-		roofBatch.Draw();
+		drawList.AddTexturedLit(roofBatch, carTexture[1], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_COLOR);
 		modelViewMatrix.PopMatrix();
 		
-		modelViewMatrix.PushMatrix();
-			glBindTexture(GL_TEXTURE_2D, carTexture[2]);
-			shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-												transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_COLOR, 0);
-			poleBatch.Draw();
-		modelViewMatrix.PopMatrix();
+		if (detailLevel == 0)
+		{
+			modelViewMatrix.PushMatrix();
+				drawList.AddTexturedLit(poleBatch, carTexture[2], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_COLOR);
+			modelViewMatrix.PopMatrix();
+		}
 
 		modelViewMatrix.PushMatrix();
-			glBindTexture(GL_TEXTURE_2D, carTexture[4]);
 			modelViewMatrix.Translate(0.0f, 0.0f, POLE_LENGTH);
 			modelViewMatrix.Scale(FLOOR_SCALE[0], FLOOR_SCALE[1], FLOOR_SCALE[2]);
-			shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-											transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_COLOR, 0);
-			floorBatch.Draw();
+			drawList.AddTexturedLit(floorBatch, carTexture[4], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_COLOR);
 		modelViewMatrix.PopMatrix();
 
 		modelViewMatrix.PushMatrix();
-			glBindTexture(GL_TEXTURE_2D, wallTexture);
 			modelViewMatrix.Translate(0.0f, 0.0f, POLE_LENGTH);// POLE_LENGTH - WALL_LENGTH);
 			modelViewMatrix.Rotate(90.0f, 0.0f, 0.0f, 1.0f);
 			modelViewMatrix.Rotate(180.0f, 0.0f, 1.0f, 0.0f);
-			shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-											transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_COLOR, 0);
-			wallBatch.Draw();
+			drawList.AddTexturedLit(wallBatch, wallTexture, modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_COLOR);
 		modelViewMatrix.PopMatrix();
 	modelViewMatrix.PopMatrix();
 }
@@ -23,6 +23,9 @@
 #include <cmath>
 #include <ctime>
 
+#include "Culling.h"
+#include "DrawList.h"
+
 /* ROOF CAP */
 const GLfloat ROOF_CAP_COLOR[] = { 0.8f, 0.8f, 0.2f, 1.0f };
 const GLfloat ROOF_CAP_BASE_RADIUS = 1.0f;
@@ -61,6 +64,10 @@ const GLfloat RIDE_POLE_LENGTH = 0.9f;
 const GLint RIDE_POLE_NBR_SLICES = 10;
 const GLint RIDE_POLE_NBR_STACKS = 10;
 
+/* BOUNDS: the floor sits at -0.70 and the roof tip at 0.2 + ROOF_CAP_LENGTH */
+const GLfloat CAROUSEL_BOTTOM_HEIGHT = -0.70f;
+const GLfloat CAROUSEL_TOP_HEIGHT = 0.2f + ROOF_CAP_LENGTH;
+
 /* DATA FILE */
 // const char* COASTER_DATA_FILE = "roller_coaster_data.txt";
 
@@ -73,7 +80,8 @@ public:
 
   void SetupRenderingContext();
   void Update();
-  void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos);
+  void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos);
+  const BoundingSphere& GetBoundingSphere() const { return bounds; }
 
 private:
   GLTriangleBatch roofcap;
@@ -84,11 +92,16 @@ private:
 
   GLTriangleBatch ridePoles[NBR_RIDE_POLES];
   /* animals */
+
+  BoundingSphere bounds;
 };
 
 Carousel::Carousel()
 {
-  
+  /* The structure is modelled on its side and tilted upright in Draw, so its height runs along y */
+  GLfloat halfHeight = 0.5f * (CAROUSEL_TOP_HEIGHT - CAROUSEL_BOTTOM_HEIGHT);
+  SetBoundingSphere(bounds, 0.0f, CAROUSEL_BOTTOM_HEIGHT + halfHeight, 0.0f,
+                    sqrtf(BOTTOM_BASE_RADIUS * BOTTOM_BASE_RADIUS + halfHeight * halfHeight));
 }
 
 Carousel::~Carousel()
@@ -118,7 +131,7 @@ void Carousel::Update()
   
 }
 
-void Carousel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos)
+void Carousel::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos)
 {
   modelViewMatrix.PushMatrix();
   
@@ -128,47 +141,39 @@ void Carousel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManag
     /* Floor carousel bottom */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.0f, 0.0f, -0.70f);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightEyePos, BOTTOM_COLOR);
-      bottom.Draw();
+      drawList.AddLit(bottom, modelViewMatrix.GetMatrix(), vLightEyePos, BOTTOM_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* Floor carousel cap */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.0f, 0.0f, -0.60f);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                 transformPipeline.GetProjectionMatrix(), vLightEyePos, BOTTOM_COLOR);
-      bottomcap.Draw();
+      drawList.AddLit(bottomcap, modelViewMatrix.GetMatrix(), vLightEyePos, BOTTOM_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* rotate support beam verticle, start in center and spread out at coords x=cos(rot), y=sin(rot) */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.0f, 0.0f, -0.70f);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightEyePos, CENTER_PIECE_COLOR);
-      centerpiece.Draw();
+      drawList.AddLit(centerpiece, modelViewMatrix.GetMatrix(), vLightEyePos, CENTER_PIECE_COLOR);
     modelViewMatrix.PopMatrix();
     
     /* carousel ride poles */
     for ( int i = 0; i < NBR_RIDE_POLES; i++ )
     {
       int rot = i*360.0f/NBR_RIDE_POLES;
+      GLfloat sinRot, cosRot;
+      m3dSinCosf(m3dDegToRadf(rot), sinRot, cosRot);
 
       modelViewMatrix.PushMatrix();
-        modelViewMatrix.Translate(cosf(m3dDegToRad(rot))/1.2f, sinf(m3dDegToRad(rot))/1.2f, 0.0f);
+        modelViewMatrix.Translate(cosRot/1.2f, sinRot/1.2f, 0.0f);
         modelViewMatrix.Translate(0.0f, 0.0f, -0.70f);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                     transformPipeline.GetProjectionMatrix(), vLightEyePos, ROOF_CAP_COLOR);
-        ridePoles[i].Draw();
+        drawList.AddLit(ridePoles[i], modelViewMatrix.GetMatrix(), vLightEyePos, ROOF_CAP_COLOR);
       modelViewMatrix.PopMatrix();
     }
     
     /* rotate support beam verticle, start in center and spread out at coords x=cos(rot), y=sin(rot) */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.0f, 0.0f, 0.2f);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightEyePos, ROOF_CAP_COLOR);
-      roofcap.Draw();
+      drawList.AddLit(roofcap, modelViewMatrix.GetMatrix(), vLightEyePos, ROOF_CAP_COLOR);
     modelViewMatrix.PopMatrix();
 
   modelViewMatrix.PopMatrix();
@@ -0,0 +1,282 @@
+//
+//  Culling.h
+//  Firewheel
+//
+//  Bounding spheres for the rides and their parts, and a small helper that
+//  tests them against the view frustum while the scene is being drawn.
+//
+
+#ifndef Firewheel_Culling_h
+#define Firewheel_Culling_h
+
+#include <GLTools.h>
+#include <GLFrustum.h>
+#include <GLFrame.h>
+#include <cmath>
+
+/* --------------- */
+/* Bounding sphere */
+
+/* Center is in the object's own coordinates, i.e. relative to the modelview
+   matrix that is current when the object's Draw routine is called. */
+struct BoundingSphere
+{
+  M3DVector3f center;
+  GLfloat     radius;
+};
+
+void SetBoundingSphere(BoundingSphere &sphere, GLfloat x, GLfloat y, GLfloat z, GLfloat radius);
+void SetBoundingSphere(BoundingSphere &sphere, GLfloat x, GLfloat y, GLfloat z, GLfloat radius)
+{
+  sphere.center[0] = x;
+  sphere.center[1] = y;
+  sphere.center[2] = z;
+  sphere.radius = radius;
+}
+
+/* Sphere around the box holding all the points; not minimal, but close enough for culling. */
+void ComputeBoundingSphere(BoundingSphere &sphere, const M3DVector3f points[], int count);
+void ComputeBoundingSphere(BoundingSphere &sphere, const M3DVector3f points[], int count)
+{
+  int i, j;
+  M3DVector3f vMin, vMax;
+
+  if (count <= 0)
+  {
+    SetBoundingSphere(sphere, 0.0f, 0.0f, 0.0f, 0.0f);
+    return;
+  }
+
+  m3dCopyVector3(vMin, points[0]);
+  m3dCopyVector3(vMax, points[0]);
+  for (i = 1; i < count; i++)
+    for (j = 0; j < 3; j++)
+    {
+      if (points[i][j] < vMin[j]) vMin[j] = points[i][j];
+      if (points[i][j] > vMax[j]) vMax[j] = points[i][j];
+    }
+
+  for (j = 0; j < 3; j++)
+    sphere.center[j] = 0.5f * (vMin[j] + vMax[j]);
+
+  float maxDistanceSquared = 0.0f;
+  for (i = 0; i < count; i++)
+  {
+    float d = m3dGetDistanceSquared3(sphere.center, points[i]);
+    if (d > maxDistanceSquared)
+      maxDistanceSquared = d;
+  }
+  sphere.radius = sqrtf(maxDistanceSquared);
+}
+
+/* ------------ */
+/* Scene culler */
+
+const int MAX_CULL_DEPTH = 8;
+
+/* Tests bounding spheres against the view frustum. The frustum planes are put
+   into world space once per frame from the camera frame; each test carries the
+   sphere from the current modelview matrix back into world space with the
+   inverse camera matrix, which also works for the mirrored reflection pass.
+
+   Culling is hierarchical: after a parent (a ride) has been found to be entirely
+   inside the frustum, PushParent() it, and its parts are accepted without being
+   tested until the matching PopParent().
+
+   Counters cover everything since BeginFrame(), including results classified
+   elsewhere and handed over with CountResults() (the park BVH's rides):
+     tested - spheres actually checked against the frustum planes
+     culled - spheres found to be outside, whose objects were skipped
+     drawn  - objects that were let through, tested or not */
+class SceneCuller
+{
+public:
+  SceneCuller();
+
+  void BeginFrame(GLFrustum &frustum, GLFrame &camera);
+
+  GLT_FRUSTUM_TEST Test(const BoundingSphere &sphere, const M3DMatrix44f mModelView);
+  bool IsVisible(const BoundingSphere &sphere, const M3DMatrix44f mModelView)
+    { return Test(sphere, mModelView) != GLT_FRUSTUM_OUTSIDE; }
+
+  void PushParent(GLT_FRUSTUM_TEST result);
+  void PopParent();
+
+  void CountResults(const GLT_FRUSTUM_TEST results[], int count);
+
+  void SetEnabled(bool enable) { enabled = enable; }
+  bool IsEnabled() const       { return enabled; }
+
+  int GetTestedCount() const { return nbrTested; }
+  int GetCulledCount() const { return nbrCulled; }
+  int GetDrawnCount() const  { return nbrDrawn; }
+
+private:
+  GLFrustum   *pFrustum;
+  M3DMatrix44f mCameraToWorld;
+  bool         enabled;
+
+  GLT_FRUSTUM_TEST parents[MAX_CULL_DEPTH];
+  int              depth;
+
+  int nbrTested;
+  int nbrCulled;
+  int nbrDrawn;
+};
+
+SceneCuller::SceneCuller()
+  : pFrustum(NULL), enabled(true), depth(0), nbrTested(0), nbrCulled(0), nbrDrawn(0)
+{
+  m3dLoadIdentity44(mCameraToWorld);
+}
+
+void SceneCuller::BeginFrame(GLFrustum &frustum, GLFrame &camera)
+{
+  M3DMatrix44f mCamera;
+
+  pFrustum = &frustum;
+  pFrustum->Transform(camera);
+
+  camera.GetCameraMatrix(mCamera);
+  m3dInvertMatrix44(mCameraToWorld, mCamera);
+
+  depth = 0;
+  nbrTested = nbrCulled = nbrDrawn = 0;
+}
+
+GLT_FRUSTUM_TEST SceneCuller::Test(const BoundingSphere &sphere, const M3DMatrix44f mModelView)
+{
+  /* Nothing to test against, or the parent is known to be fully visible. */
+  int top = ((depth < MAX_CULL_DEPTH) ? depth : MAX_CULL_DEPTH) - 1;
+  if (!enabled || pFrustum == NULL || (top >= 0 && parents[top] == GLT_FRUSTUM_INSIDE))
+  {
+    nbrDrawn++;
+    return GLT_FRUSTUM_INSIDE;
+  }
+
+  M3DVector3f vEye, vWorld;
+  m3dTransformVector3(vEye, sphere.center, mModelView);
+  m3dTransformVector3(vWorld, vEye, mCameraToWorld);
+
+  /* Scale the radius by the largest axis scale in the modelview. */
+  float scaleSquared = m3dGetVectorLengthSquared3(&mModelView[0]);
+  float s = m3dGetVectorLengthSquared3(&mModelView[4]);
+  if (s > scaleSquared) scaleSquared = s;
+  s = m3dGetVectorLengthSquared3(&mModelView[8]);
+  if (s > scaleSquared) scaleSquared = s;
+
+  nbrTested++;
+  GLT_FRUSTUM_TEST result = pFrustum->ClassifySphere(vWorld, sphere.radius * sqrtf(scaleSquared));
+  if (result == GLT_FRUSTUM_OUTSIDE)
+    nbrCulled++;
+  else
+    nbrDrawn++;
+
+  return result;
+}
+
+void SceneCuller::PushParent(GLT_FRUSTUM_TEST result)
+{
+  /* Too deep: keep counting depth, but stop recording, so Pop still balances. */
+  if (depth < MAX_CULL_DEPTH)
+    parents[depth] = result;
+  depth++;
+}
+
+void SceneCuller::PopParent()
+{
+  if (depth > 0)
+    depth--;
+}
+
+void SceneCuller::CountResults(const GLT_FRUSTUM_TEST results[], int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    if (enabled)
+      nbrTested++;
+    if (results[i] == GLT_FRUSTUM_OUTSIDE)
+      nbrCulled++;
+    else
+      nbrDrawn++;
+  }
+}
+
+/* ------- */
+/* Portals */
+
+/* A convex polygon clipped by n planes gains at most n vertices. */
+const int MAX_PORTAL_VERTICES = 16;
+
+/* Clip the convex polygon in place to the positive side of each plane
+   (Sutherland-Hodgman). poly needs room for MAX_PORTAL_VERTICES; returns the
+   new vertex count, 0 if nothing is left. */
+int ClipPolygonToPlanes(M3DVector3f poly[], int count, const M3DVector4f planes[], int nPlanes);
+int ClipPolygonToPlanes(M3DVector3f poly[], int count, const M3DVector4f planes[], int nPlanes)
+{
+  M3DVector3f clipped[MAX_PORTAL_VERTICES];
+
+  for (int p = 0; p < nPlanes && count > 0; p++)
+  {
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+      const float *a = poly[i];
+      const float *b = poly[(i + 1) % count];
+      float da = m3dGetDistanceToPlane(a, planes[p]);
+      float db = m3dGetDistanceToPlane(b, planes[p]);
+
+      if (da >= 0.0f && n < MAX_PORTAL_VERTICES)
+        m3dCopyVector3(clipped[n++], a);
+      if ((da >= 0.0f) != (db >= 0.0f) && n < MAX_PORTAL_VERTICES)
+      {
+        float t = da / (da - db);
+        for (int j = 0; j < 3; j++)
+          clipped[n][j] = a[j] + t * (b[j] - a[j]);
+        n++;
+      }
+    }
+
+    for (int i = 0; i < n; i++)
+      m3dCopyVector3(poly[i], clipped[i]);
+    count = n;
+  }
+
+  return count;
+}
+
+/* Planes through vEye and each edge of the convex polygon, facing inwards,
+   so together they bound what can be seen from vEye through the polygon.
+   Degenerate edges are skipped; returns the number of planes written. */
+int BuildPortalPlanes(M3DVector4f planes[], const M3DVector3f vEye, const M3DVector3f poly[], int count);
+int BuildPortalPlanes(M3DVector4f planes[], const M3DVector3f vEye, const M3DVector3f poly[], int count)
+{
+  M3DVector3f vCentroid = { 0.0f, 0.0f, 0.0f };
+  int i, n = 0;
+
+  for (i = 0; i < count; i++)
+    m3dAddVectors3(vCentroid, vCentroid, poly[i]);
+  m3dScaleVector3(vCentroid, 1.0f / float(count));
+
+  for (i = 0; i < count; i++)
+  {
+    M3DVector3f vA, vB;
+    m3dSubtractVectors3(vA, poly[i], vEye);
+    m3dSubtractVectors3(vB, poly[(i + 1) % count], vEye);
+    m3dCrossProduct3(planes[n], vA, vB);
+
+    float length = m3dGetVectorLength3(planes[n]);
+    if (length < 1.0e-6f)
+      continue;
+    m3dScaleVector3(planes[n], 1.0f / length);
+    planes[n][3] = -m3dDotProduct3(planes[n], vEye);
+
+    if (m3dGetDistanceToPlane(vCentroid, planes[n]) < 0.0f)
+      m3dScaleVector4(planes[n], -1.0f);
+    n++;
+  }
+
+  return n;
+}
+
+#endif
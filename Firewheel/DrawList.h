@@ -0,0 +1,516 @@
+//
+//  DrawList.h
+//  Firewheel
+//
+//  Records the scene's draws instead of issuing them as the hierarchy is
+//  walked, then submits them sorted so that draws sharing a program, texture
+//  or mesh end up next to each other. Parts of the scene that haven't changed
+//  can keep their draws from an earlier frame and skip the walk entirely.
+//
+
+#ifndef Firewheel_DrawList_h
+#define Firewheel_DrawList_h
+
+#include <GLTools.h>
+#include <GLShaderManager.h>
+#include <GLBatchBase.h>
+#include <vector>
+#include <algorithm>
+
+#include "MultiDraw.h"
+#include "TextureManager.h"
+
+/* Eye space depths beyond this all share the farthest depth bucket. */
+const GLfloat DRAW_LIST_DEPTH_RANGE = 128.0f;
+
+typedef unsigned long long DrawSortKey;
+
+/* Sort key layout, most significant first; the state that is dearest to change
+   gets the highest bits, and depth (front to back, for early depth rejection)
+   only orders draws that share all of it.
+     63-56  program (stock shader)
+     55-40  texture name
+     39-24  mesh (each batch owns its vertex array object)
+     23-0   depth */
+const int DRAW_KEY_PROGRAM_SHIFT = 56;
+const int DRAW_KEY_TEXTURE_SHIFT = 40;
+const int DRAW_KEY_MESH_SHIFT    = 24;
+const DrawSortKey DRAW_KEY_DEPTH_MAX = 0xFFFFFF;
+
+/* Everything needed to issue one lit draw later. */
+struct DrawItem
+{
+  GLBatchBase     *pBatch;
+  GLT_STOCK_SHADER shader;
+  GLuint           texture;
+  GLuint           sampler;     /* 0 for the one the texture was acquired with */
+  M3DMatrix44f     mModelView;
+  M3DVector4f      vLightEyePos;
+  M3DVector4f      vColor;
+};
+
+/* Retained draws for one subtree, relative to the subtree's root: matrices
+   and light positions are stored in the root's space, so the cache stays good
+   while the camera moves, or the root with it. Invalidate() it whenever
+   something inside the subtree changes. */
+class DrawCache
+{
+public:
+  DrawCache() : valid(false) { }
+
+  void Invalidate()     { valid = false; }
+  bool IsValid() const  { return valid; }
+  int  GetCount() const { return (int)items.size(); }
+
+private:
+  friend class DrawList;
+  std::vector<DrawItem> items;
+  bool                  valid;
+};
+
+/* Caches can nest (a static part inside a ride that is being recorded), this deep */
+const int MAX_DRAW_CAPTURE_DEPTH = 4;
+
+/* State changes for one order of a list of draws, and the draw calls it took. */
+struct DrawListStats
+{
+  int draws;
+  int calls;
+  int programSwitches;
+  int textureSwitches;
+  int meshSwitches;
+};
+
+/* Typical pass:
+     drawList.Begin(projection);
+     ... rides call AddLit()/AddTexturedLit() in place of UseStockShader + Draw ...
+     drawList.Submit(shaderManager);
+
+   Only the two point light shaders the rides use are supported. Draws are
+   opaque, so changing their order doesn't change the picture. The counters
+   add up over every Submit() since ResetStats(), for both the order the draws
+   were recorded in and the order they were submitted in.
+
+   A subtree whose draws are retained in a DrawCache is drawn with
+     if (!drawList.UseCache(cache, modelViewMatrix.GetMatrix()))
+     {
+       ... walk the subtree, adding its draws as usual ...
+       drawList.EndCapture(cache);
+     }
+   UseCache() replays a valid cache and returns true. Otherwise it starts
+   recording into the cache, unless cacheable is false (say, because parts
+   of the subtree are being culled), and EndCapture() finishes the recording
+   and adds the draws to the frame.
+
+   With a MultiDrawPool set and enabled, the sorted draws of pooled meshes go
+   out as one multi-draw call per texture instead of one call per draw.
+
+   With a TextureManager set, each texture a draw binds is touched on its way
+   out, at the distance of the draw's origin from the eye, and is sampled with
+   the draw's sampler object, or else the one the texture was acquired with.
+   A pooled draw's texture is touched in the pool's array as well, so that
+   its layer is loaded and kept, while it's bound meanwhile. The sampler
+   binding is undone before Submit() returns. */
+class DrawList
+{
+public:
+  DrawList();
+
+  void Begin(const M3DMatrix44f mProjection);
+  void AddLit(GLBatchBase &batch, const M3DMatrix44f mModelView, const M3DVector4f vLightEyePos, const GLfloat vColor[4]);
+  void AddTexturedLit(GLBatchBase &batch, GLuint texture, const M3DMatrix44f mModelView,
+                      const M3DVector4f vLightEyePos, const GLfloat vColor[4], GLuint sampler = 0);
+  void Submit(GLShaderManager &shaderManager);
+
+  bool UseCache(DrawCache &cache, const M3DMatrix44f mRoot, bool cacheable = true);
+  void EndCapture(DrawCache &cache);
+
+  void SetSorting(bool sort) { sorting = sort; }
+  bool IsSorting() const     { return sorting; }
+
+  void SetMultiDrawPool(MultiDrawPool *pool) { pMultiDraw = pool; }
+  void SetTextureManager(TextureManager *manager) { pTextureManager = manager; }
+
+  void ResetStats();
+  const DrawListStats& GetRecordedStats() const  { return recordedStats; }
+  const DrawListStats& GetSubmittedStats() const { return submittedStats; }
+  int GetCachedDrawCount() const                 { return nbrCachedDraws; }
+
+private:
+  struct SortEntry
+  {
+    DrawSortKey key;
+    int         index;
+    bool operator<(const SortEntry &other) const
+      { return (key != other.key) ? (key < other.key) : (index < other.index); }
+  };
+
+  /* What the previous draw left bound, for counting switches */
+  struct BoundState
+  {
+    GLT_STOCK_SHADER shader;
+    GLuint           texture;
+    GLuint           sampler;
+    GLBatchBase     *pBatch;
+  };
+
+  /* A cache being recorded, and its root's transform both ways */
+  struct Capture
+  {
+    DrawCache   *pCache;
+    M3DMatrix44f mRoot;
+    M3DMatrix44f mInverseRoot;
+  };
+
+  void Add(GLT_STOCK_SHADER shader, GLBatchBase &batch, GLuint texture, GLuint sampler, const M3DMatrix44f mModelView,
+           const M3DVector4f vLightEyePos, const GLfloat vColor[4]);
+  void Append(const DrawItem &item);
+  void Replay(const DrawCache &cache, const M3DMatrix44f mRoot);
+  static DrawSortKey MakeKey(const DrawItem &item);
+  static void ResetBound(BoundState &bound);
+  static bool CountSwitches(DrawListStats &stats, BoundState &bound, const DrawItem &item);
+  void DrawOne(GLShaderManager &shaderManager, DrawItem &item);
+  void TouchTexture(const DrawItem &item);
+  void TouchLayer(const DrawItem &item);
+  static float GetDistance(const DrawItem &item);
+  GLuint GetSampler(const DrawItem &item) const;
+  static void BindSampler(BoundState &bound, GLuint sampler);
+  void SubmitMultiDraw(GLShaderManager &shaderManager);
+
+  std::vector<DrawItem>  items;
+  std::vector<SortEntry> order;
+  M3DMatrix44f           mProjection;
+  bool                   sorting;
+  MultiDrawPool         *pMultiDraw;
+  TextureManager        *pTextureManager;
+  std::vector<bool>      pooled;
+
+  Capture captures[MAX_DRAW_CAPTURE_DEPTH];
+  int     captureDepth;
+
+  DrawListStats recordedStats;
+  DrawListStats submittedStats;
+  int           nbrCachedDraws;
+};
+
+DrawList::DrawList()
+  : sorting(true), pMultiDraw(NULL), pTextureManager(NULL), captureDepth(0)
+{
+  m3dLoadIdentity44(mProjection);
+  ResetStats();
+}
+
+void DrawList::ResetStats()
+{
+  recordedStats.draws = recordedStats.calls = recordedStats.programSwitches = recordedStats.textureSwitches = recordedStats.meshSwitches = 0;
+  submittedStats = recordedStats;
+  nbrCachedDraws = 0;
+}
+
+void DrawList::Begin(const M3DMatrix44f mProjectionMatrix)
+{
+  m3dCopyMatrix44(mProjection, mProjectionMatrix);
+  items.clear();
+  captureDepth = 0;
+}
+
+void DrawList::AddLit(GLBatchBase &batch, const M3DMatrix44f mModelView, const M3DVector4f vLightEyePos, const GLfloat vColor[4])
+{
+  Add(GLT_SHADER_POINT_LIGHT_DIFF, batch, 0, 0, mModelView, vLightEyePos, vColor);
+}
+
+void DrawList::AddTexturedLit(GLBatchBase &batch, GLuint texture, const M3DMatrix44f mModelView,
+                              const M3DVector4f vLightEyePos, const GLfloat vColor[4], GLuint sampler)
+{
+  Add(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, batch, texture, sampler, mModelView, vLightEyePos, vColor);
+}
+
+void DrawList::Add(GLT_STOCK_SHADER shader, GLBatchBase &batch, GLuint texture, GLuint sampler, const M3DMatrix44f mModelView,
+                   const M3DVector4f vLightEyePos, const GLfloat vColor[4])
+{
+  DrawItem item;
+  item.pBatch = &batch;
+  item.shader = shader;
+  item.texture = texture;
+  item.sampler = sampler;
+  m3dCopyMatrix44(item.mModelView, mModelView);
+  m3dCopyVector4(item.vLightEyePos, vLightEyePos);
+  m3dCopyVector4(item.vColor, vColor);
+  Append(item);
+}
+
+/* Into the innermost cache being recorded, moved into its root's space; into the frame otherwise. */
+void DrawList::Append(const DrawItem &item)
+{
+  if (captureDepth == 0)
+  {
+    items.push_back(item);
+    return;
+  }
+
+  const Capture &capture = captures[captureDepth - 1];
+  DrawItem local = item;
+  m3dMatrixMultiply44(local.mModelView, capture.mInverseRoot, item.mModelView);
+  m3dTransformVector4(local.vLightEyePos, item.vLightEyePos, capture.mInverseRoot);
+  capture.pCache->items.push_back(local);
+}
+
+void DrawList::Replay(const DrawCache &cache, const M3DMatrix44f mRoot)
+{
+  int count = (int)cache.items.size();
+  for (int i = 0; i < count; i++)
+  {
+    DrawItem item = cache.items[i];
+    m3dMatrixMultiply44(item.mModelView, mRoot, cache.items[i].mModelView);
+    m3dTransformVector4(item.vLightEyePos, cache.items[i].vLightEyePos, mRoot);
+    Append(item);
+  }
+}
+
+bool DrawList::UseCache(DrawCache &cache, const M3DMatrix44f mRoot, bool cacheable)
+{
+  if (cache.valid)
+  {
+    Replay(cache, mRoot);
+    if (captureDepth == 0)
+      nbrCachedDraws += (int)cache.items.size();
+    return true;
+  }
+
+  if (cacheable && captureDepth < MAX_DRAW_CAPTURE_DEPTH)
+  {
+    Capture &capture = captures[captureDepth++];
+    capture.pCache = &cache;
+    m3dCopyMatrix44(capture.mRoot, mRoot);
+    m3dInvertMatrix44(capture.mInverseRoot, mRoot);
+    cache.items.clear();
+  }
+  return false;
+}
+
+/* Does nothing unless UseCache() started recording into this cache. */
+void DrawList::EndCapture(DrawCache &cache)
+{
+  if (captureDepth == 0 || captures[captureDepth - 1].pCache != &cache)
+    return;
+
+  captureDepth--;
+  cache.valid = true;
+  Replay(cache, captures[captureDepth].mRoot);
+}
+
+DrawSortKey DrawList::MakeKey(const DrawItem &item)
+{
+  /* Batches don't carry an id, so fold the address down; a collision only
+     costs a little grouping, never correctness. */
+  DrawSortKey mesh = ((DrawSortKey)(size_t)item.pBatch >> 4) & 0xFFFF;
+
+  /* Distance in front of the eye, from the translation column */
+  GLfloat depth = -item.mModelView[14] / DRAW_LIST_DEPTH_RANGE;
+  depth = (depth < 0.0f) ? 0.0f : ((depth > 1.0f) ? 1.0f : depth);
+
+  return ((DrawSortKey)item.shader << DRAW_KEY_PROGRAM_SHIFT) |
+         ((DrawSortKey)(item.texture & 0xFFFF) << DRAW_KEY_TEXTURE_SHIFT) |
+         (mesh << DRAW_KEY_MESH_SHIFT) |
+         (DrawSortKey)(depth * DRAW_KEY_DEPTH_MAX);
+}
+
+void DrawList::ResetBound(BoundState &bound)
+{
+  bound.shader = GLT_SHADER_LAST;
+  bound.texture = 0;
+  bound.sampler = 0;
+  bound.pBatch = NULL;
+}
+
+/* Count the state item changes and update bound; true if it needs its texture bound.
+   Untextured draws leave the texture binding alone. */
+bool DrawList::CountSwitches(DrawListStats &stats, BoundState &bound, const DrawItem &item)
+{
+  bool bindTexture = (item.texture != 0 && item.texture != bound.texture);
+
+  stats.draws++;
+  if (item.shader != bound.shader)
+    stats.programSwitches++;
+  if (bindTexture)
+    stats.textureSwitches++;
+  if (item.pBatch != bound.pBatch)
+    stats.meshSwitches++;
+
+  bound.shader = item.shader;
+  bound.pBatch = item.pBatch;
+  if (bindTexture)
+    bound.texture = item.texture;
+  return bindTexture;
+}
+
+void DrawList::Submit(GLShaderManager &shaderManager)
+{
+  int i, count = (int)items.size();
+  BoundState bound;
+
+  /* What the draws would have cost in the order the scene recorded them */
+  ResetBound(bound);
+  order.resize(count);
+  for (i = 0; i < count; i++)
+  {
+    order[i].key = sorting ? MakeKey(items[i]) : 0;
+    order[i].index = i;
+    CountSwitches(recordedStats, bound, items[i]);
+    recordedStats.calls++;
+  }
+  if (sorting)
+    std::sort(order.begin(), order.end());
+
+  if (pMultiDraw != NULL && pMultiDraw->IsEnabled())
+  {
+    SubmitMultiDraw(shaderManager);
+    items.clear();
+    return;
+  }
+
+  ResetBound(bound);
+  for (i = 0; i < count; i++)
+  {
+    DrawItem &item = items[order[i].index];
+    if (CountSwitches(submittedStats, bound, item))
+      glBindTexture(GL_TEXTURE_2D, item.texture);
+    if (item.texture != 0)
+      BindSampler(bound, GetSampler(item));
+    TouchTexture(item);
+    DrawOne(shaderManager, item);
+  }
+  BindSampler(bound, 0);
+
+  items.clear();
+}
+
+void DrawList::TouchTexture(const DrawItem &item)
+{
+  if (pTextureManager != NULL && item.texture != 0)
+    pTextureManager->Touch(item.texture, GetDistance(item));
+}
+
+void DrawList::TouchLayer(const DrawItem &item)
+{
+  if (pTextureManager != NULL && item.texture != 0)
+    pTextureManager->TouchLayer(item.texture, GetDistance(item));
+}
+
+float DrawList::GetDistance(const DrawItem &item)
+{
+  return sqrtf(item.mModelView[12] * item.mModelView[12] +
+               item.mModelView[13] * item.mModelView[13] +
+               item.mModelView[14] * item.mModelView[14]);
+}
+
+GLuint DrawList::GetSampler(const DrawItem &item) const
+{
+  if (item.sampler != 0 || pTextureManager == NULL)
+    return item.sampler;
+  return pTextureManager->GetSampler(item.texture);
+}
+
+/* Only ever non-zero where there are sampler objects */
+void DrawList::BindSampler(BoundState &bound, GLuint sampler)
+{
+  if (sampler != bound.sampler)
+  {
+    glBindSampler(0, sampler);
+    bound.sampler = sampler;
+  }
+}
+
+void DrawList::DrawOne(GLShaderManager &shaderManager, DrawItem &item)
+{
+  if (item.shader == GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF)
+    shaderManager.UseStockShader(item.shader, item.mModelView, mProjection, item.vLightEyePos, item.vColor, 0);
+  else
+    shaderManager.UseStockShader(item.shader, item.mModelView, mProjection, item.vLightEyePos, item.vColor);
+
+  item.pBatch->Draw();
+  submittedStats.calls++;
+}
+
+/* Same order as the regular path, but consecutive pooled draws go out as one
+   call as long as the ones that need a bound texture agree on it and on its
+   sampler; the pool's records for them are consecutive too, since they are
+   added in submission order. The counters here are what the GPU actually sees: a run is one
+   program, one mesh, and at most one texture bind. */
+void DrawList::SubmitMultiDraw(GLShaderManager &shaderManager)
+{
+  int i, count = (int)order.size();
+  BoundState bound;
+
+  pMultiDraw->Begin();
+  pooled.resize(count);
+  for (i = 0; i < count; i++)
+  {
+    const DrawItem &item = items[order[i].index];
+    pooled[i] = pMultiDraw->Add(item.pBatch, item.mModelView, mProjection, item.vLightEyePos, item.vColor, item.texture);
+  }
+  pMultiDraw->Upload();
+
+  ResetBound(bound);
+  bool poolBound = false;
+  int record = 0;
+  i = 0;
+  while (i < count)
+  {
+    DrawItem &item = items[order[i].index];
+    if (!pooled[i])
+    {
+      if (CountSwitches(submittedStats, bound, item))
+        glBindTexture(GL_TEXTURE_2D, item.texture);
+      if (item.texture != 0)
+        BindSampler(bound, GetSampler(item));
+      TouchTexture(item);
+      DrawOne(shaderManager, item);
+      poolBound = false;
+      i++;
+      continue;
+    }
+
+    int first = record;
+    GLuint runTexture = 0, runSampler = 0;
+    for (; i < count && pooled[i]; i++, record++)
+    {
+      GLuint texture = items[order[i].index].texture;
+      if (pMultiDraw->NeedsBinding(texture))
+      {
+        GLuint sampler = GetSampler(items[order[i].index]);
+        if (runTexture != 0 && (texture != runTexture || sampler != runSampler))
+          break;
+        runTexture = texture;
+        runSampler = sampler;
+        TouchTexture(items[order[i].index]);
+      }
+      TouchLayer(items[order[i].index]);
+      submittedStats.draws++;
+    }
+
+    if (runTexture != 0 && runTexture != bound.texture)
+    {
+      glBindTexture(GL_TEXTURE_2D, runTexture);
+      bound.texture = runTexture;
+      submittedStats.textureSwitches++;
+    }
+    if (runTexture != 0)
+      BindSampler(bound, runSampler);
+    if (!poolBound)
+    {
+      submittedStats.programSwitches++;
+      submittedStats.meshSwitches++;
+      poolBound = true;
+    }
+    pMultiDraw->Draw(first, record - first);
+    submittedStats.calls++;
+
+    /* The next stock draw has to set its program and mesh again */
+    bound.shader = GLT_SHADER_LAST;
+    bound.pBatch = NULL;
+  }
+  BindSampler(bound, 0);
+}
+
+#endif
@@ -13,8 +13,10 @@
 #include <GLFrame.h>
 #include <GLMatrixStack.h>
 #include <GLGeometryTransform.h>
+#include <StopWatch.h>
 #include <cmath>
 #include <cstdarg>
+#include <cstdio>
 
 #include "Common.h"
 #include "GLUTKeyCodes.h"
@@ -23,6 +25,19 @@
 #include "WheelTextured.h"
 #include "Carousel.h"
 #include "RollerCoaster.h"
+#include "Culling.h"
+#include "SceneBVH.h"
+#include "OcclusionCulling.h"
+#include "ReflectionTexture.h"
+#include "DrawList.h"
+#include "MultiDraw.h"
+#include "TextureArray.h"
+#include "TextureStreamer.h"
+#include "TextureManager.h"
+#include "FrameCapture.h"
+#include "HeadlessContext.h"
+#include "Benchmark.h"
+#include "GPUTimer.h"
 
 #ifdef __APPLE__
   #include <glut/glut.h>
@@ -47,7 +62,7 @@
 
 const int   ORIG_WINDOW_SIZE[] = { 1000, 1000 };
 const float CAMERA_LINEAR_STEP = 0.1f;
-const float CAMERA_ANGULAR_STEP = float(m3dDegToRad(5.0f));
+const float CAMERA_ANGULAR_STEP = m3dDegToRadf(5.0f);
 const float FRUSTUM_FIELD_OF_VIEW = 35.0f;
 const float FRUSTUM_NEAR_PLANE = 0.1f;
 const float FRUSTUM_FAR_PLANE = 100.0f;
@@ -60,9 +75,36 @@ const float FLOOR_HEIGHT = -0.65f;
 const float REFLECTING_ALPHA = 0.5f;
 const float NONREFLECTING_ALPHA = 1.0f;
 
+// The reflection pass is culled against the floor's visible part: one plane per
+// edge of the floor once clipped to the frustum, plus the floor and far planes.
+const int   MAX_REFLECTION_PLANES = MAX_PORTAL_VERTICES + 2;
+
 /* ------------------------------- */
 
 const float FERRIS_WHEEL_POSITION[] = { 0.0f, 0.0f, -2.5f };
+const float ROLLER_COASTER_POSITION[] = { 0.0f, 0.0f, -10.0f };
+const float CAROUSEL_POSITION[] = { 0.0f, 0.0f, -3.0f };
+const float ANIMAL_POSITION[] = { 0.0f, 0.0f, -2.0f };
+
+/* ------------------------------- */
+
+/* Everything the park-wide BVH knows about; the wheel's cars follow the rides.
+   Only the rides DrawScene draws are in it: the track, carousel, unicorn and
+   ostrich come back with their Draw calls. */
+enum ParkObject { PARK_WHEEL = 0, PARK_TURTLE,
+                  PARK_FIRST_WHEEL_CAR, NBR_PARK_OBJECTS = PARK_FIRST_WHEEL_CAR + NBR_CARS };
+
+const char *PARK_OBJECT_NAME[PARK_FIRST_WHEEL_CAR] = {
+  "Ferris wheel", "Turtle"
+};
+
+/* The rides DrawScene draws, and so the only ones with occlusion queries. */
+const int   NBR_OCCLUDED_RIDES = 2;
+const int   OCCLUDED_RIDES[NBR_OCCLUDED_RIDES] = { PARK_WHEEL, PARK_TURTLE };
+
+/* The wheel's cars drop their thin parts beyond this distance. */
+const int   NBR_WHEEL_LOD_DISTANCES = 1;
+const float WHEEL_LOD_DISTANCES[NBR_WHEEL_LOD_DISTANCES] = { 8.0f };
 
 /* ------------------------------- */
 
@@ -71,6 +113,36 @@ const int   NBR_WHEEL_TEXTURES = 3;
 const int   NBR_WALL_TEXTURES = 4;
 const int   NBR_CAR_TEXTURES = 4;
 
+/* The rides' textures are kept within this, evicting the longest undrawn */
+const size_t TEXTURE_BUDGET_BYTES = 48 * 1024 * 1024;
+
+/* ------------------------------- */
+
+/* A benchmark steps the animation every 50 ms of simulated time, as the timer
+   does in real time, and flies the camera once around the park on that clock. */
+const float BENCHMARK_TIMESTEP = 0.05f;
+const int   NBR_BENCHMARK_CAMERA_KEYS = 7;
+const CameraKey BENCHMARK_CAMERA_PATH[NBR_BENCHMARK_CAMERA_KEYS] = {
+  {  0.0f, {  0.0f, 0.0f,   0.0f }, { 0.0f, 0.0f, -2.5f } },
+  {  4.0f, {  3.0f, 0.5f,  -1.0f }, { 0.0f, 0.0f, -3.0f } },
+  {  8.0f, {  4.0f, 1.5f,  -6.0f }, { 0.0f, 0.0f, -6.0f } },
+  { 12.0f, {  0.0f, 2.0f, -14.0f }, { 0.0f, 0.0f, -8.0f } },
+  { 16.0f, { -4.0f, 1.0f,  -6.0f }, { 0.0f, 0.0f, -4.0f } },
+  { 20.0f, { -2.0f, 0.3f,   1.0f }, { 0.0f, 0.0f, -2.5f } },
+  { 24.0f, {  0.0f, 0.0f,   0.0f }, { 0.0f, 0.0f, -2.5f } }
+};
+
+/* ------------------------------- */
+
+/* The passes timed on the GPU. The rides are recorded and then submitted as
+   one sorted list, so they're timed together, as the submission. */
+enum GPUPass { GPU_PASS_FRAME = 0, GPU_PASS_REFLECTION, GPU_PASS_GROUND, GPU_PASS_RIDES,
+               GPU_PASS_OCCLUSION, NBR_GPU_PASSES };
+
+const char *GPU_PASS_NAME[NBR_GPU_PASSES] = {
+  "frame", "reflection", "ground", "rides", "occlusion"
+};
+
 /* ------------------------------- */
 
 const int   MAX_FILENAME_LENGTH = 20;
@@ -102,12 +174,31 @@ GLMatrixStack modelViewMatrix; // Modelview Matrix
 GLMatrixStack projectionMatrix; // Projection Matrix
 GLFrustum viewFrustum; // View Frustum
 GLGeometryTransform	transformPipeline; // Geometry Transform Pipeline
+SceneCuller sceneCuller; // Frustum culling of the rides and their parts
+SceneBVH parkBVH; // World-space bounds of every ride, for culling, picking and LOD
+GLT_FRUSTUM_TEST parkVisibility[NBR_PARK_OBJECTS]; // Main pass, from parkBVH
+GLT_FRUSTUM_TEST parkReflectionVisibility[NBR_PARK_OBJECTS]; // Mirrored pass, from parkBVH
+OcclusionCuller occlusionCuller; // Skips rides hidden behind other rides (main pass only)
+ReflectionTexture reflectionTexture; // Reduced resolution target for the reflection
+DrawList drawList; // The rides' draws for the current pass, submitted sorted by state
+MultiDrawPool multiDrawPool; // The rides' meshes in shared buffers, for one call per texture
+TextureArray rideTextureArray; // The wheel's textures as layers, so its draws needn't rebind
+TextureStreamer textureStreamer; // Loads the textures in the background, a few uploads a frame
+TextureManager textureManager; // Loads the rides' textures as they're drawn, within the budget
+FrameCapture frameCapture; // Screenshots and recordings, read back and written without stalling
+DrawCache rideDrawCache[PARK_FIRST_WHEEL_CAR]; // Each ride's retained draws, main pass
+DrawCache rideReflectionDrawCache[PARK_FIRST_WHEEL_CAR]; // The same for the mirrored pass
+CStopWatch cullStatsTimer; // Paces the culling counters in the title bar
+GPUTimers gpuTimers; // Each pass's GPU time, averaged over the last few dozen frames
 
 /* ------------------------------- */
 
 Wheel   theWheel;
+int     windowWidth = ORIG_WINDOW_SIZE[0];
+int     windowHeight = ORIG_WINDOW_SIZE[1];
 bool    fullscreen = false;
 bool    reflecting = false;
+int     reflectionMode = 0; // Index into REFLECTION_DIVISORS
 int     currentTextureIndex = 0;
 GLBatch groundBatch;
 GLFrame cameraFrame;
@@ -116,17 +207,26 @@ GLuint  capTexture[NBR_TEXTURE_SETS];
 GLuint  wheelTexture[NBR_WHEEL_TEXTURES];
 GLuint  wallTexture[NBR_TEXTURE_SETS][NBR_WALL_TEXTURES];
 GLuint  carTexture[NBR_CAR_TEXTURES];
+bool    reportingGPUTimes = false; // Print the passes' GPU times with the title bar's counters
 
 /* ------------------------------- */
 
 void SetupRenderingContext();
 void ShutdownRenderingContext();
-bool LoadBMPTexture(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode);
 void ResizeWindow(int nWidth, int nHeight);
 void Display();
-void DrawGround();
-void DrawScene();
+void DrawFrame();
+void DrawGround(bool reflectionInTexture);
+void DrawReflection(const M3DMatrix44f mCamera);
+void DrawScene(const GLT_FRUSTUM_TEST visibility[], DrawCache rideCache[]);
+void InvalidateRideDraws(int ride);
+int  GetReflectionPlanes(M3DVector4f planes[], const M3DVector3f vCameraPosition);
+void SetupParkBVH();
+void UpdateParkBVH();
+void MouseClick(int button, int state, int mouseXPosition, int mouseYPosition);
 void TimerFunction(int value);
+void UpdateScene();
+int  RunHeadless(const HeadlessOptions &options);
 void KeyboardPress(unsigned char pressedKey, int mouseXPosition, int mouseYPosition);
 void NonASCIIKeyboardPress(int key, int mouseXPosition, int mouseYPosition);
 
@@ -157,6 +257,13 @@ int main(int argc, char* argv[])
 {
 	gltSetWorkingDirectory(argv[0]);
 
+	// --headless renders into an offscreen framebuffer, with no window at all
+	HeadlessOptions headless;
+	if (!ParseHeadlessOptions(argc, argv, ORIG_WINDOW_SIZE[0], ORIG_WINDOW_SIZE[1], headless))
+		return -1;
+	if (headless.enabled)
+		return RunHeadless(headless);
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutInitWindowSize(ORIG_WINDOW_SIZE[0], ORIG_WINDOW_SIZE[1]);
@@ -172,6 +279,7 @@ int main(int argc, char* argv[])
 
 	glutKeyboardFunc( KeyboardPress );
 	glutSpecialFunc( NonASCIIKeyboardPress );
+	glutMouseFunc( MouseClick );
 	glutReshapeFunc( ResizeWindow );
 	glutDisplayFunc( Display );
 	glutTimerFunc( 50, TimerFunction, 1 );
@@ -201,13 +309,27 @@ void SetupRenderingContext()
   /* Scene objects */
 
   track.SetupRenderingContext();
+  track.SetCuller(&sceneCuller);
 	theWheel.SetupRenderingContext();
+	theWheel.SetCuller(&sceneCuller);
   carousel.SetupRenderingContext();
 
   unicorn.SetupRenderingContext();
   ostrich.SetupRenderingContext();
   turtle.SetupRenderingContext();
 
+  SetupParkBVH();
+  parkBVH.SetCuller(&sceneCuller);
+  occlusionCuller.SetupRenderingContext(OCCLUDED_RIDES, NBR_OCCLUDED_RIDES);
+  reflectionTexture.SetupRenderingContext();
+  multiDrawPool.SetupRenderingContext();
+  drawList.SetMultiDrawPool(&multiDrawPool);
+  textureStreamer.SetupRenderingContext(2, GetProcessorCount() / 2); // half the cores share the images' rows
+  textureManager.SetupRenderingContext(&textureStreamer, TEXTURE_BUDGET_BYTES);
+  drawList.SetTextureManager(&textureManager);
+  frameCapture.SetupRenderingContext();
+  gpuTimers.SetupRenderingContext(GPU_PASS_NAME, NBR_GPU_PASSES);
+
   /* --------------- */
 	/* Make the ground */
 
@@ -227,50 +349,78 @@ void SetupRenderingContext()
 	/* Make texture object for ground. */
 
 	glGenTextures(1, &groundTexture);
-	glBindTexture(GL_TEXTURE_2D, groundTexture);
-	LoadBMPTexture(GROUND_TEXTURE_FILENAME, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
+	textureStreamer.Load(groundTexture, GROUND_TEXTURE_FILENAME, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT);
 	
-  /* ----------------------------- */
-	/* Make texture objects for cap. */
+  /* -------------------------------------------------------------------- */
+	/* Acquire the texture objects for the cap; a file that's already been  */
+	/* acquired, by any part of the ride, hands back the same texture.      */
 
-	glGenTextures(NBR_TEXTURE_SETS, capTexture);
 	for ( i = 0; i < NBR_TEXTURE_SETS; i++ )
 	{
-		glBindTexture(GL_TEXTURE_2D, capTexture[i]);
-		LoadBMPTexture(CAP_TEXTURE_FILENAME[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+		capTexture[i] = textureManager.Acquire(CAP_TEXTURE_FILENAME[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
 	}
 
-  /* ------------------------------------------ */
-	/* Make texture objects for wheel components. */
+  /* --------------------------------------------- */
+	/* Acquire texture objects for wheel components. */
 
-	glGenTextures(NBR_WHEEL_TEXTURES, wheelTexture);
 	for ( i = 0; i < NBR_WHEEL_TEXTURES; i++ )
 	{
-		glBindTexture(GL_TEXTURE_2D, wheelTexture[i]);
-		LoadBMPTexture(WHEEL_TEXTURE_FILENAME[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+		wheelTexture[i] = textureManager.Acquire(WHEEL_TEXTURE_FILENAME[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
 	}
 
-  /* ------------------------------------------------ */
-	/* Make texture objects for Ferris wheel car walls. */
+  /* --------------------------------------------------- */
+	/* Acquire texture objects for Ferris wheel car walls. */
 
 	for ( i = 0; i < NBR_TEXTURE_SETS; i++ )
 	{
-		glGenTextures(NBR_WALL_TEXTURES, wallTexture[i]);
 		for ( j = 0; j < NBR_WALL_TEXTURES; j++ )
 		{
-			glBindTexture(GL_TEXTURE_2D, wallTexture[i][j]);
-			LoadBMPTexture(WALL_TEXTURE_FILENAME[i][j], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+			wallTexture[i][j] = textureManager.Acquire(WALL_TEXTURE_FILENAME[i][j], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
 		}
 	}
 
-  /* ---------------------------------------- */
-	/* Make texture objects for car components. */
+  /* ------------------------------------------- */
+	/* Acquire texture objects for car components. */
 
-	glGenTextures(NBR_CAR_TEXTURES, carTexture);
 	for ( i = 0; i < NBR_CAR_TEXTURES; i++ )
 	{
-		glBindTexture(GL_TEXTURE_2D, carTexture[i]);
-		LoadBMPTexture(CAR_TEXTURE_FILENAME[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+		carTexture[i] = textureManager.Acquire(CAR_TEXTURE_FILENAME[i], GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+	}
+
+  /* ----------------------------------------------------------------------- */
+	/* Start on the set that shows first; the other loads when it's drawn, and */
+	/* either set can be evicted again once it hasn't been drawn for a while.  */
+
+	textureManager.Prefetch(capTexture[currentTextureIndex]);
+	for ( j = 0; j < NBR_WALL_TEXTURES; j++ )
+		textureManager.Prefetch(wallTexture[currentTextureIndex][j]);
+	for ( i = 0; i < NBR_WHEEL_TEXTURES; i++ )
+		textureManager.Prefetch(wheelTexture[i]);
+	for ( i = 0; i < NBR_CAR_TEXTURES; i++ )
+		textureManager.Prefetch(carTexture[i]);
+
+  /* ------------------------------------------------------------------------- */
+	/* Layer the same images into one array texture for the multi-draw path, so  */
+	/* every car, whatever its wall, and either texture set, shares one binding. */
+	/* It has room for one set and the images every set shares: a layer streams  */
+	/* in once it's drawn from, taking the place of one gone undrawn, like the   */
+	/* other set's on a switch, and the 2D textures stand in for it until then. */
+
+	for ( i = 0; i < NBR_TEXTURE_SETS; i++ )
+	{
+		rideTextureArray.AddTexture(capTexture[i], CAP_TEXTURE_FILENAME[i]);
+		for ( j = 0; j < NBR_WALL_TEXTURES; j++ )
+			rideTextureArray.AddTexture(wallTexture[i][j], WALL_TEXTURE_FILENAME[i][j]);
+	}
+	for ( i = 0; i < NBR_WHEEL_TEXTURES; i++ )
+		rideTextureArray.AddTexture(wheelTexture[i], WHEEL_TEXTURE_FILENAME[i]);
+	for ( i = 0; i < NBR_CAR_TEXTURES; i++ )
+		rideTextureArray.AddTexture(carTexture[i], CAR_TEXTURE_FILENAME[i]);
+	if (rideTextureArray.SetupRenderingContext(&textureStreamer,
+	                                           rideTextureArray.GetFileCount() - (NBR_TEXTURE_SETS - 1) * (1 + NBR_WALL_TEXTURES)))
+	{
+		multiDrawPool.SetTextureArray(&rideTextureArray);
+		textureManager.SetTextureArray(&rideTextureArray);
 	}
 }
 
@@ -280,47 +430,17 @@ void SetupRenderingContext()
 
 void ShutdownRenderingContext()
 {
+	textureStreamer.ShutdownRenderingContext();
+	textureManager.ShutdownRenderingContext();
+	frameCapture.ShutdownRenderingContext();
+	gpuTimers.ShutdownRenderingContext();
+	occlusionCuller.ShutdownRenderingContext();
+	reflectionTexture.ShutdownRenderingContext();
+	multiDrawPool.ShutdownRenderingContext();
+	rideTextureArray.ShutdownRenderingContext();
+
+	// The rides' textures went with the texture manager, which owns them
 	glDeleteTextures(1, &groundTexture);
-	glDeleteTextures(NBR_TEXTURE_SETS, capTexture);
-	glDeleteTextures(NBR_WHEEL_TEXTURES, wheelTexture);
-	for (int i = 0; i < NBR_TEXTURE_SETS; i++)
-		glDeleteTextures(NBR_WALL_TEXTURES, wallTexture[i]);
-	glDeleteTextures(NBR_CAR_TEXTURES, carTexture);
-}
-
-
-/* -------------------------------------------------------------------------------------- */
-/* Load in a BMP file as a texture. Allows specification of the filters and the wrap mode */
-
-bool LoadBMPTexture(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode)	
-{
-	GLbyte *pBits;
-	GLint iWidth, iHeight;
-
-	pBits = gltReadBMPBits(szFileName, &iWidth, &iHeight);
-	if(pBits == NULL)
-		return false;
-
-    // Set Wrap modes
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, iWidth, iHeight, 0, GL_BGR, GL_UNSIGNED_BYTE, pBits);
-
-  free(pBits);
-  
-  switch (minFilter) {
-    case GL_LINEAR_MIPMAP_LINEAR:
-    case GL_LINEAR_MIPMAP_NEAREST:
-    case GL_NEAREST_MIPMAP_LINEAR:
-    case GL_NEAREST_MIPMAP_NEAREST:
-      glGenerateMipmap(GL_TEXTURE_2D);
-  }
-
-	return true;
 }
 
 
@@ -330,6 +450,9 @@ bool LoadBMPTexture(const char *szFileName, GLenum minFilter, GLenum magFilter,
 void ResizeWindow(int nWidth, int nHeight)
 {
 	glViewport(0, 0, nWidth, nHeight);
+	windowWidth = nWidth;
+	windowHeight = (nHeight > 0) ? nHeight : 1;
+	reflectionTexture.Resize(windowWidth, windowHeight);
 
 	// Create the projection matrix, and load it on the projection matrix stack
 	viewFrustum.SetPerspective(FRUSTUM_FIELD_OF_VIEW, float(nWidth)/float(nHeight), FRUSTUM_NEAR_PLANE, FRUSTUM_FAR_PLANE);
@@ -345,73 +468,267 @@ void ResizeWindow(int nWidth, int nHeight)
 
 void Display()
 {
+	DrawFrame();
+
+	// Report the culling counters for this frame (both passes) about once a second
+	if (cullStatsTimer.GetElapsedSeconds() >= 1.0f)
+	{
+		const DrawListStats &recorded = drawList.GetRecordedStats();
+		const DrawListStats &submitted = drawList.GetSubmittedStats();
+		char title[512];
+		sprintf(title, "Textured Ferris Wheel - culling %s: %d tested, %d culled, %d drawn - occlusion %s: %d queries, %d draws saved"
+				" - sorting %s: %d draws (%d retained), program %d/%d, texture %d/%d, mesh %d/%d switches"
+				" - multi-draw %s: %d calls - textures %d/%d resident, layers %d/%d, %.1f/%.0f MB, %d levels dropped",
+				sceneCuller.IsEnabled() ? "on" : "off", sceneCuller.GetTestedCount(),
+				sceneCuller.GetCulledCount(), sceneCuller.GetDrawnCount(),
+				occlusionCuller.IsEnabled() ? "on" : "off", occlusionCuller.GetQueryCount(),
+				occlusionCuller.GetDrawsSavedCount(),
+				drawList.IsSorting() ? "on" : "off", submitted.draws, drawList.GetCachedDrawCount(),
+				recorded.programSwitches, submitted.programSwitches, recorded.textureSwitches, submitted.textureSwitches,
+				recorded.meshSwitches, submitted.meshSwitches,
+				multiDrawPool.IsEnabled() ? "on" : (multiDrawPool.IsSupported() ? "off" : "unsupported"), submitted.calls,
+				textureManager.GetResidentCount(), textureManager.GetTextureCount(),
+				rideTextureArray.GetResidentCount(), rideTextureArray.GetLayerCount(), textureManager.GetResidentBytes() / 1048576.0f,
+				textureManager.GetBudget() / 1048576.0f, textureManager.GetDetailBias());
+		glutSetWindowTitle(title);
+		if (reportingGPUTimes)
+			gpuTimers.Print("Textured Ferris Wheel");
+		cullStatsTimer.Reset();
+	}
+
+	// Start reading the frame back, if it's being captured, before it's swapped out
+	frameCapture.Capture();
+
+	// Do the buffer Swap
+	glutSwapBuffers();
+
+	// Tell GLUT to do it again
+	glutPostRedisplay();
+}
+
+
+/* ---------------------------------------------------------------------------- */
+/* Draws a frame into the bound framebuffer, the window's or the offscreen one. */
+
+void DrawFrame()
+{
+	// Timed from the first upload to the last occlusion query
+	gpuTimers.BeginFrame();
+	gpuTimers.Begin(GPU_PASS_FRAME);
+
+	// Load what was drawn last frame and evict to the budget, then upload
+	// whatever textures the loaders have ready
+	textureManager.Update();
+	textureStreamer.Update();
+
 	// Clear the color and depth buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// Bring the frustum planes up to date with the camera and zero the counters
+	sceneCuller.BeginFrame(viewFrustum, cameraFrame);
+	drawList.ResetStats();
+
+	M3DVector3f vCameraPosition;
+	cameraFrame.GetOrigin(vCameraPosition);
+
+	// Which rides are in view, directly and in the floor's reflection. The rides
+	// go into the culling counters here; the wheel counts its own cars as it draws.
+	M3DVector4f planes[MAX_REFLECTION_PLANES];
+	viewFrustum.GetPlanes(planes);
+	parkBVH.QueryFrustum(planes, parkVisibility);
+	sceneCuller.CountResults(parkVisibility, PARK_FIRST_WHEEL_CAR);
+
+	// Drop the rides whose boxes were hidden last frame. The reflection is seen
+	// through the floor rather than past the other rides, so it isn't affected.
+	occlusionCuller.CollectResults(parkVisibility);
+
+	int nbrReflectionPlanes = reflecting ? GetReflectionPlanes(planes, vCameraPosition) : 0;
+	if (nbrReflectionPlanes > 0)
+	{
+		parkBVH.QueryFrustum(planes, parkReflectionVisibility, nbrReflectionPlanes);
+		sceneCuller.CountResults(parkReflectionVisibility, PARK_FIRST_WHEEL_CAR);
+	}
+
+	// Level of detail from the camera's distance to each ride; the wheel's retained draws go with a change
+	int wheelDetailLevel = parkBVH.SelectLOD(PARK_WHEEL, vCameraPosition, WHEEL_LOD_DISTANCES, NBR_WHEEL_LOD_DISTANCES);
+	if (wheelDetailLevel != theWheel.GetDetailLevel())
+		InvalidateRideDraws(PARK_WHEEL);
+	theWheel.SetDetailLevel(wheelDetailLevel);
+
 	// Save the current modelview matrix (the identity matrix)
 	modelViewMatrix.PushMatrix();	
 		M3DMatrix44f mCamera;
 		cameraFrame.GetCameraMatrix(mCamera);
 		modelViewMatrix.MultMatrix(mCamera);
 
-		if (reflecting)
+		// No reflection pass at all when none of the floor is on screen
+		bool reflectionInTexture = false;
+		if (nbrReflectionPlanes == 0)
+			reflectionTexture.Invalidate();
+		else if (reflectionTexture.IsEnabled())
 		{
-			// Draw the "reflection" of the scene upside down
-			modelViewMatrix.PushMatrix();
-
-				// Flip the y-axis last.
-				modelViewMatrix.Scale(1.0f, -1.0f, 1.0f);
-
-				// The scene is essentially in a pit, bo elevate it an equal distance from the
-				// x-z plane to ensure that its reflection will appear to be below the ground.
-				modelViewMatrix.Translate(0.0f, -2.0f * FLOOR_HEIGHT, 0.0f);
-
-				// Reverse the orientation of all polygonsm in the scene so the orientation of
-				// their reflections will produce the same lighting as the above-ground scene.
-				glFrontFace(GL_CW);
-				DrawScene();
-				glFrontFace(GL_CCW);
+			// Into the reduced resolution texture, which the ground shader blends in
+			if (reflectionTexture.NeedsUpdate(mCamera))
+			{
+				reflectionTexture.BeginRender();
+				DrawReflection(mCamera);
+				reflectionTexture.EndRender();
+			}
+			reflectionInTexture = true;
+		}
+		else
+		{
+			// Straight into the window, under the blended ground
+			DrawReflection(mCamera);
 
-			modelViewMatrix.PopMatrix();
+			// The oblique projection's depths don't compare with the regular one's
+			glClear(GL_DEPTH_BUFFER_BIT);
 		}
 
-  DrawGround();
-  DrawScene();
+  DrawGround(reflectionInTexture);
+  DrawScene(parkVisibility, rideDrawCache);
 
-	modelViewMatrix.PopMatrix();
+		// With the depth buffer complete, find out which ride boxes are hidden, for next frame
+		BoundingSphere rideBounds[PARK_FIRST_WHEEL_CAR];
+		for (int i = 0; i < PARK_FIRST_WHEEL_CAR; i++)
+			rideBounds[i] = parkBVH.GetObjectBounds(i);
+		gpuTimers.Begin(GPU_PASS_OCCLUSION);
+		occlusionCuller.IssueQueries(rideBounds, vCameraPosition, modelViewMatrix, shaderManager, transformPipeline);
+		gpuTimers.End(GPU_PASS_OCCLUSION);
 
-	// Do the buffer Swap
-	glutSwapBuffers();
+	modelViewMatrix.PopMatrix();
 
-	// Tell GLUT to do it again
-	glutPostRedisplay();
+	gpuTimers.End(GPU_PASS_FRAME);
+	gpuTimers.EndFrame();
 }
 
 
-/* ---------------------------------- */
-/* Renders the texture-mapped ground. */
+/* ---------------------------------------------------------------------------- */
+/* Renders the texture-mapped ground, blended over whatever is already drawn, or */
+/* over the reflection texture when the reflection was drawn into it instead.    */
 
-void DrawGround()
+void DrawGround(bool reflectionInTexture)
 {
-	glEnable(GL_BLEND);
+	ScopedGPUTimer timer(gpuTimers, GPU_PASS_GROUND);
+
 	glBindTexture(GL_TEXTURE_2D, groundTexture);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	static GLfloat vFloorColor[] = { 1.0f, 1.0f, 1.0f, REFLECTING_ALPHA};
 	if (reflecting)
 		vFloorColor[3] = REFLECTING_ALPHA;
 	else
 		vFloorColor[3] = NONREFLECTING_ALPHA;
+
+	if (reflectionInTexture)
+	{
+		reflectionTexture.UseGroundShader(transformPipeline.GetModelViewProjectionMatrix(), vFloorColor, 0);
+		groundBatch.Draw();
+		return;
+	}
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	shaderManager.UseStockShader(GLT_SHADER_TEXTURE_MODULATE, transformPipeline.GetModelViewProjectionMatrix(), vFloorColor, 0);	
 	groundBatch.Draw();
 	glDisable(GL_BLEND);
 }
 
 
-/* ---------------------------------------------------------- */
-/* Renders the Ferris wheel objects via Wheel's Draw routine. */
+/* ------------------------------------------------------------------------- */
+/* Renders the scene mirrored in the floor, with the camera on the modelview */
+/* matrix, into whichever framebuffer is bound.                              */
+
+void DrawReflection(const M3DMatrix44f mCamera)
+{
+	ScopedGPUTimer timer(gpuTimers, GPU_PASS_REFLECTION);
+
+	// Clip away anything of the reflection that pokes up through the floor,
+	// by making the floor the near plane: world plane (0, -1, 0, h), in eye space
+	M3DMatrix44f mCameraToWorld, mOblique;
+	M3DVector4f vFloorPlane;
+	m3dInvertMatrix44(mCameraToWorld, mCamera);
+	for (int i = 0; i < 4; i++)
+		vFloorPlane[i] = FLOOR_HEIGHT * mCameraToWorld[4 * i + 3] - mCameraToWorld[4 * i + 1];
+	viewFrustum.GetObliqueProjectionMatrix(mOblique, vFloorPlane);
+	projectionMatrix.PushMatrix();
+	projectionMatrix.LoadMatrix(mOblique);
+
+	// Draw the "reflection" of the scene upside down
+	modelViewMatrix.PushMatrix();
+
+		// Flip the y-axis last.
+		modelViewMatrix.Scale(1.0f, -1.0f, 1.0f);
+
+		// The scene is essentially in a pit, bo elevate it an equal distance from the
+		// x-z plane to ensure that its reflection will appear to be below the ground.
+		modelViewMatrix.Translate(0.0f, -2.0f * FLOOR_HEIGHT, 0.0f);
+
+		// Reverse the orientation of all polygonsm in the scene so the orientation of
+		// their reflections will produce the same lighting as the above-ground scene.
+		glFrontFace(GL_CW);
+		DrawScene(parkReflectionVisibility, rideReflectionDrawCache);
+		glFrontFace(GL_CCW);
+
+	modelViewMatrix.PopMatrix();
+	projectionMatrix.PopMatrix();
+}
+
+
+/* ---------------------------------------------------------------------------- */
+/* Planes bounding the rides whose reflections can be seen, for the BVH; 0 when */
+/* none of the floor is on screen or the camera is beneath it. A point's        */
+/* reflection is seen from the camera through the floor exactly when the point  */
+/* itself is seen from the mirrored camera through the same spot, so clip the   */
+/* floor to the frustum and take the pyramid from the mirrored camera through   */
+/* what is left, closed off by the floor and the mirrored far plane.            */
 
-void DrawScene()
+int GetReflectionPlanes(M3DVector4f planes[], const M3DVector3f vCameraPosition)
 {
+	if (vCameraPosition[1] <= FLOOR_HEIGHT)
+		return 0;
+
+	M3DVector4f frustumPlanes[6];
+	viewFrustum.GetPlanes(frustumPlanes);
+
+	float halfWidth = 0.5f * FLOOR_GRID_WIDTH;
+	M3DVector3f floorCorners[MAX_PORTAL_VERTICES] = {
+		{ -halfWidth, FLOOR_HEIGHT,  halfWidth }, {  halfWidth, FLOOR_HEIGHT,  halfWidth },
+		{  halfWidth, FLOOR_HEIGHT, -halfWidth }, { -halfWidth, FLOOR_HEIGHT, -halfWidth } };
+	int nbrCorners = ClipPolygonToPlanes(floorCorners, 4, frustumPlanes, 6);
+	if (nbrCorners < 3)
+		return 0;
+
+	M3DVector3f vMirroredCamera = { vCameraPosition[0], 2.0f * FLOOR_HEIGHT - vCameraPosition[1], vCameraPosition[2] };
+	int nbrPlanes = BuildPortalPlanes(planes, vMirroredCamera, floorCorners, nbrCorners);
+
+	// Above the floor
+	planes[nbrPlanes][0] = 0.0f;
+	planes[nbrPlanes][1] = 1.0f;
+	planes[nbrPlanes][2] = 0.0f;
+	planes[nbrPlanes][3] = -FLOOR_HEIGHT;
+	nbrPlanes++;
+
+	// Mirror of the far plane: (a, b, c, d) -> (a, -b, c, d + 2bh)
+	m3dCopyVector4(planes[nbrPlanes], frustumPlanes[1]);
+	planes[nbrPlanes][3] += 2.0f * planes[nbrPlanes][1] * FLOOR_HEIGHT;
+	planes[nbrPlanes][1] = -planes[nbrPlanes][1];
+	nbrPlanes++;
+
+	return nbrPlanes;
+}
+
+
+/* ------------------------------------------------------------------------------ */
+/* Renders the Ferris wheel objects via Wheel's Draw routine. Rides are skipped    */
+/* when the BVH query for this pass put them outside the frustum; their parts are */
+/* then tested by the scene culler only if the ride straddles the frustum. The    */
+/* rides record their draws, which are submitted together, sorted, at the end.    */
+/* A ride that hasn't changed replays its draws from rideCache instead of being   */
+/* walked again; straddling rides with culled parts aren't retained.             */
+
+void DrawScene(const GLT_FRUSTUM_TEST visibility[], DrawCache rideCache[])
+{
+	drawList.Begin(transformPipeline.GetProjectionMatrix());
+
 	modelViewMatrix.PushMatrix();	
 		M3DMatrix44f mCamera;
 		cameraFrame.GetCameraMatrix(mCamera);
@@ -429,8 +746,16 @@ void DrawScene()
       modelViewMatrix.Translate(FERRIS_WHEEL_POSITION[0], FERRIS_WHEEL_POSITION[1], FERRIS_WHEEL_POSITION[2]);
 
       /* Apply the Translation to this entire block of objects */
+      /* Cars are only tested individually when the wheel straddles the frustum */
       modelViewMatrix.PushMatrix();
-        //theWheel.Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos, capTexture, wheelTexture, wallTexture, carTexture, currentTextureIndex);
+        if (visibility[PARK_WHEEL] != GLT_FRUSTUM_OUTSIDE &&
+            !drawList.UseCache(rideCache[PARK_WHEEL], modelViewMatrix.GetMatrix(), visibility[PARK_WHEEL] == GLT_FRUSTUM_INSIDE))
+        {
+          sceneCuller.PushParent(visibility[PARK_WHEEL]);
+          theWheel.Draw(modelViewMatrix, drawList, vLightEyePos, capTexture, wheelTexture, wallTexture, carTexture, currentTextureIndex);
+          sceneCuller.PopParent();
+          drawList.EndCapture(rideCache[PARK_WHEEL]);
+        }
       modelViewMatrix.PopMatrix();
 
     modelViewMatrix.PopMatrix();
@@ -439,7 +764,7 @@ void DrawScene()
     /* ROLLER COASTER */
 
     modelViewMatrix.PushMatrix();
-      modelViewMatrix.Translate(0.0, 0.0, -10.0);
+      modelViewMatrix.Translate(ROLLER_COASTER_POSITION[0], ROLLER_COASTER_POSITION[1], ROLLER_COASTER_POSITION[2]);
       //track.Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos);
     modelViewMatrix.PopMatrix();
 
@@ -448,18 +773,84 @@ void DrawScene()
 
     modelViewMatrix.PushMatrix();
       //modelViewMatrix.Translate(3.0f, 0.0f, -3.0f);
-      modelViewMatrix.Translate(0.0f, 0.0f, -3.0f);
+      modelViewMatrix.Translate(CAROUSEL_POSITION[0], CAROUSEL_POSITION[1], CAROUSEL_POSITION[2]);
       //carousel.Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos);
     modelViewMatrix.PopMatrix();
 
     modelViewMatrix.PushMatrix();
-      modelViewMatrix.Translate(0.0f, 0.0f, -2.0f);
+      modelViewMatrix.Translate(ANIMAL_POSITION[0], ANIMAL_POSITION[1], ANIMAL_POSITION[2]);
       //unicorn.Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos);
       //ostrich.Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos);
-      turtle.Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos);
+      if (visibility[PARK_TURTLE] != GLT_FRUSTUM_OUTSIDE &&
+          !drawList.UseCache(rideCache[PARK_TURTLE], modelViewMatrix.GetMatrix()))
+      {
+        turtle.Draw(modelViewMatrix, drawList, vLightEyePos);
+        drawList.EndCapture(rideCache[PARK_TURTLE]);
+      }
     modelViewMatrix.PopMatrix();
 
 	modelViewMatrix.PopMatrix();
+
+	// Recording is all CPU; the rides' GPU time is in the submission
+	gpuTimers.Begin(GPU_PASS_RIDES);
+	drawList.Submit(shaderManager);
+	gpuTimers.End(GPU_PASS_RIDES);
+}
+
+
+/* ------------------------------------------------------------------------------- */
+/* Put every drawn ride into the park BVH, at the spot DrawScene translates it to. */
+
+void PlaceBounds(BoundingSphere &world, const BoundingSphere &local, const float position[]);
+void PlaceBounds(BoundingSphere &world, const BoundingSphere &local, const float position[])
+{
+	SetBoundingSphere(world, local.center[0] + position[0], local.center[1] + position[1],
+					  local.center[2] + position[2], local.radius);
+}
+
+void SetupParkBVH()
+{
+	BoundingSphere world;
+
+	/* Added in ParkObject order, so the ids match the enum. */
+	PlaceBounds(world, theWheel.GetBoundingSphere(), FERRIS_WHEEL_POSITION);
+	parkBVH.AddObject(world);
+	PlaceBounds(world, turtle.GetBoundingSphere(), ANIMAL_POSITION);
+	parkBVH.AddObject(world);
+
+	SetBoundingSphere(world, 0.0f, 0.0f, 0.0f, CAR_BOUNDING_RADIUS);
+	for (int i = 0; i < NBR_CARS; i++)
+		parkBVH.AddObject(world);
+
+	UpdateParkBVH();
+	parkBVH.Build();
+}
+
+/* Move the wheel's cars to where they hang now, and refit the boxes around them. */
+void UpdateParkBVH()
+{
+	BoundingSphere world;
+	M3DVector3f vOffset;
+
+	for (int i = 0; i < NBR_CARS; i++)
+	{
+		theWheel.GetCarOffset(i, vOffset);
+		SetBoundingSphere(world, FERRIS_WHEEL_POSITION[0] + vOffset[0], FERRIS_WHEEL_POSITION[1] + vOffset[1],
+						  FERRIS_WHEEL_POSITION[2] + vOffset[2], CAR_BOUNDING_RADIUS);
+		parkBVH.SetObjectBounds(PARK_FIRST_WHEEL_CAR + i, world);
+	}
+
+	parkBVH.Refit();
+}
+
+
+/* ------------------------------------------------------------------------------------- */
+/* A ride's retained draws, in both passes, are out of date once anything in it changes. */
+
+void InvalidateRideDraws(int ride)
+{
+	rideDrawCache[ride].Invalidate();
+	rideReflectionDrawCache[ride].Invalidate();
 }
 
 
@@ -468,13 +859,24 @@ void DrawScene()
 
 void TimerFunction(int value)
 {
-	theWheel.Update();
+	UpdateScene();
 
 	glutPostRedisplay();
 	glutTimerFunc(50, TimerFunction, value);
 }
 
 
+/* -------------------------------------------------------------- */
+/* One step of the animation, on the timer or per headless frame. */
+
+void UpdateScene()
+{
+	theWheel.Update();
+	InvalidateRideDraws(PARK_WHEEL);
+	UpdateParkBVH();
+}
+
+
 /* --------------------------------------------------------------------------------- */
 /* Respond to user requests to toggle reflection or to display alternative textures. */
 
@@ -485,11 +887,53 @@ void KeyboardPress(unsigned char pressedKey, int mouseXPosition, int mouseYPosit
       reflecting = !reflecting;
       break;
 
+    case F_LOWER_KEY: case F_UPPER_KEY:
+      reflectionMode = (reflectionMode + 1) % NBR_REFLECTION_MODES;
+      reflectionTexture.SetResolutionDivisor(REFLECTION_DIVISORS[reflectionMode]);
+      break;
+
+    case M_LOWER_KEY: case M_UPPER_KEY:
+      multiDrawPool.SetEnabled(!multiDrawPool.IsEnabled());
+      break;
+
+    case S_LOWER_KEY: case S_UPPER_KEY:
+      drawList.SetSorting(!drawList.IsSorting());
+      break;
+
     case T_LOWER_KEY: case T_UPPER_KEY:
       currentTextureIndex = (currentTextureIndex + 1) % NBR_TEXTURE_SETS;
+      InvalidateRideDraws(PARK_WHEEL);
+      break;
+
+    case C_LOWER_KEY: case C_UPPER_KEY:
+      sceneCuller.SetEnabled(!sceneCuller.IsEnabled());
+      break;
+
+    case O_LOWER_KEY: case O_UPPER_KEY:
+      occlusionCuller.SetEnabled(!occlusionCuller.IsEnabled());
+      break;
+
+    case P_LOWER_KEY: case P_UPPER_KEY:
+      frameCapture.Screenshot();
+      break;
+
+    case G_LOWER_KEY: case G_UPPER_KEY:
+      reportingGPUTimes = !reportingGPUTimes;
+      break;
+
+    case V_LOWER_KEY: case V_UPPER_KEY:
+      if (!frameCapture.IsRecording())
+        frameCapture.StartRecording();
+      else
+      {
+        frameCapture.StopRecording();
+        printf("Recording stopped: %d frames written, %d dropped so far\n",
+               frameCapture.GetWrittenCount(), frameCapture.GetDroppedCount());
+      }
       break;
 
     case ESCAPE_KEY:
+      frameCapture.ShutdownRenderingContext(); // write out what's still in flight
       exit(0);
       break;
 
@@ -499,6 +943,41 @@ void KeyboardPress(unsigned char pressedKey, int mouseXPosition, int mouseYPosit
 }
 
 
+/* ---------------------------------------------------------------------- */
+/* Left click reports the ride under the mouse, by casting a ray from the */
+/* camera through the clicked pixel into the park BVH.                    */
+
+void MouseClick(int button, int state, int mouseXPosition, int mouseYPosition)
+{
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+		return;
+
+	/* Direction through the pixel in eye space, on the z = -1 plane */
+	float tanHalfFov = tanf(m3dDegToRadf(0.5f * FRUSTUM_FIELD_OF_VIEW));
+	float eyeX = (2.0f * mouseXPosition / windowWidth - 1.0f) * tanHalfFov * float(windowWidth) / float(windowHeight);
+	float eyeY = (1.0f - 2.0f * mouseYPosition / windowHeight) * tanHalfFov;
+
+	/* ...and in world space: eye x is the camera's right, y its up, -z its forward */
+	M3DVector3f vOrigin, vForward, vUp, vRight, vDirection;
+	cameraFrame.GetOrigin(vOrigin);
+	cameraFrame.GetForwardVector(vForward);
+	cameraFrame.GetUpVector(vUp);
+	m3dCrossProduct3(vRight, vForward, vUp);
+	for (int i = 0; i < 3; i++)
+		vDirection[i] = eyeX * vRight[i] + eyeY * vUp[i] + vForward[i];
+	m3dNormalizeVector3(vDirection);
+
+	float distance;
+	int picked = parkBVH.Pick(vOrigin, vDirection, &distance);
+	if (picked < 0)
+		printf("Nothing picked\n");
+	else if (picked < PARK_FIRST_WHEEL_CAR)
+		printf("Picked the %s, %.2f away\n", PARK_OBJECT_NAME[picked], distance);
+	else
+		printf("Picked Ferris wheel car %d, %.2f away\n", picked - PARK_FIRST_WHEEL_CAR + 1, distance);
+}
+
+
 /* ------------------------------------------------------------- */
 /* Respond to arrow keys by moving the camera frame of reference */
 
@@ -530,3 +1009,105 @@ void NonASCIIKeyboardPress(int key, int mouseXPosition, int mouseYPosition)
       break;
   }
 }
+
+
+/* --------------------------------------------------------------------------------- */
+/* Renders the park into an offscreen framebuffer, with no window: a warm-up for the */
+/* textures to stream in, then the requested frames, one animation step each, timed  */
+/* to the end of the GPU's work. The last frame can go out for a golden-image test.  */
+/* A benchmark also takes the camera along its path, on the same fixed timestep, and */
+/* writes out every frame's times and counters; as each frame is finished before the */
+/* next, the occlusion results are always a frame old, and the counters repeat.      */
+
+int RunHeadless(const HeadlessOptions &options)
+{
+	HeadlessContext headless;
+	if (!headless.Create(options.width, options.height))
+		return -1;
+
+	reflectionTexture.SetWindowFramebuffer(headless.GetFramebuffer());
+	SetupRenderingContext();
+	ResizeWindow(options.width, options.height);
+
+	// The same toggles as at the keyboard, e.g. --keys ms for unsorted single draws
+	for (const char *pKey = options.szKeys; pKey != NULL && *pKey != '\0'; pKey++)
+		KeyboardPress((unsigned char)*pKey, 0, 0);
+
+	BenchmarkRecorder recorder;
+	CameraPath cameraPath(BENCHMARK_CAMERA_PATH, NBR_BENCHMARK_CAMERA_KEYS);
+	bool benchmark = (options.szBenchmarkFileName != NULL);
+	if (benchmark)
+	{
+		recorder.SetGPUTimers(&gpuTimers, GPU_PASS_FRAME);
+		cameraPath.Apply(0.0f, cameraFrame);
+	}
+
+	// Until every texture that's wanted is in, and nothing more has been asked for
+	int nbrWarmupFrames = 0;
+	while (nbrWarmupFrames < HEADLESS_MAX_WARMUP_FRAMES)
+	{
+		DrawFrame();
+		headless.Finish();
+		nbrWarmupFrames++;
+		if (nbrWarmupFrames > 1 && textureManager.GetLoadingCount() == 0 && textureStreamer.GetPendingCount() == 0)
+			break;
+	}
+	printf("Headless: %d warm-up frames, textures %d/%d resident, layers %d/%d, %.1f/%.0f MB\n", nbrWarmupFrames,
+	       textureManager.GetResidentCount(), textureManager.GetTextureCount(),
+	       rideTextureArray.GetResidentCount(), rideTextureArray.GetLayerCount(),
+	       textureManager.GetResidentBytes() / 1048576.0f, textureManager.GetBudget() / 1048576.0f);
+
+	// Only the timed frames go into the GPU averages
+	gpuTimers.Reset();
+
+	std::vector<float> frameSeconds;
+	frameSeconds.reserve(options.nbrFrames);
+	CStopWatch frameTimer;
+	for (int frame = 0; frame < options.nbrFrames; frame++)
+	{
+		float simulatedTime = frame * BENCHMARK_TIMESTEP;
+		frameTimer.Reset();
+		if (benchmark)
+		{
+			recorder.BeginFrame(simulatedTime);
+			cameraPath.Apply(simulatedTime, cameraFrame);
+		}
+		UpdateScene();
+		DrawFrame();
+		if (benchmark)
+			recorder.EndSubmit();
+		headless.Finish();
+		frameSeconds.push_back(frameTimer.GetElapsedSeconds());
+
+		// The culler's count has the BVH's rides as well as the cars it tested itself
+		if (benchmark)
+		{
+			const DrawListStats &submitted = drawList.GetSubmittedStats();
+			BenchmarkCounters counters = { submitted.draws, submitted.calls, submitted.programSwitches,
+			                               submitted.textureSwitches, submitted.meshSwitches,
+			                               sceneCuller.GetCulledCount(), occlusionCuller.GetDrawsSavedCount() };
+			recorder.EndFrame(counters);
+		}
+	}
+	PrintFrameTimes("Textured Ferris Wheel", frameSeconds);
+	gpuTimers.Finish();
+	gpuTimers.Print("Textured Ferris Wheel");
+
+	// The last frame's state changes, as recorded and as submitted
+	const DrawListStats &recorded = drawList.GetRecordedStats();
+	const DrawListStats &submitted = drawList.GetSubmittedStats();
+	printf("Textured Ferris Wheel: %d draws in %d calls, sorting %s, multi-draw %s; switches recorded/submitted:"
+	       " program %d/%d, texture %d/%d, mesh %d/%d\n",
+	       submitted.draws, submitted.calls, drawList.IsSorting() ? "on" : "off", multiDrawPool.IsEnabled() ? "on" : "off",
+	       recorded.programSwitches, submitted.programSwitches, recorded.textureSwitches, submitted.textureSwitches,
+	       recorded.meshSwitches, submitted.meshSwitches);
+
+	bool written = (options.szImageFileName == NULL) || headless.WriteImage(options.szImageFileName);
+	if (benchmark)
+	{
+		recorder.PrintSummary("Textured Ferris Wheel benchmark");
+		written = recorder.Write(options.szBenchmarkFileName) && written;
+	}
+	ShutdownRenderingContext();
+	return written ? 0 : -1;
+}
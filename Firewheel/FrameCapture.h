@@ -0,0 +1,334 @@
+//
+//  FrameCapture.h
+//  Firewheel
+//
+//  Screenshots and frame-by-frame recording without stalling the frame: the
+//  window is read back into a ring of pixel pack buffers, each fenced, and
+//  only mapped a frame or two later, once the GPU has got to it. A writer
+//  thread encodes the frames as run-length encoded TGAs (see TGAImage.h).
+//
+
+#ifndef Firewheel_FrameCapture_h
+#define Firewheel_FrameCapture_h
+
+#include <GLTools.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include "Threading.h"
+#include "TGAImage.h"
+
+/* Readbacks in flight; a frame that finds them all busy isn't captured */
+const int FRAME_CAPTURE_BUFFERS = 3;
+
+/* Frames read back but not yet written; beyond this, frames are dropped
+   rather than letting the writer's backlog grow without bound. */
+const int FRAME_CAPTURE_QUEUE = 8;
+
+/* Typical frame, once everything is drawn:
+     frameCapture.Capture();
+     glutSwapBuffers();
+
+   Screenshot() captures the next frame; StartRecording() every frame until
+   StopRecording(). Without fence syncs (GL 3.2 or ARB_sync), a buffer is
+   taken to be ready FRAME_CAPTURE_BUFFERS frames after its read. */
+class FrameCapture
+{
+public:
+  FrameCapture();
+  ~FrameCapture() { ShutdownRenderingContext(); }
+
+  void SetupRenderingContext();
+  /* Finishes and writes whatever is in flight */
+  void ShutdownRenderingContext();
+
+  void Screenshot();
+  void StartRecording(const char *szPrefix = "frame");
+  void StopRecording();
+  bool IsRecording() const { return recording; }
+
+  void Capture();
+
+  int GetWrittenCount();
+  int GetDroppedCount() const { return nbrDropped; }
+
+private:
+  struct Frame
+  {
+    std::string          fileName;
+    GLint                width, height;
+    std::vector<GLubyte> pixels;   /* BGRA, bottom row first */
+  };
+
+  /* A pixel pack buffer and the read waiting in it */
+  struct Readback
+  {
+    GLuint       buffer;
+    size_t       size;
+    GLsync       fence;
+    unsigned int frame;
+    Frame       *pFrame;
+  };
+
+  bool IsReady(Readback &readback, bool wait);
+  void Collect(bool wait);
+  static void WriterMain(void *pSelf);
+
+  Readback     readbacks[FRAME_CAPTURE_BUFFERS];
+  int          oldest, nbrBusy;
+  bool         useFences;
+  bool         started;
+  unsigned int frame;
+
+  bool         screenshotWanted;
+  bool         recording;
+  std::string  recordingPrefix;
+  int          nbrScreenshots, nbrRecorded, nbrDropped;
+
+  Thread       writer;
+  Mutex        mutex;
+  Condition    wake;
+  bool         stopping;
+
+  /* Guarded by mutex */
+  std::deque<Frame*>  queue;
+  std::vector<Frame*> spares;
+  int                 nbrWritten;
+};
+
+FrameCapture::FrameCapture()
+  : oldest(0), nbrBusy(0), useFences(false), started(false), frame(0),
+    screenshotWanted(false), recording(false), nbrScreenshots(0), nbrRecorded(0), nbrDropped(0),
+    stopping(false), nbrWritten(0)
+{
+  for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+  {
+    readbacks[i].buffer = 0;
+    readbacks[i].size = 0;
+    readbacks[i].fence = 0;
+    readbacks[i].pFrame = NULL;
+  }
+}
+
+void FrameCapture::SetupRenderingContext()
+{
+  useFences = (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+  for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+    glGenBuffers(1, &readbacks[i].buffer);
+
+  stopping = false;
+  started = writer.Start(WriterMain, this);
+}
+
+void FrameCapture::ShutdownRenderingContext()
+{
+  if (readbacks[0].buffer == 0)
+    return;
+
+  recording = screenshotWanted = false;
+  while (nbrBusy > 0)
+    Collect(true);
+  for (int i = 0; i < FRAME_CAPTURE_BUFFERS; i++)
+  {
+    glDeleteBuffers(1, &readbacks[i].buffer);
+    readbacks[i].buffer = 0;
+    readbacks[i].size = 0;
+  }
+
+  /* The writer empties the queue before it stops */
+  {
+    ScopedLock lock(mutex);
+    stopping = true;
+    wake.Broadcast();
+  }
+  if (started)
+    writer.Join();
+  started = false;
+
+  for (size_t i = 0; i < queue.size(); i++)
+    delete queue[i];
+  for (size_t i = 0; i < spares.size(); i++)
+    delete spares[i];
+  queue.clear();
+  spares.clear();
+}
+
+void FrameCapture::Screenshot()
+{
+  screenshotWanted = true;
+}
+
+void FrameCapture::StartRecording(const char *szPrefix)
+{
+  recordingPrefix = szPrefix;
+  nbrRecorded = 0;
+  recording = true;
+}
+
+void FrameCapture::StopRecording()
+{
+  recording = false;
+}
+
+/* Hands on the reads the GPU has finished, oldest first, then starts this
+   frame's if it's wanted. Call with the frame drawn, before the swap. */
+void FrameCapture::Capture()
+{
+  frame++;
+  Collect(false);
+  if (!screenshotWanted && !recording)
+    return;
+
+  char szFileName[256];
+  if (screenshotWanted)
+    sprintf(szFileName, "screenshot_%04d.tga", nbrScreenshots++);
+  else
+    sprintf(szFileName, "%s_%06d.tga", recordingPrefix.c_str(), nbrRecorded++);
+  screenshotWanted = false;
+
+  if (nbrBusy == FRAME_CAPTURE_BUFFERS || !started)
+  {
+    nbrDropped++;
+    return;
+  }
+
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  Frame *pFrame;
+  {
+    ScopedLock lock(mutex);
+    if (spares.empty())
+      pFrame = new Frame;
+    else
+    {
+      pFrame = spares.back();
+      spares.pop_back();
+    }
+  }
+  pFrame->fileName = szFileName;
+  pFrame->width = viewport[2];
+  pFrame->height = viewport[3];
+
+  /* BGRA is what the framebuffer holds, so the read is a plain copy */
+  Readback &readback = readbacks[(oldest + nbrBusy) % FRAME_CAPTURE_BUFFERS];
+  size_t size = 4 * (size_t)viewport[2] * viewport[3];
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  if (readback.size != size)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    readback.size = size;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_BGRA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  readback.fence = useFences ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+  readback.frame = frame;
+  readback.pFrame = pFrame;
+  nbrBusy++;
+}
+
+bool FrameCapture::IsReady(Readback &readback, bool wait)
+{
+  if (readback.fence == 0)
+    return wait || frame - readback.frame >= (unsigned int)FRAME_CAPTURE_BUFFERS;
+
+  /* Flushing only when waiting; otherwise the fence goes out with the swap */
+  GLenum status = glClientWaitSync(readback.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ULL : 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+/* Mapping waits for the read to land, which the fence says it has; the copy
+   out frees the buffer for the next read right away. */
+void FrameCapture::Collect(bool wait)
+{
+  while (nbrBusy > 0)
+  {
+    Readback &readback = readbacks[oldest];
+    bool ready = IsReady(readback, wait);
+    if (!ready && !wait)
+      break;
+    if (readback.fence != 0)
+      glDeleteSync(readback.fence);
+    readback.fence = 0;
+
+    Frame *pFrame = readback.pFrame;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const GLubyte *pPixels = (const GLubyte*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    bool queued = false;
+    if (pPixels != NULL)
+    {
+      pFrame->pixels.assign(pPixels, pPixels + readback.size);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+      ScopedLock lock(mutex);
+      if ((int)queue.size() < FRAME_CAPTURE_QUEUE)
+      {
+        queue.push_back(pFrame);
+        wake.Signal();
+        queued = true;
+      }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (!queued)
+    {
+      ScopedLock lock(mutex);
+      spares.push_back(pFrame);
+      nbrDropped++;
+    }
+    readback.pFrame = NULL;
+    oldest = (oldest + 1) % FRAME_CAPTURE_BUFFERS;
+    nbrBusy--;
+  }
+}
+
+/* Drops the alpha the window doesn't have, then writes the file */
+void FrameCapture::WriterMain(void *pSelf)
+{
+  FrameCapture *self = static_cast<FrameCapture*>(pSelf);
+  std::vector<GLubyte> bgr;
+
+  for (;;)
+  {
+    Frame *pFrame;
+    {
+      ScopedLock lock(self->mutex);
+      while (!self->stopping && self->queue.empty())
+        self->wake.Wait(self->mutex);
+      if (self->queue.empty())
+        return;
+      pFrame = self->queue.front();
+      self->queue.pop_front();
+    }
+
+    size_t nbrPixels = (size_t)pFrame->width * pFrame->height;
+    bgr.resize(3 * nbrPixels);
+    for (size_t i = 0; i < nbrPixels; i++)
+    {
+      bgr[3 * i + 0] = pFrame->pixels[4 * i + 0];
+      bgr[3 * i + 1] = pFrame->pixels[4 * i + 1];
+      bgr[3 * i + 2] = pFrame->pixels[4 * i + 2];
+    }
+    bool written = WriteTGA(pFrame->fileName.c_str(), pFrame->width, pFrame->height, 3, &bgr[0]);
+    if (!written)
+      fprintf(stderr, "%s: can't write\n", pFrame->fileName.c_str());
+
+    ScopedLock lock(self->mutex);
+    if (written)
+      self->nbrWritten++;
+    self->spares.push_back(pFrame);
+  }
+}
+
+int FrameCapture::GetWrittenCount()
+{
+  ScopedLock lock(mutex);
+  return nbrWritten;
+}
+
+#endif
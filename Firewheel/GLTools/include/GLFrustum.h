@@ -35,6 +35,15 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 #ifndef __GL_FRAME_CLASS
 #define __GL_FRAME_CLASS
 
+// The batch tests below use SSE when the compiler has it turned on
+// (always the case for x86-64), and plain C++ otherwise.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GLT_FRUSTUM_SSE
+#endif
+
+// Result of classifying a sphere against the frustum
+enum GLT_FRUSTUM_TEST { GLT_FRUSTUM_OUTSIDE = 0, GLT_FRUSTUM_INTERSECT, GLT_FRUSTUM_INSIDE };
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -277,7 +286,187 @@ class GLFrustum
             return true;
             }
 
+        // Same test as above, but also tells a sphere that straddles a plane
+        // from one that is entirely inside. Useful for hierarchies, since
+        // nothing contained in an inside sphere needs to be tested again.
+        GLT_FRUSTUM_TEST ClassifySphere(const M3DVector3f vPoint, float fRadius)
+            {
+            const float *planes[6] = { nearPlane, farPlane, leftPlane, rightPlane, bottomPlane, topPlane };
+            GLT_FRUSTUM_TEST result = GLT_FRUSTUM_INSIDE;
+
+            for(int i = 0; i < 6; i++)
+                {
+                float fDist = m3dGetDistanceToPlane(vPoint, planes[i]);
+                if(fDist + fRadius <= 0.0f)
+                    return GLT_FRUSTUM_OUTSIDE;
+                if(fDist - fRadius < 0.0f)
+                    result = GLT_FRUSTUM_INTERSECT;
+                }
+
+            return result;
+            }
+
+        // Projection matrix whose near plane is replaced by vClipPlane (eye
+        // space, normal pointing away from the eye), so everything on the eye's
+        // side of it is clipped with no user clip plane in the shaders. The far
+        // plane stays put but tilts, so depth values differ from the regular
+        // projection's: don't depth test one pass against the other. See Eric
+        // Lengyel, "Oblique View Frustum Depth Projection and Clipping".
+        // Perspective projections only; the eye must be behind the plane.
+        void GetObliqueProjectionMatrix(M3DMatrix44f mProjection, const M3DVector4f vClipPlane)
+            {
+            m3dCopyMatrix44(mProjection, projMatrix);
+
+            // Corner of the view volume opposite the plane, in eye space
+            M3DVector4f q;
+            q[0] = ((vClipPlane[0] > 0.0f ? 1.0f : (vClipPlane[0] < 0.0f ? -1.0f : 0.0f)) + projMatrix[8]) / projMatrix[0];
+            q[1] = ((vClipPlane[1] > 0.0f ? 1.0f : (vClipPlane[1] < 0.0f ? -1.0f : 0.0f)) + projMatrix[9]) / projMatrix[5];
+            q[2] = -1.0f;
+            q[3] = (1.0f + projMatrix[10]) / projMatrix[14];
+
+            // Scale the plane so that corner stays on the far plane, then make it the third row
+            float fScale = 2.0f / (vClipPlane[0] * q[0] + vClipPlane[1] * q[1] + vClipPlane[2] * q[2] + vClipPlane[3] * q[3]);
+            mProjection[2] = vClipPlane[0] * fScale;
+            mProjection[6] = vClipPlane[1] * fScale;
+            mProjection[10] = vClipPlane[2] * fScale + 1.0f;
+            mProjection[14] = vClipPlane[3] * fScale;
+            }
+
+        // Copy out the plane equations from the last Transform(), in the order
+        // near, far, left, right, bottom, top. Normals point into the frustum.
+        void GetPlanes(M3DVector4f vPlanes[6])
+            {
+            m3dCopyVector4(vPlanes[0], nearPlane);
+            m3dCopyVector4(vPlanes[1], farPlane);
+            m3dCopyVector4(vPlanes[2], leftPlane);
+            m3dCopyVector4(vPlanes[3], rightPlane);
+            m3dCopyVector4(vPlanes[4], bottomPlane);
+            m3dCopyVector4(vPlanes[5], topPlane);
+            }
+
+        ///////////////////////////////////////////////////////////////////////
+        // Batch tests for large numbers of objects. Bounds are passed as
+        // structure-of-arrays (one array per component) so four objects can be
+        // tested against a plane with one SSE instruction per component.
+        // The indices of the objects that are not entirely outside are written
+        // to pVisible in ascending order, and their count is returned. pVisible
+        // must have room for nCount entries. Call Transform() first.
+
+        // Spheres with centers (x[i], y[i], z[i]) and radii r[i]
+        int TestSpheres(const float *x, const float *y, const float *z, const float *r,
+                        int nCount, int *pVisible)
+            {
+            const float *planes[6] = { nearPlane, farPlane, leftPlane, rightPlane, bottomPlane, topPlane };
+            int nVisible = 0;
+            int i = 0;
+
+#ifdef GLT_FRUSTUM_SSE
+            for(; i + 4 <= nCount; i += 4)
+                {
+                __m128 vX = _mm_loadu_ps(x + i);
+                __m128 vY = _mm_loadu_ps(y + i);
+                __m128 vZ = _mm_loadu_ps(z + i);
+                __m128 vR = _mm_loadu_ps(r + i);
+                __m128 vOutside = _mm_setzero_ps();
+
+                for(int p = 0; p < 6; p++)
+                    {
+                    // distance + radius, for four spheres at once
+                    __m128 vDist = _mm_add_ps(_mm_mul_ps(vX, _mm_set1_ps(planes[p][0])),
+                                              _mm_mul_ps(vY, _mm_set1_ps(planes[p][1])));
+                    vDist = _mm_add_ps(vDist, _mm_mul_ps(vZ, _mm_set1_ps(planes[p][2])));
+                    vDist = _mm_add_ps(vDist, _mm_add_ps(vR, _mm_set1_ps(planes[p][3])));
+                    vOutside = _mm_or_ps(vOutside, _mm_cmple_ps(vDist, _mm_setzero_ps()));
+                    }
+
+                nVisible = AppendVisible(pVisible, nVisible, i, ~_mm_movemask_ps(vOutside) & 0xF);
+                }
+#endif
+
+            // Whatever is left over (or everything, without SSE)
+            for(; i < nCount; i++)
+                {
+                bool bInside = true;
+                for(int p = 0; p < 6 && bInside; p++)
+                    bInside = (x[i] * planes[p][0] + y[i] * planes[p][1] + z[i] * planes[p][2] + planes[p][3] + r[i]) > 0.0f;
+                pVisible[nVisible] = i;
+                nVisible += bInside ? 1 : 0;
+                }
+
+            return nVisible;
+            }
+
+        // Axis aligned boxes with centers (x[i], y[i], z[i]) and half widths
+        // (ex[i], ey[i], ez[i]). A box is outside a plane when its corner that
+        // is farthest along the plane normal is still behind it.
+        int TestBoxes(const float *x, const float *y, const float *z,
+                      const float *ex, const float *ey, const float *ez,
+                      int nCount, int *pVisible)
+            {
+            const float *planes[6] = { nearPlane, farPlane, leftPlane, rightPlane, bottomPlane, topPlane };
+            int nVisible = 0;
+            int i = 0;
+
+#ifdef GLT_FRUSTUM_SSE
+            for(; i + 4 <= nCount; i += 4)
+                {
+                __m128 vX = _mm_loadu_ps(x + i);
+                __m128 vY = _mm_loadu_ps(y + i);
+                __m128 vZ = _mm_loadu_ps(z + i);
+                __m128 vEX = _mm_loadu_ps(ex + i);
+                __m128 vEY = _mm_loadu_ps(ey + i);
+                __m128 vEZ = _mm_loadu_ps(ez + i);
+                __m128 vOutside = _mm_setzero_ps();
+
+                for(int p = 0; p < 6; p++)
+                    {
+                    __m128 vNX = _mm_set1_ps(planes[p][0]);
+                    __m128 vNY = _mm_set1_ps(planes[p][1]);
+                    __m128 vNZ = _mm_set1_ps(planes[p][2]);
+
+                    __m128 vDist = _mm_add_ps(_mm_mul_ps(vX, vNX), _mm_mul_ps(vY, vNY));
+                    vDist = _mm_add_ps(vDist, _mm_add_ps(_mm_mul_ps(vZ, vNZ), _mm_set1_ps(planes[p][3])));
+
+                    __m128 vReach = _mm_add_ps(_mm_mul_ps(vEX, _mm_set1_ps(fabsf(planes[p][0]))),
+                                               _mm_mul_ps(vEY, _mm_set1_ps(fabsf(planes[p][1]))));
+                    vReach = _mm_add_ps(vReach, _mm_mul_ps(vEZ, _mm_set1_ps(fabsf(planes[p][2]))));
+
+                    vOutside = _mm_or_ps(vOutside, _mm_cmple_ps(_mm_add_ps(vDist, vReach), _mm_setzero_ps()));
+                    }
+
+                nVisible = AppendVisible(pVisible, nVisible, i, ~_mm_movemask_ps(vOutside) & 0xF);
+                }
+#endif
+
+            for(; i < nCount; i++)
+                {
+                bool bInside = true;
+                for(int p = 0; p < 6 && bInside; p++)
+                    {
+                    float fDist = x[i] * planes[p][0] + y[i] * planes[p][1] + z[i] * planes[p][2] + planes[p][3];
+                    float fReach = ex[i] * fabsf(planes[p][0]) + ey[i] * fabsf(planes[p][1]) + ez[i] * fabsf(planes[p][2]);
+                    bInside = (fDist + fReach) > 0.0f;
+                    }
+                pVisible[nVisible] = i;
+                nVisible += bInside ? 1 : 0;
+                }
+
+            return nVisible;
+            }
+
     protected:
+        // Write out the indices of the lanes set in nMask (bit n = object iBase + n)
+        // without branching on the mask; slots past the last visible one get
+        // overwritten by the next group.
+        static inline int AppendVisible(int *pVisible, int nVisible, int iBase, int nMask)
+            {
+            pVisible[nVisible] = iBase;		nVisible += nMask & 1;
+            pVisible[nVisible] = iBase + 1;	nVisible += (nMask >> 1) & 1;
+            pVisible[nVisible] = iBase + 2;	nVisible += (nMask >> 2) & 1;
+            pVisible[nVisible] = iBase + 3;	nVisible += (nMask >> 3) & 1;
+            return nVisible;
+            }
+
 		// The projection matrix for this frustum
 		M3DMatrix44f projMatrix;	
 
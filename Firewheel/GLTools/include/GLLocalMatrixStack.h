@@ -0,0 +1,163 @@
+// GLLocalMatrixStack.h
+// Fixed capacity matrix stack that lives entirely in its own storage, and a
+// flat buffer of matrices to collect the results in.
+//
+// GLMatrixStack allocates its stack on the heap and is normally shared by the
+// whole program, so only one thread can walk the scene at a time. A
+// GLLocalMatrixStack is meant to be declared as a local variable inside a worker
+// function: each thread gets its own stack with no allocation and no locking,
+// computes the world matrices for the part of the scene it was handed, and
+// writes them into its own slots of a GLMatrixBuffer. As long as the slots are
+// disjoint, no synchronization is needed until the frame is drawn.
+
+#ifndef __GLT_LOCAL_MATRIX_STACK
+#define __GLT_LOCAL_MATRIX_STACK
+
+#include <math3d.h>
+#include <GLFrame.h>
+#include <GLMatrixStack.h>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Same interface as GLMatrixStack, minus the heap. The depth is a template
+// parameter so the storage size is known at compile time; keep it small since
+// it lives on the worker's stack (16 levels = 1 KB).
+template <int STACK_DEPTH>
+class GLLocalMatrixStack
+	{
+	public:
+		GLLocalMatrixStack(void) {
+			stackPointer = 0;
+			m3dLoadIdentity44(stack[0]);
+			lastError = GLT_STACK_NOERROR;
+			}
+
+		// Start from an existing matrix, e.g. the parent node's world matrix
+		GLLocalMatrixStack(const M3DMatrix44f mBase) {
+			stackPointer = 0;
+			m3dCopyMatrix44(stack[0], mBase);
+			lastError = GLT_STACK_NOERROR;
+			}
+
+		inline void LoadIdentity(void) {
+			m3dLoadIdentity44(stack[stackPointer]);
+			}
+
+		inline void LoadMatrix(const M3DMatrix44f mMatrix) {
+			m3dCopyMatrix44(stack[stackPointer], mMatrix);
+			}
+
+		inline void LoadMatrix(GLFrame& frame) {
+			M3DMatrix44f m;
+			frame.GetMatrix(m);
+			LoadMatrix(m);
+			}
+
+		inline void MultMatrix(const M3DMatrix44f mMatrix) {
+			M3DMatrix44f mTemp;
+			m3dCopyMatrix44(mTemp, stack[stackPointer]);
+			m3dMatrixMultiply44(stack[stackPointer], mTemp, mMatrix);
+			}
+
+		inline void MultMatrix(GLFrame& frame) {
+			M3DMatrix44f m;
+			frame.GetMatrix(m);
+			MultMatrix(m);
+			}
+
+		inline void PushMatrix(void) {
+			if(stackPointer < (STACK_DEPTH-1)) {
+				stackPointer++;
+				m3dCopyMatrix44(stack[stackPointer], stack[stackPointer-1]);
+				}
+			else
+				lastError = GLT_STACK_OVERFLOW;
+			}
+
+		inline void PopMatrix(void) {
+			if(stackPointer > 0)
+				stackPointer--;
+			else
+				lastError = GLT_STACK_UNDERFLOW;
+			}
+
+		void Scale(GLfloat x, GLfloat y, GLfloat z) {
+			M3DMatrix44f mScale;
+			m3dScaleMatrix44(mScale, x, y, z);
+			MultMatrix(mScale);
+			}
+
+		void Translate(GLfloat x, GLfloat y, GLfloat z) {
+			M3DMatrix44f mTranslate;
+			m3dTranslationMatrix44(mTranslate, x, y, z);
+			MultMatrix(mTranslate);
+			}
+
+		void Rotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
+			M3DMatrix44f mRotate;
+			m3dRotationMatrix44(mRotate, m3dDegToRadf(angle), x, y, z);
+			MultMatrix(mRotate);
+			}
+
+		const M3DMatrix44f& GetMatrix(void) { return stack[stackPointer]; }
+		void GetMatrix(M3DMatrix44f mMatrix) { m3dCopyMatrix44(mMatrix, stack[stackPointer]); }
+
+		inline GLT_STACK_ERROR GetLastError(void) {
+			GLT_STACK_ERROR retval = lastError;
+			lastError = GLT_STACK_NOERROR;
+			return retval;
+			}
+
+	protected:
+		GLT_STACK_ERROR		lastError;
+		int					stackPointer;
+		M3DMatrix44f		stack[STACK_DEPTH];
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Per-frame array of matrices. Allocated once up front; each producer writes
+// only the slots it owns, so concurrent writers never touch the same memory.
+// Reading the results back must wait until every producer has finished.
+class GLMatrixBuffer
+	{
+	public:
+		GLMatrixBuffer(int nMatrices = 0) {
+			nCount = 0;
+			pMatrices = NULL;
+			if(nMatrices > 0)
+				Resize(nMatrices);
+			}
+
+		~GLMatrixBuffer(void) {
+			delete [] pMatrices;
+			}
+
+		// Not safe to call while anyone is writing
+		void Resize(int nMatrices) {
+			delete [] pMatrices;
+			pMatrices = new M3DMatrix44f[nMatrices];
+			nCount = nMatrices;
+			for(int i = 0; i < nCount; i++)
+				m3dLoadIdentity44(pMatrices[i]);
+			}
+
+		inline int GetCount(void) const { return nCount; }
+
+		inline void SetMatrix(int iSlot, const M3DMatrix44f mMatrix) {
+			m3dCopyMatrix44(pMatrices[iSlot], mMatrix);
+			}
+
+		inline const M3DMatrix44f& GetMatrix(int iSlot) const { return pMatrices[iSlot]; }
+		inline M3DMatrix44f& GetMatrix(int iSlot) { return pMatrices[iSlot]; }
+
+	protected:
+		int				nCount;
+		M3DMatrix44f	*pMatrices;
+
+	private:
+		GLMatrixBuffer(const GLMatrixBuffer&);
+		GLMatrixBuffer& operator=(const GLMatrixBuffer&);
+	};
+
+#endif
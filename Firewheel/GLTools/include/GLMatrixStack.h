@@ -114,7 +114,7 @@ class GLMatrixStack
             			
 		void Rotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
 			M3DMatrix44f mTemp, mRotate;
-			m3dRotationMatrix44(mRotate, float(m3dDegToRad(angle)), x, y, z);
+			m3dRotationMatrix44(mRotate, m3dDegToRadf(angle), x, y, z);
 			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
 			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mRotate);
 			}
@@ -139,7 +139,7 @@ class GLMatrixStack
 			
 		void Rotatev(GLfloat angle, M3DVector3f vAxis) {
 			M3DMatrix44f mTemp, mRotation;
-			m3dRotationMatrix44(mRotation, float(m3dDegToRad(angle)), vAxis[0], vAxis[1], vAxis[2]);
+			m3dRotationMatrix44(mRotation, m3dDegToRadf(angle), vAxis[0], vAxis[1], vAxis[2]);
 			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
 			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mRotation);
 			}
@@ -147,7 +147,7 @@ class GLMatrixStack
 		
 		// I've also always wanted to be able to do this
 		void PushMatrix(const M3DMatrix44f mMatrix) {
-		 	if(stackPointer < stackDepth) {
+		 	if(stackPointer < (stackDepth-1)) {
 				stackPointer++;
 				m3dCopyMatrix44(pStack[stackPointer], mMatrix);
 				}
@@ -101,6 +101,11 @@ class GLTriangleBatch : public GLBatchBase
         inline GLuint GetIndexCount(void) { return nNumIndexes; }
         inline GLuint GetVertexCount(void) { return nNumVerts; }
 
+        // Read the mesh back out of its buffer objects after End(), for packing
+        // several batches into shared buffers. The arrays must have room for
+        // GetVertexCount() vertices and GetIndexCount() indexes. Not on OpenGL ES.
+        void CopyMesh(M3DVector3f *pVertsOut, M3DVector3f *pNormsOut, M3DVector2f *pTexCoordsOut, GLushort *pIndexesOut);
+
         
         // Draw - make sure you call glEnableClientState for these arrays
         virtual void Draw(void);
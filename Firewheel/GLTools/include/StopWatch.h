@@ -3,9 +3,11 @@
 // Code by Richard S. Wright Jr.
 // March 23, 1999
 // 
-// This function uses the High performance counter on Win32 and
-// gettimeofday on Mac OS X/Linux. gettimeofday is actually pretty
-// good on the Mac (about 10ms).
+// Time is kept as 64-bit integer nanoseconds from a monotonic clock:
+// QueryPerformanceCounter on Win32, mach_absolute_time on Mac OS X, and
+// clock_gettime(CLOCK_MONOTONIC) everywhere else. None of these jump when
+// the wall clock is changed, and converting to seconds only happens when
+// the caller asks for it, so long running timers don't lose precision.
 
 /* Copyright (c) 2005-2009, Richard S. Wright Jr.
 All rights reserved.
@@ -40,65 +42,176 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 
 #ifdef WIN32
 #include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
 #else
-#include <sys/time.h>
+#include <time.h>
 #endif
 
 
+// Nanoseconds. 64 bits is good for a few hundred years.
+typedef unsigned long long	GLTStopWatchTicks;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Read the monotonic clock. The origin is arbitrary, only differences
+// between two readings mean anything.
+inline GLTStopWatchTicks gltGetNanoseconds(void)
+	{
+	#ifdef WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if(frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+
+	// Split to avoid overflowing the multiply on machines that have been up a while
+	GLTStopWatchTicks whole = GLTStopWatchTicks(count.QuadPart / frequency.QuadPart);
+	GLTStopWatchTicks part = GLTStopWatchTicks(count.QuadPart % frequency.QuadPart);
+	return whole * 1000000000ULL + (part * 1000000000ULL) / GLTStopWatchTicks(frequency.QuadPart);
+	#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = { 0, 0 };
+	if(timebase.denom == 0)
+		mach_timebase_info(&timebase);
+
+	GLTStopWatchTicks count = mach_absolute_time();
+	if(timebase.numer == timebase.denom)		// 1:1 on Intel Macs
+		return count;
+	return (count / timebase.denom) * timebase.numer + ((count % timebase.denom) * timebase.numer) / timebase.denom;
+	#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return GLTStopWatchTicks(now.tv_sec) * 1000000000ULL + GLTStopWatchTicks(now.tv_nsec);
+	#endif
+	}
+
+inline double gltTicksToSeconds(GLTStopWatchTicks ticks)
+	{ return double(ticks) * 1.0e-9; }
+
+inline double gltTicksToMilliseconds(GLTStopWatchTicks ticks)
+	{ return double(ticks) * 1.0e-6; }
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Simple Stopwatch class. Use this for high resolution timing 
 // purposes (or, even low resolution timings)
-// Pretty self-explanitory.... 
-// Reset(), or GetElapsedSeconds().
+//
+// Three ways to use it:
+//	Reset(), GetElapsedSeconds()	- time since the watch was created or reset
+//	Lap()							- time since the previous lap, and start the next one
+//	Start(), Stop()					- add up the time spent between pairs of calls,
+//									  e.g. per subsystem over a frame. See CScopedTimer.
 class CStopWatch
 	{
 	public:
 		CStopWatch(void)	// Constructor
 			{
-			#ifdef WIN32
-			QueryPerformanceFrequency(&m_CounterFrequency);
-			QueryPerformanceCounter(&m_LastCount);
-			#else
-            gettimeofday(&m_LastCount, 0);
-			#endif
+			m_LastCount = gltGetNanoseconds();
+			m_LapCount = m_LastCount;
+			m_StartCount = 0;
+			m_Accumulated = 0;
+			m_nIntervals = 0;
+			m_bRunning = false;
 			}
 
-		// Resets timer (difference) to zero
+		// Resets timer (difference) to zero. Also starts a new lap, but leaves
+		// the accumulated time alone.
 		inline void Reset(void) 
 			{
-			#ifdef WIN32
-			QueryPerformanceCounter(&m_LastCount);
-			#else
-			gettimeofday(&m_LastCount, 0);
-			#endif
+			m_LastCount = gltGetNanoseconds();
+			m_LapCount = m_LastCount;
 			}					
 		
+		// Time since construction or the last Reset()
+		inline GLTStopWatchTicks GetElapsedNanoseconds(void) const
+			{ return gltGetNanoseconds() - m_LastCount; }
+
 		// Get elapsed time in seconds
-		float GetElapsedSeconds(void)
+		inline float GetElapsedSeconds(void) const
+			{ return float(gltTicksToSeconds(GetElapsedNanoseconds())); }
+
+		inline double GetElapsedMilliseconds(void) const
+			{ return gltTicksToMilliseconds(GetElapsedNanoseconds()); }
+
+		// Time since the last Lap() (or Reset()), and start timing the next lap
+		inline GLTStopWatchTicks Lap(void)
+			{
+			GLTStopWatchTicks now = gltGetNanoseconds();
+			GLTStopWatchTicks lap = now - m_LapCount;
+			m_LapCount = now;
+			return lap;
+			}
+
+		inline float LapSeconds(void)
+			{ return float(gltTicksToSeconds(Lap())); }
+
+		// Begin an interval to add to the accumulated total. Calling Start()
+		// on a running watch is ignored, so nested scopes are only counted once.
+		inline void Start(void)
 			{
-			// Get the current count
-			#ifdef WIN32
-			LARGE_INTEGER lCurrent;
-			QueryPerformanceCounter(&lCurrent);
-
-			return float((lCurrent.QuadPart - m_LastCount.QuadPart) /
-										double(m_CounterFrequency.QuadPart));
-			#else
-            timeval lcurrent;
-            gettimeofday(&lcurrent, 0);
-            float fSeconds = (float)(lcurrent.tv_sec - m_LastCount.tv_sec);
-            float fFraction = (float)(lcurrent.tv_usec - m_LastCount.tv_usec) * 0.000001f;
-            return fSeconds + fFraction;
-			#endif
-			}	
+			if(m_bRunning)
+				return;
+			m_StartCount = gltGetNanoseconds();
+			m_bRunning = true;
+			}
+
+		// End the interval begun by Start(), and return its length
+		inline GLTStopWatchTicks Stop(void)
+			{
+			if(!m_bRunning)
+				return 0;
+			GLTStopWatchTicks interval = gltGetNanoseconds() - m_StartCount;
+			m_Accumulated += interval;
+			m_nIntervals++;
+			m_bRunning = false;
+			return interval;
+			}
+
+		inline void ClearAccumulated(void)
+			{
+			m_Accumulated = 0;
+			m_nIntervals = 0;
+			}
+
+		inline bool IsRunning(void) const { return m_bRunning; }
+		inline GLTStopWatchTicks GetAccumulatedNanoseconds(void) const { return m_Accumulated; }
+		inline double GetAccumulatedSeconds(void) const { return gltTicksToSeconds(m_Accumulated); }
+		inline double GetAccumulatedMilliseconds(void) const { return gltTicksToMilliseconds(m_Accumulated); }
+		inline unsigned int GetIntervalCount(void) const { return m_nIntervals; }
+
+		// Mean length of the accumulated intervals
+		inline double GetAverageMilliseconds(void) const
+			{ return (m_nIntervals == 0) ? 0.0 : GetAccumulatedMilliseconds() / double(m_nIntervals); }
 	
 	protected:
-	#ifdef WIN32
-		LARGE_INTEGER m_CounterFrequency;
-		LARGE_INTEGER m_LastCount;
-	#else
-        timeval m_LastCount;
-	#endif
+		GLTStopWatchTicks	m_LastCount;
+		GLTStopWatchTicks	m_LapCount;
+		GLTStopWatchTicks	m_StartCount;
+		GLTStopWatchTicks	m_Accumulated;
+		unsigned int		m_nIntervals;
+		bool				m_bRunning;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the lifetime of the enclosing scope to a stopwatch's accumulated time.
+//	{
+//	CScopedTimer timer(drawTime);
+//	...
+//	}
+class CScopedTimer
+	{
+	public:
+		CScopedTimer(CStopWatch &watch) : m_Watch(watch) { m_Watch.Start(); }
+		~CScopedTimer(void) { m_Watch.Stop(); }
+
+	protected:
+		CStopWatch&	m_Watch;
+
+	private:
+		CScopedTimer(const CScopedTimer&);
+		CScopedTimer& operator=(const CScopedTimer&);
 	};
 
 
@@ -99,24 +99,21 @@ static const char *szShadedFP =
 									
 // GLT_SHADER_DEFAULT_LIGHT
 // Simple diffuse, directional, and vertex based light
-static const char *szDefaultLightVP = "uniform mat4 mvMatrix;"
-									  "uniform mat4 pMatrix;"
+// The normal matrix and the modelview projection matrix are the same for
+// every vertex in the batch, so they are computed once on the CPU by
+// UseStockShader instead of being rebuilt in the vertex shader.
+static const char *szDefaultLightVP = "uniform mat4 mvpMatrix;"
+									  "uniform mat3 normalMatrix;"
 									  "varying vec4 vFragColor;"
 									  "attribute vec4 vVertex;"
 									  "attribute vec3 vNormal;"
 									  "uniform vec4 vColor;"
 									  "void main(void) { "
-									  " mat3 mNormalMatrix;"
-									  " mNormalMatrix[0] = mvMatrix[0].xyz;"
-									  " mNormalMatrix[1] = mvMatrix[1].xyz;"
-									  " mNormalMatrix[2] = mvMatrix[2].xyz;"
-									  " vec3 vNorm = normalize(mNormalMatrix * vNormal);"
+									  " vec3 vNorm = normalize(normalMatrix * vNormal);"
 									  " vec3 vLightDir = vec3(0.0, 0.0, 1.0); "
 									  " float fDot = max(0.0, dot(vNorm, vLightDir)); "
 									  " vFragColor.rgb = vColor.rgb * fDot;"
 									  " vFragColor.a = vColor.a;"
-									  " mat4 mvpMatrix;"
-									  " mvpMatrix = pMatrix * mvMatrix;"
 									  " gl_Position = mvpMatrix * vVertex; "
 									  "}";
 
@@ -132,19 +129,19 @@ static const char *szDefaultLightFP =
 
 //GLT_SHADER_POINT_LIGHT_DIFF
 // Point light, diffuse lighting only
+// mvMatrix is still needed for the eye space position of the vertex; the
+// normal matrix (with its columns already normalized) and the modelview
+// projection matrix come precomputed from UseStockShader.
 static const char *szPointLightDiffVP =	  "uniform mat4 mvMatrix;"
-										  "uniform mat4 pMatrix;"
+										  "uniform mat4 mvpMatrix;"
+										  "uniform mat3 normalMatrix;"
 										  "uniform vec3 vLightPos;"
 										  "uniform vec4 vColor;"
 										  "attribute vec4 vVertex;"
 										  "attribute vec3 vNormal;"
 										  "varying vec4 vFragColor;"
 										  "void main(void) { "
-										  " mat3 mNormalMatrix;"
-										  " mNormalMatrix[0] = normalize(mvMatrix[0].xyz);"
-										  " mNormalMatrix[1] = normalize(mvMatrix[1].xyz);"
-										  " mNormalMatrix[2] = normalize(mvMatrix[2].xyz);"
-										  " vec3 vNorm = normalize(mNormalMatrix * vNormal);"
+										  " vec3 vNorm = normalize(normalMatrix * vNormal);"
 										  " vec4 ecPosition;"
 										  " vec3 ecPosition3;"
 										  " ecPosition = mvMatrix * vVertex;"
@@ -153,8 +150,6 @@ static const char *szPointLightDiffVP =	  "uniform mat4 mvMatrix;"
 										  " float fDot = max(0.0, dot(vNorm, vLightDir)); "
 										  " vFragColor.rgb = vColor.rgb * fDot;"
 										  " vFragColor.a = vColor.a;"
-										  " mat4 mvpMatrix;"
-										  " mvpMatrix = pMatrix * mvMatrix;"
 										  " gl_Position = mvpMatrix * vVertex; "
 										  "}";
 
@@ -238,8 +233,10 @@ static const char *szTextureModulateFP =
 
 //GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF
 // Point light (Diffuse only), with texture (modulated)
+// Same uniforms as GLT_SHADER_POINT_LIGHT_DIFF
 static const char *szTexturePointLightDiffVP =	  "uniform mat4 mvMatrix;"
-												  "uniform mat4 pMatrix;"
+												  "uniform mat4 mvpMatrix;"
+												  "uniform mat3 normalMatrix;"
 												  "uniform vec3 vLightPos;"
 												  "uniform vec4 vColor;"
 												  "attribute vec4 vVertex;"
@@ -248,11 +245,7 @@ static const char *szTexturePointLightDiffVP =	  "uniform mat4 mvMatrix;"
 												  "attribute vec2 vTexCoord0;"
 												  "varying vec2 vTex;"
 												  "void main(void) { "
-												  " mat3 mNormalMatrix;"
-												  " mNormalMatrix[0] = normalize(mvMatrix[0].xyz);"
-												  " mNormalMatrix[1] = normalize(mvMatrix[1].xyz);"
-												  " mNormalMatrix[2] = normalize(mvMatrix[2].xyz);"
-												  " vec3 vNorm = normalize(mNormalMatrix * vNormal);"
+												  " vec3 vNorm = normalize(normalMatrix * vNormal);"
 												  " vec4 ecPosition;"
 												  " vec3 ecPosition3;"
 												  " ecPosition = mvMatrix * vVertex;"
@@ -262,8 +255,6 @@ static const char *szTexturePointLightDiffVP =	  "uniform mat4 mvMatrix;"
 												  " vFragColor.rgb = vColor.rgb * fDot;"
 												  " vFragColor.a = vColor.a;"
 												  " vTex = vTexCoord0;"
-												  " mat4 mvpMatrix;"
-												  " mvpMatrix = pMatrix * mvMatrix;"
 												  " gl_Position = mvpMatrix * vVertex; "
 												  "}";
 
@@ -287,6 +278,24 @@ static const char *szTexturePointLightDiffFP =
 // GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF
 // Modulate texture with diffuse point light
 
+///////////////////////////////////////////////////////////////////////////////
+// The lighting shaders take the modelview projection matrix and the normal
+// matrix as uniforms. Both are the same for every vertex in a draw, so build
+// them here once rather than per vertex on the GPU. The normal matrix is the
+// rotation part of the modelview; bNormalize rescales its columns so uniform
+// scaling in the modelview doesn't darken or brighten the lighting.
+static void gltLightingMatrices(M3DMatrix44f mvpMatrix, M3DMatrix33f mNormalMatrix,
+								const M3DMatrix44f mvMatrix, const M3DMatrix44f pMatrix, bool bNormalize)
+	{
+	m3dMatrixMultiply44(mvpMatrix, pMatrix, mvMatrix);
+	m3dExtractRotationMatrix33(mNormalMatrix, mvMatrix);
+	if(bNormalize) {
+		m3dNormalizeVector3(&mNormalMatrix[0]);
+		m3dNormalizeVector3(&mNormalMatrix[3]);
+		m3dNormalizeVector3(&mNormalMatrix[6]);
+		}
+	}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Constructor, just zero out everything
 GLShaderManager::GLShaderManager(void)
@@ -369,8 +378,10 @@ GLint GLShaderManager::UseStockShader(GLT_STOCK_SHADER nShaderID, ...)
 	glUseProgram(uiStockShaders[nShaderID]);
 
 	// Set up the uniforms
-	GLint iTransform, iModelMatrix, iProjMatrix, iColor, iLight, iTextureUnit;
+	GLint iTransform, iModelMatrix, iNormalMatrix, iColor, iLight, iTextureUnit;
 	int				iInteger;
+	M3DMatrix44f	mMVP;
+	M3DMatrix33f	mNormal;
 	M3DMatrix44f* mvpMatrix;
 	M3DMatrix44f*  pMatrix;
 	M3DMatrix44f*  mvMatrix;
@@ -416,13 +427,15 @@ GLint GLShaderManager::UseStockShader(GLT_STOCK_SHADER nShaderID, ...)
 
 
 		case GLT_SHADER_DEFAULT_LIGHT:
-			iModelMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "mvMatrix");
 		    mvMatrix = va_arg(uniformList, M3DMatrix44f*);
-			glUniformMatrix4fv(iModelMatrix, 1, GL_FALSE, *mvMatrix);
-
-			iProjMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "pMatrix");
 		    pMatrix = va_arg(uniformList, M3DMatrix44f*);
-			glUniformMatrix4fv(iProjMatrix, 1, GL_FALSE, *pMatrix);
+			gltLightingMatrices(mMVP, mNormal, *mvMatrix, *pMatrix, false);
+
+			iTransform = glGetUniformLocation(uiStockShaders[nShaderID], "mvpMatrix");
+			glUniformMatrix4fv(iTransform, 1, GL_FALSE, mMVP);
+
+			iNormalMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "normalMatrix");
+			glUniformMatrix3fv(iNormalMatrix, 1, GL_FALSE, mNormal);
 
 			iColor = glGetUniformLocation(uiStockShaders[nShaderID], "vColor");
 			vColor = va_arg(uniformList, M3DVector4f*);
@@ -430,13 +443,18 @@ GLint GLShaderManager::UseStockShader(GLT_STOCK_SHADER nShaderID, ...)
 			break;
 
 		case GLT_SHADER_POINT_LIGHT_DIFF:
-			iModelMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "mvMatrix");
 		    mvMatrix = va_arg(uniformList, M3DMatrix44f*);
+		    pMatrix = va_arg(uniformList, M3DMatrix44f*);
+			gltLightingMatrices(mMVP, mNormal, *mvMatrix, *pMatrix, true);
+
+			iModelMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "mvMatrix");
 			glUniformMatrix4fv(iModelMatrix, 1, GL_FALSE, *mvMatrix);
 
-			iProjMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "pMatrix");
-		    pMatrix = va_arg(uniformList, M3DMatrix44f*);
-			glUniformMatrix4fv(iProjMatrix, 1, GL_FALSE, *pMatrix);
+			iTransform = glGetUniformLocation(uiStockShaders[nShaderID], "mvpMatrix");
+			glUniformMatrix4fv(iTransform, 1, GL_FALSE, mMVP);
+
+			iNormalMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "normalMatrix");
+			glUniformMatrix3fv(iNormalMatrix, 1, GL_FALSE, mNormal);
 
 			iLight = glGetUniformLocation(uiStockShaders[nShaderID], "vLightPos");
 			vLightPos = va_arg(uniformList, M3DVector3f*);
@@ -448,13 +466,18 @@ GLint GLShaderManager::UseStockShader(GLT_STOCK_SHADER nShaderID, ...)
 			break;			
 
 		case GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF:
-			iModelMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "mvMatrix");
 		    mvMatrix = va_arg(uniformList, M3DMatrix44f*);
+		    pMatrix = va_arg(uniformList, M3DMatrix44f*);
+			gltLightingMatrices(mMVP, mNormal, *mvMatrix, *pMatrix, true);
+
+			iModelMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "mvMatrix");
 			glUniformMatrix4fv(iModelMatrix, 1, GL_FALSE, *mvMatrix);
 
-			iProjMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "pMatrix");
-		    pMatrix = va_arg(uniformList, M3DMatrix44f*);
-			glUniformMatrix4fv(iProjMatrix, 1, GL_FALSE, *pMatrix);
+			iTransform = glGetUniformLocation(uiStockShaders[nShaderID], "mvpMatrix");
+			glUniformMatrix4fv(iTransform, 1, GL_FALSE, mMVP);
+
+			iNormalMatrix = glGetUniformLocation(uiStockShaders[nShaderID], "normalMatrix");
+			glUniformMatrix3fv(iNormalMatrix, 1, GL_FALSE, mNormal);
 
 			iLight = glGetUniformLocation(uiStockShaders[nShaderID], "vLightPos");
 			vLightPos = va_arg(uniformList, M3DVector3f*);
@@ -149,22 +149,44 @@ void gltSetWorkingDirectory(const char *szArgv)
 	}
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Fill in the sine and cosine of the nSteps+1 angles i * fStep. The mesh makers
+// below look each of these up several times per vertex, so compute them once, in
+// float. With bClose the last entry is snapped back to angle zero so the seam of
+// a closed surface welds exactly.
+static void gltMakeSinCosTable(GLfloat *pSin, GLfloat *pCos, GLint nSteps, GLfloat fStep, bool bClose)
+	{
+	for(GLint i = 0; i <= nSteps; i++)
+		m3dSinCosf(fStep * float(i), pSin[i], pCos[i]);
+
+	if(bClose) {
+		pSin[nSteps] = 0.0f;
+		pCos[nSteps] = 1.0f;
+		}
+	}
+
+
 // Draw a torus (doughnut)  at z = fZVal... torus is in xy plane
 void gltMakeTorus(GLTriangleBatch& torusBatch, GLfloat majorRadius, GLfloat minorRadius, GLint numMajor, GLint numMinor)
 	{
-    double majorStep = 2.0f*M3D_PI / numMajor;
-    double minorStep = 2.0f*M3D_PI / numMinor;
+    GLfloat majorStep = M3D_2PIf / float(numMajor);
+    GLfloat minorStep = M3D_2PIf / float(numMinor);
     int i, j;
+
+	GLfloat *pMajorSin = new GLfloat[numMajor + 1];
+	GLfloat *pMajorCos = new GLfloat[numMajor + 1];
+	GLfloat *pMinorSin = new GLfloat[numMinor + 1];
+	GLfloat *pMinorCos = new GLfloat[numMinor + 1];
+	gltMakeSinCosTable(pMajorSin, pMajorCos, numMajor, majorStep, true);
+	gltMakeSinCosTable(pMinorSin, pMinorCos, numMinor, minorStep, true);
 	
     torusBatch.BeginMesh(numMajor * (numMinor+1) * 6);
     for (i=0; i<numMajor; ++i) 
 		{
-		double a0 = i * majorStep;
-		double a1 = a0 + majorStep;
-		GLfloat x0 = (GLfloat) cos(a0);
-		GLfloat y0 = (GLfloat) sin(a0);
-		GLfloat x1 = (GLfloat) cos(a1);
-		GLfloat y1 = (GLfloat) sin(a1);
+		GLfloat x0 = pMajorCos[i];
+		GLfloat y0 = pMajorSin[i];
+		GLfloat x1 = pMajorCos[i+1];
+		GLfloat y1 = pMajorSin[i+1];
 
 		M3DVector3f vVertex[4];
 		M3DVector3f vNormal[4];
@@ -172,10 +194,9 @@ void gltMakeTorus(GLTriangleBatch& torusBatch, GLfloat majorRadius, GLfloat mino
 		
 		for (j=0; j<=numMinor; ++j) 
 			{
-			double b = j * minorStep;
-			GLfloat c = (GLfloat) cos(b);
+			GLfloat c = pMinorCos[j];
 			GLfloat r = minorRadius * c + majorRadius;
-			GLfloat z = minorRadius * (GLfloat) sin(b);
+			GLfloat z = minorRadius * pMinorSin[j];
 			
 			// First point
 			vTexture[0][0] = (float)(i)/(float)(numMajor);
@@ -199,11 +220,10 @@ void gltMakeTorus(GLTriangleBatch& torusBatch, GLfloat majorRadius, GLfloat mino
 			vVertex[1][1] = y1*r;
 			vVertex[1][2] = z;
 
-			// Next one over
-			b = (j+1) * minorStep;
-			c = (GLfloat) cos(b);
+			// Next one over (the loop runs one step past the seam, so wrap)
+			c = pMinorCos[(j+1) % numMinor];
 			r = minorRadius * c + majorRadius;
-			z = minorRadius * (GLfloat) sin(b);
+			z = minorRadius * pMinorSin[(j+1) % numMinor];
 						
 			// Third (based on first)
 			vTexture[2][0] = (float)(i)/(float)(numMajor);
@@ -242,28 +262,39 @@ void gltMakeTorus(GLTriangleBatch& torusBatch, GLfloat majorRadius, GLfloat mino
 			}
 		}
 	torusBatch.End();
+
+	delete [] pMajorSin;
+	delete [] pMajorCos;
+	delete [] pMinorSin;
+	delete [] pMinorCos;
 	}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 // Make a sphere
 void gltMakeSphere(GLTriangleBatch& sphereBatch, GLfloat fRadius, GLint iSlices, GLint iStacks)
 	{
-    GLfloat drho = (GLfloat)(3.141592653589) / (GLfloat) iStacks;
-    GLfloat dtheta = 2.0f * (GLfloat)(3.141592653589) / (GLfloat) iSlices;
+    GLfloat drho = M3D_PIf / (GLfloat) iStacks;
+    GLfloat dtheta = M3D_2PIf / (GLfloat) iSlices;
 	GLfloat ds = 1.0f / (GLfloat) iSlices;
 	GLfloat dt = 1.0f / (GLfloat) iStacks;
 	GLfloat t = 1.0f;	
 	GLfloat s = 0.0f;
     GLint i, j;     // Looping variables
+
+	GLfloat *pRhoSin = new GLfloat[iStacks + 1];
+	GLfloat *pRhoCos = new GLfloat[iStacks + 1];
+	GLfloat *pThetaSin = new GLfloat[iSlices + 1];
+	GLfloat *pThetaCos = new GLfloat[iSlices + 1];
+	gltMakeSinCosTable(pRhoSin, pRhoCos, iStacks, drho, false);
+	gltMakeSinCosTable(pThetaSin, pThetaCos, iSlices, dtheta, true);
     
     sphereBatch.BeginMesh(iSlices * iStacks * 6);
 	for (i = 0; i < iStacks; i++) 
 		{
-		GLfloat rho = (GLfloat)i * drho;
-		GLfloat srho = (GLfloat)(sin(rho));
-		GLfloat crho = (GLfloat)(cos(rho));
-		GLfloat srhodrho = (GLfloat)(sin(rho + drho));
-		GLfloat crhodrho = (GLfloat)(cos(rho + drho));
+		GLfloat srho = pRhoSin[i];
+		GLfloat crho = pRhoCos[i];
+		GLfloat srhodrho = pRhoSin[i+1];
+		GLfloat crhodrho = pRhoCos[i+1];
 		
         // Many sources of OpenGL sphere drawing code uses a triangle fan
         // for the caps of the sphere. This however introduces texturing 
@@ -275,9 +306,8 @@ void gltMakeSphere(GLTriangleBatch& sphereBatch, GLfloat fRadius, GLint iSlices,
 
 		for ( j = 0; j < iSlices; j++) 
 			{
-			GLfloat theta = (j == iSlices) ? 0.0f : j * dtheta;
-			GLfloat stheta = (GLfloat)(-sin(theta));
-			GLfloat ctheta = (GLfloat)(cos(theta));
+			GLfloat stheta = -pThetaSin[j];
+			GLfloat ctheta = pThetaCos[j];
 			
 			GLfloat x = stheta * srho;
 			GLfloat y = ctheta * srho;
@@ -306,9 +336,8 @@ void gltMakeSphere(GLTriangleBatch& sphereBatch, GLfloat fRadius, GLint iSlices,
 			vVertex[1][2] = z * fRadius;
 			
 
-			theta = ((j+1) == iSlices) ? 0.0f : (j+1) * dtheta;
-			stheta = (GLfloat)(-sin(theta));
-			ctheta = (GLfloat)(cos(theta));
+			stheta = -pThetaSin[j+1];
+			ctheta = pThetaCos[j+1];
 			
 			x = stheta * srho;
 			y = ctheta * srho;
@@ -353,6 +382,11 @@ void gltMakeSphere(GLTriangleBatch& sphereBatch, GLfloat fRadius, GLint iSlices,
         t -= dt;
         }
 		sphereBatch.End();
+
+	delete [] pRhoSin;
+	delete [] pRhoCos;
+	delete [] pThetaSin;
+	delete [] pThetaCos;
     }
     
 
@@ -366,7 +400,11 @@ void gltMakeDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerR
 
 	fStepSizeRadial /= float(nStacks);
 	
-	GLfloat fStepSizeSlice = (3.1415926536f * 2.0f) / float(nSlices);
+	GLfloat fStepSizeSlice = M3D_2PIf / float(nSlices);
+
+	GLfloat *pSliceSin = new GLfloat[nSlices + 1];
+	GLfloat *pSliceCos = new GLfloat[nSlices + 1];
+	gltMakeSinCosTable(pSliceSin, pSliceCos, nSlices, fStepSizeSlice, true);
 	
 	diskBatch.BeginMesh(nSlices * nStacks * 6);
 	
@@ -378,22 +416,20 @@ void gltMakeDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerR
 	
 	for(GLint i = 0; i < nStacks; i++)			// Stacks
 		{
-		float theyta;
-		float theytaNext;
 		for(GLint j = 0; j < nSlices; j++)     // Slices
 			{
 			float inner = innerRadius + (float(i)) * fStepSizeRadial;
 			float outer = innerRadius + (float(i+1)) * fStepSizeRadial;
 			
-			theyta = fStepSizeSlice * float(j);
-			if(j == (nSlices - 1))
-				theytaNext = 0.0f;
-			else
-				theytaNext = fStepSizeSlice * (float(j+1));
+			// Table entry nSlices wraps back to angle 0
+			float cosTheyta = pSliceCos[j];
+			float sinTheyta = pSliceSin[j];
+			float cosTheytaNext = pSliceCos[j+1];
+			float sinTheytaNext = pSliceSin[j+1];
 				
 			// Inner First
-			vVertex[0][0] = cos(theyta) * inner;	// X	
-			vVertex[0][1] = sin(theyta) * inner;	// Y
+			vVertex[0][0] = cosTheyta * inner;	// X	
+			vVertex[0][1] = sinTheyta * inner;	// Y
 			vVertex[0][2] = 0.0f;					// Z
 			
 			vNormal[0][0] = 0.0f;					// Surface Normal, same for everybody
@@ -404,8 +440,8 @@ void gltMakeDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerR
 			vTexture[0][1] = ((vVertex[0][1] * fRadialScale) + 1.0f) * 0.5f;
 			
 			// Outer First
-			vVertex[1][0] = cos(theyta) * outer;	// X	
-			vVertex[1][1] = sin(theyta) * outer;	// Y
+			vVertex[1][0] = cosTheyta * outer;	// X	
+			vVertex[1][1] = sinTheyta * outer;	// Y
 			vVertex[1][2] = 0.0f;					// Z
 			
 			vNormal[1][0] = 0.0f;					// Surface Normal, same for everybody
@@ -416,8 +452,8 @@ void gltMakeDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerR
 			vTexture[1][1] = ((vVertex[1][1] * fRadialScale) + 1.0f) * 0.5f;
 			
 			// Inner Second
-			vVertex[2][0] = cos(theytaNext) * inner;	// X	
-			vVertex[2][1] = sin(theytaNext) * inner;	// Y
+			vVertex[2][0] = cosTheytaNext * inner;	// X	
+			vVertex[2][1] = sinTheytaNext * inner;	// Y
 			vVertex[2][2] = 0.0f;					// Z
 			
 			vNormal[2][0] = 0.0f;					// Surface Normal, same for everybody
@@ -429,8 +465,8 @@ void gltMakeDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerR
 			
 			
 			// Outer Second
-			vVertex[3][0] = cos(theytaNext) * outer;	// X	
-			vVertex[3][1] = sin(theytaNext) * outer;	// Y
+			vVertex[3][0] = cosTheytaNext * outer;	// X	
+			vVertex[3][1] = sinTheytaNext * outer;	// Y
 			vVertex[3][2] = 0.0f;					// Z
 			
 			vNormal[3][0] = 0.0f;					// Surface Normal, same for everybody
@@ -456,6 +492,9 @@ void gltMakeDisk(GLTriangleBatch& diskBatch, GLfloat innerRadius, GLfloat outerR
 		}
 	
 	diskBatch.End();
+
+	delete [] pSliceSin;
+	delete [] pSliceCos;
 	}
 
 // Draw a cylinder. Much like gluCylinder
@@ -464,7 +503,11 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 	{	
     float fRadiusStep = (topRadius - baseRadius) / float(numStacks);
 
-	GLfloat fStepSizeSlice = (3.1415926536f * 2.0f) / float(numSlices);
+	GLfloat fStepSizeSlice = M3D_2PIf / float(numSlices);
+
+	GLfloat *pSliceSin = new GLfloat[numSlices + 1];
+	GLfloat *pSliceCos = new GLfloat[numSlices + 1];
+	gltMakeSinCosTable(pSliceSin, pSliceCos, numSlices, fStepSizeSlice, true);
 
 	M3DVector3f vVertex[4];
 	M3DVector3f vNormal[4];
@@ -492,8 +535,6 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 	
 		float fCurrentRadius = baseRadius + (fRadiusStep * float(i));
 		float fNextRadius = baseRadius + (fRadiusStep * float(i+1));
-		float theyta;
-		float theytaNext;
 
 		float fCurrentZ = float(i) * (fLength / float(numStacks)); 
 		float fNextZ = float(i+1) * (fLength / float(numStacks));
@@ -518,15 +559,15 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 			else
 				sNext = float(j+1) * ds;
 
-			theyta = fStepSizeSlice * float(j);
-			if(j == (numSlices - 1))
-				theytaNext = 0.0f;
-			else
-				theytaNext = fStepSizeSlice * (float(j+1));
+			// Table entry numSlices wraps back to angle 0
+			float cosTheyta = pSliceCos[j];
+			float sinTheyta = pSliceSin[j];
+			float cosTheytaNext = pSliceCos[j+1];
+			float sinTheytaNext = pSliceSin[j+1];
 				
 			// Inner First
-			vVertex[1][0] = cos(theyta) * fCurrentRadius;	// X	
-			vVertex[1][1] = sin(theyta) * fCurrentRadius;	// Y
+			vVertex[1][0] = cosTheyta * fCurrentRadius;	// X	
+			vVertex[1][1] = sinTheyta * fCurrentRadius;	// Y
 			vVertex[1][2] = fCurrentZ;						// Z
 			
 			vNormal[1][0] = vVertex[1][0];					// Surface Normal, same for everybody
@@ -538,8 +579,8 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 			vTexture[1][1] = t;
 	
 			// Outer First
-			vVertex[0][0] = cos(theyta) * fNextRadius;	// X	
-			vVertex[0][1] = sin(theyta) * fNextRadius;	// Y
+			vVertex[0][0] = cosTheyta * fNextRadius;	// X	
+			vVertex[0][1] = sinTheyta * fNextRadius;	// Y
 			vVertex[0][2] = fNextZ;						// Z
 			
 			if(!m3dCloseEnough(fNextRadius, 0.0f, 0.00001f)) {
@@ -556,8 +597,8 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 			vTexture[0][1] = tNext;
 			
 			// Inner second
-			vVertex[3][0] = cos(theytaNext) * fCurrentRadius;	// X	
-			vVertex[3][1] = sin(theytaNext) * fCurrentRadius;	// Y
+			vVertex[3][0] = cosTheytaNext * fCurrentRadius;	// X	
+			vVertex[3][1] = sinTheytaNext * fCurrentRadius;	// Y
 			vVertex[3][2] = fCurrentZ;						// Z
 			
 			vNormal[3][0] = vVertex[3][0];					// Surface Normal, same for everybody
@@ -569,8 +610,8 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 			vTexture[3][1] = t;
 
 			// Outer second
-			vVertex[2][0] = cos(theytaNext) * fNextRadius;	// X	
-			vVertex[2][1] = sin(theytaNext) * fNextRadius;	// Y
+			vVertex[2][0] = cosTheytaNext * fNextRadius;	// X	
+			vVertex[2][1] = sinTheytaNext * fNextRadius;	// Y
 			vVertex[2][2] = fNextZ;						// Z
 			
 			if(!m3dCloseEnough(fNextRadius, 0.0f, 0.00001f)) {
@@ -601,6 +642,9 @@ void gltMakeCylinder(GLTriangleBatch& cylinderBatch, GLfloat baseRadius, GLfloat
 			}
         }
 	cylinderBatch.End();
+
+	delete [] pSliceSin;
+	delete [] pSliceCos;
 	}
 	
 	
@@ -1057,7 +1101,7 @@ GLbyte* gltReadBMPBits(const char *szFileName, int *nWidth, int *nHeight)
 		{
 		free(pBitmapInfo);
 		fclose(pFile);
-		return false;
+		return NULL;
 		}
 
 	// Save the size and dimensions of the bitmap
@@ -1069,7 +1113,7 @@ GLbyte* gltReadBMPBits(const char *szFileName, int *nWidth, int *nHeight)
 	if(pBitmapInfo->header.bits != 24)
 		{
 		free(pBitmapInfo);
-		return false;
+		return NULL;
 		}
 
 	if(lBitSize == 0)
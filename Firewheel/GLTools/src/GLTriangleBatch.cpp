@@ -234,6 +234,29 @@ void GLTriangleBatch::End(void)
     #endif
     }
 
+//////////////////////////////////////////////////////////////////////////
+// Copy the mesh back from video memory; the client side arrays are gone
+// once End() has been called.
+void GLTriangleBatch::CopyMesh(M3DVector3f *pVertsOut, M3DVector3f *pNormsOut, M3DVector2f *pTexCoordsOut, GLushort *pIndexesOut)
+    {
+    #ifndef OPENGL_ES
+    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[VERTEX_DATA]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat)*nNumVerts*3, pVertsOut);
+
+    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[NORMAL_DATA]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat)*nNumVerts*3, pNormsOut);
+
+    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[TEXTURE_DATA]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat)*nNumVerts*2, pTexCoordsOut);
+
+    // Any binding point will do for reading; this keeps the VAOs' element buffers alone
+    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[INDEX_DATA]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLushort)*nNumIndexes, pIndexesOut);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    #endif
+    }
+
 //////////////////////////////////////////////////////////////////////////
 // Draw - make sure you call glEnableClientState for these arrays
 void GLTriangleBatch::Draw(void) 
@@ -231,6 +231,20 @@ void m3dMakeOrthographicMatrix(M3DMatrix44f mProjection, float xMin, float xMax,
 	
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Sine and cosine of a whole array of angles. The restrict qualifiers let the
+// compiler vectorize the inlined polynomial four or eight angles at a time.
+void m3dSinCosArrayf(const float *pAngles, float *pSin, float *pCos, int nCount)
+	{
+	const float * __restrict pIn = pAngles;
+	float * __restrict pOutSin = pSin;
+	float * __restrict pOutCos = pCos;
+
+	for(int i = 0; i < nCount; i++)
+		m3dSinCosf(pIn[i], pOutSin[i], pOutCos[i]);
+	}
+
+
 #define M33(row,col)  m[col*3+row]
 ///////////////////////////////////////////////////////////////////////////////
 // Creates a 3x3 rotation matrix, takes radians NOT degrees
@@ -240,10 +254,9 @@ void m3dRotationMatrix33(M3DMatrix33f m, float angle, float x, float y, float z)
 	float mag, s, c;
 	float xx, yy, zz, xy, yz, zx, xs, ys, zs, one_c;
 
-	s = float(sin(angle));
-	c = float(cos(angle));
+	m3dSinCosf(angle, s, c);
 
-	mag = float(sqrt( x*x + y*y + z*z ));
+	mag = sqrtf( x*x + y*y + z*z );
 
 	// Identity matrix
 	if (mag == 0.0f) {
@@ -289,10 +302,9 @@ void m3dRotationMatrix44(M3DMatrix44f m, float angle, float x, float y, float z)
 	float mag, s, c;
 	float xx, yy, zz, xy, yz, zx, xs, ys, zs, one_c;
 
-	s = float(sin(angle));
-	c = float(cos(angle));
+	m3dSinCosf(angle, s, c);
 
-	mag = float(sqrt( x*x + y*y + z*z ));
+	mag = sqrtf( x*x + y*y + z*z );
 
 	// Identity matrix
 	if (mag == 0.0f) {
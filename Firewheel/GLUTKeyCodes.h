@@ -15,12 +15,28 @@
 #define SPACE_KEY 32
 
 #define A_UPPER_KEY 65
+#define C_UPPER_KEY 67
+#define F_UPPER_KEY 70
+#define G_UPPER_KEY 71
+#define M_UPPER_KEY 77
+#define O_UPPER_KEY 79
+#define P_UPPER_KEY 80
 #define R_UPPER_KEY 82
+#define S_UPPER_KEY 83
 #define T_UPPER_KEY 84
+#define V_UPPER_KEY 86
 
 #define A_LOWER_KEY 97
+#define C_LOWER_KEY 99
+#define F_LOWER_KEY 102
+#define G_LOWER_KEY 103
+#define M_LOWER_KEY 109
+#define O_LOWER_KEY 111
+#define P_LOWER_KEY 112
 #define R_LOWER_KEY 114
+#define S_LOWER_KEY 115
 #define T_LOWER_KEY 116
+#define V_LOWER_KEY 118
 
 #define DELETE_KEY 127
 
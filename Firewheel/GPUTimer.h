@@ -0,0 +1,332 @@
+//
+//  GPUTimer.h
+//  Firewheel
+//
+//  Where the GPU's time goes, pass by pass. Each timed section is bracketed
+//  by a pair of GL_TIMESTAMP queries, so sections can nest and a section can
+//  run more than once a frame; the results are read a few frames later, once
+//  they're in, and kept frame by frame and as averages over the last
+//  GPU_TIMER_AVERAGE_FRAMES.
+//
+
+#ifndef Firewheel_GPUTimer_h
+#define Firewheel_GPUTimer_h
+
+#include <GLTools.h>
+#include <vector>
+#include <cstdio>
+
+/* Frames of queries in flight. A frame that finds its slot still waiting on
+   the GPU goes untimed rather than stalling. */
+const int GPU_TIMER_FRAMES = 4;
+
+/* The averages are over this many timed frames */
+const int GPU_TIMER_AVERAGE_FRAMES = 60;
+
+/* Typical frame, with the sections named at setup:
+     gpuTimers.BeginFrame();
+     {
+       ScopedGPUTimer timer(gpuTimers, GPU_PASS_GROUND);
+       ... draw the ground ...
+     }
+     gpuTimers.EndFrame();
+     ...
+     gpuTimers.GetAverageMs(GPU_PASS_GROUND)
+
+   Frames are numbered as they begin, timed or not. Frames are collected in
+   order, and a collected frame's section times can be looked up by number
+   while it is among the last GPU_TIMER_AVERAGE_FRAMES collected.
+
+   Without timer queries (GL 3.3 or ARB_timer_query) nothing is timed and the
+   averages stay at 0. */
+class GPUTimers
+{
+public:
+  GPUTimers();
+  ~GPUTimers() { ShutdownRenderingContext(); }
+
+  /* The names must outlive the timers */
+  void SetupRenderingContext(const char *szNames[], int count);
+  void ShutdownRenderingContext();
+
+  bool IsSupported() const { return supported; }
+
+  void BeginFrame();
+  void EndFrame();
+  void Begin(int section);
+  void End(int section);
+
+  /* Waits for the frames still out, and collects them */
+  void Finish();
+  /* Forgets everything timed so far, in flight or averaged, e.g. after a warm-up */
+  void Reset();
+
+  int   GetSectionCount() const             { return (int)names.size(); }
+  const char *GetSectionName(int section) const { return names[section]; }
+  float GetAverageMs(int section) const;
+  int   GetSkippedCount() const             { return nbrSkipped; }
+
+  int   GetFrameNumber() const              { return frameNumber; }   /* the one begun last */
+  int   GetCollectedFrameNumber() const     { return collectedNumber; }   /* -1 before any */
+  bool  GetFrameMs(int number, int section, float &ms) const;
+
+  /* "<szName> GPU ms: frame 1.234, ground 0.123, ..." on one line */
+  void Print(const char *szName) const;
+
+private:
+  /* One run of a section: its two timestamps, the end one 0 until issued */
+  struct Sample
+  {
+    int    section;
+    GLuint start, end;
+  };
+
+  /* A frame's samples, and the queries they use, kept for reuse */
+  struct FrameQueries
+  {
+    std::vector<GLuint> queries;
+    std::vector<Sample> samples;
+    size_t              nbrUsed;
+    GLuint              lastIssued; /* the latest timestamp asked for */
+    bool                pending;
+    int                 number;
+    std::vector<int>    open;       /* per section, the sample begun and not yet ended, or -1 */
+  };
+
+  GLuint NextQuery(FrameQueries &frame);
+  bool   Collect(FrameQueries &frame, bool wait);
+
+  bool                      supported;
+  std::vector<const char*>  names;
+  FrameQueries              frames[GPU_TIMER_FRAMES];
+  int                       current;
+  bool                      timing;      /* this frame has a slot */
+  int                       nbrSkipped;
+  int                       frameNumber, collectedNumber;
+
+  /* GPU_TIMER_AVERAGE_FRAMES totals per section, and the frames they're from, as a ring */
+  std::vector<float>        history;
+  std::vector<int>          historyFrames;
+  std::vector<double>       sums;
+  int                       historyNext, historyCount;
+};
+
+/* Times the enclosing scope */
+class ScopedGPUTimer
+{
+public:
+  ScopedGPUTimer(GPUTimers &t, int s) : timers(t), section(s) { timers.Begin(section); }
+  ~ScopedGPUTimer() { timers.End(section); }
+
+private:
+  GPUTimers &timers;
+  int        section;
+};
+
+GPUTimers::GPUTimers()
+  : supported(false), current(0), timing(false), nbrSkipped(0), frameNumber(-1), collectedNumber(-1),
+    historyNext(0), historyCount(0)
+{
+}
+
+void GPUTimers::SetupRenderingContext(const char *szNames[], int count)
+{
+  supported = (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+  names.assign(szNames, szNames + count);
+  for (int i = 0; i < GPU_TIMER_FRAMES; i++)
+  {
+    frames[i].nbrUsed = 0;
+    frames[i].lastIssued = 0;
+    frames[i].number = -1;
+    frames[i].open.assign(count, -1);
+  }
+  current = 0;
+  timing = false;
+  frameNumber = -1;
+  Reset();
+}
+
+void GPUTimers::Reset()
+{
+  for (int i = 0; i < GPU_TIMER_FRAMES; i++)
+    frames[i].pending = false;
+  history.assign(names.size() * GPU_TIMER_AVERAGE_FRAMES, 0.0f);
+  historyFrames.assign(GPU_TIMER_AVERAGE_FRAMES, -1);
+  sums.assign(names.size(), 0.0);
+  nbrSkipped = historyNext = historyCount = 0;
+  collectedNumber = frameNumber;
+}
+
+void GPUTimers::ShutdownRenderingContext()
+{
+  for (int i = 0; i < GPU_TIMER_FRAMES; i++)
+  {
+    if (!frames[i].queries.empty())
+      glDeleteQueries((GLsizei)frames[i].queries.size(), &frames[i].queries[0]);
+    frames[i].queries.clear();
+    frames[i].samples.clear();
+    frames[i].pending = false;
+  }
+  supported = false;
+}
+
+/* Takes in whatever earlier frames have finished; this frame's slot is the
+   oldest, and if it's still out, this frame isn't timed. */
+void GPUTimers::BeginFrame()
+{
+  timing = false;
+  frameNumber++;
+  if (!supported)
+    return;
+
+  for (int n = 1; n <= GPU_TIMER_FRAMES; n++)
+  {
+    FrameQueries &frame = frames[(current + n) % GPU_TIMER_FRAMES];
+    if (frame.pending && !Collect(frame, false))
+      break;
+  }
+
+  current = (current + 1) % GPU_TIMER_FRAMES;
+  FrameQueries &frame = frames[current];
+  if (frame.pending)
+  {
+    nbrSkipped++;
+    return;
+  }
+  frame.nbrUsed = 0;
+  frame.samples.clear();
+  frame.number = frameNumber;
+  frame.open.assign(names.size(), -1);
+  timing = true;
+}
+
+void GPUTimers::EndFrame()
+{
+  if (timing)
+    frames[current].pending = !frames[current].samples.empty();
+  timing = false;
+}
+
+GLuint GPUTimers::NextQuery(FrameQueries &frame)
+{
+  if (frame.nbrUsed == frame.queries.size())
+  {
+    GLuint query;
+    glGenQueries(1, &query);
+    frame.queries.push_back(query);
+  }
+  return frame.queries[frame.nbrUsed++];
+}
+
+void GPUTimers::Begin(int section)
+{
+  if (!timing)
+    return;
+
+  FrameQueries &frame = frames[current];
+  Sample sample;
+  sample.section = section;
+  sample.start = NextQuery(frame);
+  sample.end = 0;
+  glQueryCounter(sample.start, GL_TIMESTAMP);
+  frame.lastIssued = sample.start;
+  frame.open[section] = (int)frame.samples.size();
+  frame.samples.push_back(sample);
+}
+
+void GPUTimers::End(int section)
+{
+  if (!timing || frames[current].open[section] < 0)
+    return;
+
+  FrameQueries &frame = frames[current];
+  Sample &sample = frame.samples[frame.open[section]];
+  sample.end = NextQuery(frame);
+  glQueryCounter(sample.end, GL_TIMESTAMP);
+  frame.lastIssued = sample.end;
+  frame.open[section] = -1;
+}
+
+/* Oldest first, as BeginFrame does, waiting on each */
+void GPUTimers::Finish()
+{
+  if (!supported)
+    return;
+
+  for (int n = 1; n <= GPU_TIMER_FRAMES; n++)
+  {
+    FrameQueries &frame = frames[(current + n) % GPU_TIMER_FRAMES];
+    if (frame.pending)
+      Collect(frame, true);
+  }
+}
+
+/* Timestamps land in the order they were issued, so the frame is in once the
+   last one issued is. Each section's runs are added up (a section never ended
+   doesn't count), and the frame goes into the history and the averages. */
+bool GPUTimers::Collect(FrameQueries &frame, bool wait)
+{
+  GLint available = GL_FALSE;
+  if (!wait)
+  {
+    glGetQueryObjectiv(frame.lastIssued, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE)
+      return false;
+  }
+
+  std::vector<double> totals(names.size(), 0.0);
+  for (size_t i = 0; i < frame.samples.size(); i++)
+  {
+    if (frame.samples[i].end == 0)
+      continue;
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(frame.samples[i].start, GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(frame.samples[i].end, GL_QUERY_RESULT, &end);
+    if (end > start)
+      totals[frame.samples[i].section] += (end - start) / 1.0e6;
+  }
+  frame.pending = false;
+
+  for (size_t s = 0; s < names.size(); s++)
+  {
+    float &slot = history[s * GPU_TIMER_AVERAGE_FRAMES + historyNext];
+    sums[s] += totals[s] - slot;
+    slot = (float)totals[s];
+  }
+  historyFrames[historyNext] = frame.number;
+  collectedNumber = frame.number;
+  historyNext = (historyNext + 1) % GPU_TIMER_AVERAGE_FRAMES;
+  if (historyCount < GPU_TIMER_AVERAGE_FRAMES)
+    historyCount++;
+  return true;
+}
+
+/* False if the frame isn't in yet, went untimed, or is too far back */
+bool GPUTimers::GetFrameMs(int number, int section, float &ms) const
+{
+  for (int i = 0; i < historyCount; i++)
+    if (historyFrames[i] == number)
+    {
+      ms = history[section * GPU_TIMER_AVERAGE_FRAMES + i];
+      return true;
+    }
+  return false;
+}
+
+float GPUTimers::GetAverageMs(int section) const
+{
+  return (historyCount > 0) ? (float)(sums[section] / historyCount) : 0.0f;
+}
+
+void GPUTimers::Print(const char *szName) const
+{
+  if (!supported)
+    return;
+
+  printf("%s GPU ms:", szName);
+  for (int s = 0; s < GetSectionCount(); s++)
+    printf("%s %s %.3f", (s > 0) ? "," : "", names[s], GetAverageMs(s));
+  printf(" (last %d frames)\n", historyCount);
+}
+
+#endif
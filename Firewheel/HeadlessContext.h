@@ -0,0 +1,369 @@
+//
+//  HeadlessContext.h
+//  Firewheel
+//
+//  Rendering without a window, for benchmarks and golden images on machines
+//  with no display or GPU (Mesa's llvmpipe, say). The context comes from EGL,
+//  with no surface at all, or from OSMesa, and the frames go into a color and
+//  depth framebuffer object of the requested size in place of the window.
+//
+//  Which one is chosen at build time:
+//    -DFIREWHEEL_HEADLESS_EGL     link with -lEGL (EGL_MESA_platform_surfaceless
+//                                 is used when there, else the default display)
+//    -DFIREWHEEL_HEADLESS_OSMESA  link with -lOSMesa
+//  With neither, --headless reports that it isn't available.
+//
+
+#ifndef Firewheel_HeadlessContext_h
+#define Firewheel_HeadlessContext_h
+
+#include <GLTools.h>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(FIREWHEEL_HEADLESS_EGL)
+  #include <EGL/egl.h>
+  #include <EGL/eglext.h>
+#elif defined(FIREWHEEL_HEADLESS_OSMESA)
+  #include <GL/osmesa.h>
+#endif
+
+#include "TGAImage.h"
+
+/* Frames drawn before the timed ones, for the textures to stream in and the
+   occlusion queries to settle; the warm-up stops early once they have. */
+const int HEADLESS_MAX_WARMUP_FRAMES = 200;
+
+const int HEADLESS_DEFAULT_FRAMES = 100;
+
+/* What was asked for on the command line */
+struct HeadlessOptions
+{
+  bool        enabled;
+  int         nbrFrames;
+  GLint       width, height;
+  const char *szImageFileName;   /* the last frame goes here, if not NULL */
+  const char *szBenchmarkFileName;   /* per-frame times and counters, if not NULL */
+  const char *szKeys;   /* pressed in order before the first frame, if not NULL */
+};
+
+/* Picks out --headless [frames], --size WxH, --image file.tga, --benchmark
+   file.csv (or .json, which also means --headless) and --keys abc, leaving the
+   rest for GLUT; the size defaults to the window's. False, with the usage printed, when one
+   of them is malformed. */
+bool ParseHeadlessOptions(int argc, char *argv[], GLint defaultWidth, GLint defaultHeight, HeadlessOptions &options);
+bool ParseHeadlessOptions(int argc, char *argv[], GLint defaultWidth, GLint defaultHeight, HeadlessOptions &options)
+{
+  options.enabled = false;
+  options.nbrFrames = HEADLESS_DEFAULT_FRAMES;
+  options.width = defaultWidth;
+  options.height = defaultHeight;
+  options.szImageFileName = NULL;
+  options.szBenchmarkFileName = NULL;
+  options.szKeys = NULL;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool valid = true;
+    if (strcmp(argv[i], "--headless") == 0)
+    {
+      options.enabled = true;
+      if (i + 1 < argc && argv[i + 1][0] != '-')
+        valid = sscanf(argv[++i], "%d", &options.nbrFrames) == 1 && options.nbrFrames > 0;
+    }
+    else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+      valid = sscanf(argv[++i], "%dx%d", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0;
+    else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+      options.szImageFileName = argv[++i];
+    else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+    {
+      options.enabled = true;
+      options.szBenchmarkFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc)
+      options.szKeys = argv[++i];
+
+    if (!valid)
+    {
+      fprintf(stderr, "usage: %s [--headless [frames]] [--size WxH] [--image file.tga] [--benchmark file.csv|file.json] [--keys abc]\n", argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Frame times, in seconds, as min, median, mean and max milliseconds */
+void PrintFrameTimes(const char *szName, const std::vector<float> &frameSeconds);
+void PrintFrameTimes(const char *szName, const std::vector<float> &frameSeconds)
+{
+  if (frameSeconds.empty())
+    return;
+
+  std::vector<float> sorted(frameSeconds);
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0.0;
+  for (size_t i = 0; i < sorted.size(); i++)
+    total += sorted[i];
+  double mean = total / sorted.size();
+
+  printf("%s: %d frames, min %.3f ms, median %.3f ms, mean %.3f ms, max %.3f ms (%.1f fps)\n",
+         szName, (int)sorted.size(), 1000.0 * sorted.front(), 1000.0 * sorted[sorted.size() / 2],
+         1000.0 * mean, 1000.0 * sorted.back(), (mean > 0.0) ? 1.0 / mean : 0.0);
+}
+
+/* A current context and the framebuffer standing in for the window:
+     HeadlessContext headless;
+     if (!headless.Create(width, height))
+       return -1;
+     ... set up as for a window, with headless.GetFramebuffer() as the window's ...
+     for (each frame)
+     {
+       ... draw ...
+       headless.Finish();
+     }
+     headless.WriteImage("golden.tga");
+
+   Create() also initialises GLEW, as the window's code does after creating it. */
+class HeadlessContext
+{
+public:
+  HeadlessContext();
+  ~HeadlessContext() { Destroy(); }
+
+  bool Create(GLint width, GLint height);
+  void Destroy();
+
+  GLuint GetFramebuffer() const { return framebuffer; }
+  GLint  GetWidth() const       { return width; }
+  GLint  GetHeight() const      { return height; }
+
+  /* Stands in for the swap: waits for the frame, so it's all in its time */
+  void Finish() { glFinish(); }
+
+  /* The framebuffer's color, as a TGA */
+  bool WriteImage(const char *szFileName);
+
+private:
+  bool CreateContext();
+  void DestroyContext();
+  bool Fail(const char *szReason);
+
+  GLint  width, height;
+  GLuint framebuffer, colorBuffer, depthBuffer;
+
+#if defined(FIREWHEEL_HEADLESS_EGL)
+  EGLDisplay display;
+  EGLContext context;
+#elif defined(FIREWHEEL_HEADLESS_OSMESA)
+  OSMesaContext        context;
+  std::vector<GLubyte> osmesaBuffer;   /* never drawn to; OSMesa wants one to make current */
+#endif
+
+  HeadlessContext(const HeadlessContext&);
+  HeadlessContext& operator=(const HeadlessContext&);
+};
+
+HeadlessContext::HeadlessContext()
+  : width(0), height(0), framebuffer(0), colorBuffer(0), depthBuffer(0)
+#if defined(FIREWHEEL_HEADLESS_EGL)
+    , display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT)
+#elif defined(FIREWHEEL_HEADLESS_OSMESA)
+    , context(NULL)
+#endif
+{
+}
+
+bool HeadlessContext::Fail(const char *szReason)
+{
+  fprintf(stderr, "Headless: %s\n", szReason);
+  Destroy();
+  return false;
+}
+
+bool HeadlessContext::Create(GLint newWidth, GLint newHeight)
+{
+  Destroy();
+  width = newWidth;
+  height = newHeight;
+  if (!CreateContext())
+    return false;
+
+  /* Nothing to say which entry points there are without a window system, so
+     GLEW is told to look them all up. GLEW built for GLX also finds no X
+     display, which doesn't matter here. */
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+    err = GLEW_OK;
+#endif
+  if (err != GLEW_OK)
+  {
+    fprintf(stderr, "GLEW Error: %s\n", glewGetErrorString(err));
+    return Fail("can't initialise GLEW");
+  }
+  glGetError();   /* looking up what isn't there can leave GL_INVALID_ENUM behind */
+
+  glGenRenderbuffers(1, &colorBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  /* Bound for drawing and reading, like a window's, and left bound */
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    return Fail("framebuffer incomplete");
+  glViewport(0, 0, width, height);
+
+  printf("Headless: %s, %s, %dx%d\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION), width, height);
+  return true;
+}
+
+void HeadlessContext::Destroy()
+{
+  if (framebuffer != 0)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+  }
+  framebuffer = colorBuffer = depthBuffer = 0;
+  DestroyContext();
+}
+
+#if defined(FIREWHEEL_HEADLESS_EGL)
+
+/* Desktop GL, 3.3 compatibility where the driver takes the attributes (GLTools
+   still draws some things the old way), and made current with no surface. */
+bool HeadlessContext::CreateContext()
+{
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (eglGetPlatformDisplayEXT != NULL)
+    display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+  {
+    display = EGL_NO_DISPLAY;
+    return Fail("no EGL display");
+  }
+  if (!eglBindAPI(EGL_OPENGL_API))
+    return Fail("EGL can't do desktop OpenGL");
+
+  /* The default asks for window surfaces, which a surfaceless display hasn't */
+  static const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+  EGLConfig config;
+  EGLint nbrConfigs = 0;
+  if (!eglChooseConfig(display, configAttributes, &config, 1, &nbrConfigs) || nbrConfigs == 0)
+    return Fail("no EGL config for OpenGL");
+
+  static const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION_KHR, 3, EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT_KHR,
+    EGL_NONE
+  };
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+  if (context == EGL_NO_CONTEXT)
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+  if (context == EGL_NO_CONTEXT)
+    return Fail("can't create an EGL context");
+
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    return Fail("can't make the EGL context current without a surface");
+  return true;
+}
+
+void HeadlessContext::DestroyContext()
+{
+  if (display == EGL_NO_DISPLAY)
+    return;
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (context != EGL_NO_CONTEXT)
+    eglDestroyContext(display, context);
+  eglTerminate(display);
+  display = EGL_NO_DISPLAY;
+  context = EGL_NO_CONTEXT;
+}
+
+#elif defined(FIREWHEEL_HEADLESS_OSMESA)
+
+bool HeadlessContext::CreateContext()
+{
+#ifdef OSMESA_CONTEXT_MAJOR_VERSION
+  static const int attributes[] = {
+    OSMESA_FORMAT, OSMESA_RGBA, OSMESA_DEPTH_BITS, 24,
+    OSMESA_PROFILE, OSMESA_COMPAT_PROFILE,
+    OSMESA_CONTEXT_MAJOR_VERSION, 3, OSMESA_CONTEXT_MINOR_VERSION, 3,
+    0
+  };
+  context = OSMesaCreateContextAttribs(attributes, NULL);
+#endif
+  if (context == NULL)
+    context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL);
+  if (context == NULL)
+    return Fail("can't create an OSMesa context");
+
+  osmesaBuffer.resize(4 * (size_t)width * height);
+  if (!OSMesaMakeCurrent(context, &osmesaBuffer[0], GL_UNSIGNED_BYTE, width, height))
+    return Fail("can't make the OSMesa context current");
+  return true;
+}
+
+void HeadlessContext::DestroyContext()
+{
+  if (context != NULL)
+    OSMesaDestroyContext(context);
+  context = NULL;
+  std::vector<GLubyte>().swap(osmesaBuffer);
+}
+
+#else
+
+bool HeadlessContext::CreateContext()
+{
+  return Fail("not built in; build with FIREWHEEL_HEADLESS_EGL or FIREWHEEL_HEADLESS_OSMESA");
+}
+
+void HeadlessContext::DestroyContext()
+{
+}
+
+#endif
+
+/* A synchronous read; it's once, after the last frame */
+bool HeadlessContext::WriteImage(const char *szFileName)
+{
+  if (framebuffer == 0)
+    return false;
+
+  std::vector<GLubyte> pixels(3 * (size_t)width * height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, &pixels[0]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  if (!WriteTGA(szFileName, width, height, 3, &pixels[0]))
+  {
+    fprintf(stderr, "%s: can't write\n", szFileName);
+    return false;
+  }
+  printf("Headless: wrote %s\n", szFileName);
+  return true;
+}
+
+#endif
@@ -0,0 +1,377 @@
+//
+//  ImagePipeline.h
+//  Firewheel
+//
+//  Turns BMP pixels into RGBA8, the layout drivers take without converting,
+//  and builds the mip chain on the CPU instead of leaving it to the driver.
+//  Each level is a 2x2 box of the one above, averaged in linear light rather
+//  than on the sRGB values, so the smaller levels don't come out darker, and
+//  images resampled to another size are filtered in linear light too. The
+//  inner loops use SSSE3/SSE2 or NEON where the compiler targets them, and a
+//  level's rows can be split across a worker pool.
+//
+
+#ifndef Firewheel_ImagePipeline_h
+#define Firewheel_ImagePipeline_h
+
+#include <GLTools.h>
+#include <vector>
+#include <cmath>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+  #include <tmmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define FIREWHEEL_NEON 1
+#endif
+
+#include "Threading.h"
+
+/* Linear light is kept in this many bits, so four texels of it add up in 16 */
+const int IMAGE_LINEAR_BITS = 14;
+const int IMAGE_LINEAR_MAX  = (1 << IMAGE_LINEAR_BITS) - 1;
+
+/* Fewer rows than this per thread aren't worth waking the workers for */
+const int IMAGE_ROWS_PER_WORKER = 32;
+
+/* sRGB to linear and back; alpha is linear already and only rescaled */
+struct SRGBTables
+{
+  GLushort toLinear[256];
+  GLubyte  fromLinear[IMAGE_LINEAR_MAX + 1];
+  SRGBTables();
+};
+
+SRGBTables::SRGBTables()
+{
+  for (int i = 0; i < 256; i++)
+  {
+    double c = i / 255.0;
+    double l = (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+    toLinear[i] = (GLushort)(l * IMAGE_LINEAR_MAX + 0.5);
+  }
+  for (int i = 0; i <= IMAGE_LINEAR_MAX; i++)
+  {
+    double l = (double)i / IMAGE_LINEAR_MAX;
+    double c = (l <= 0.0031308) ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+    fromLinear[i] = (GLubyte)(c * 255.0 + 0.5);
+  }
+}
+
+const SRGBTables SRGB_TABLES;
+
+/* Levels from width x height down to 1x1, each halved and rounded down */
+int GetMipLevelCount(int width, int height);
+int GetMipLevelCount(int width, int height)
+{
+  int count = 1;
+  for (; width > 1 || height > 1; count++)
+  {
+    width = (width > 1) ? width / 2 : 1;
+    height = (height > 1) ? height / 2 : 1;
+  }
+  return count;
+}
+
+/* Bytes for nbrLevels RGBA8 levels, from width x height down, back to back */
+size_t GetRGBAMipChainSize(int width, int height, int nbrLevels);
+size_t GetRGBAMipChainSize(int width, int height, int nbrLevels)
+{
+  size_t size = 0;
+  for (int level = 0; level < nbrLevels; level++)
+  {
+    size += 4 * (size_t)width * height;
+    width = (width > 1) ? width / 2 : 1;
+    height = (height > 1) ? height / 2 : 1;
+  }
+  return size;
+}
+
+/* One row of BGR or BGRA texels (pixelSize 3 or 4) to RGBA; opaque without alpha */
+void ConvertBGRToRGBA(const GLubyte *pSrc, int pixelSize, int width, GLubyte *pDst);
+void ConvertBGRToRGBA(const GLubyte *pSrc, int pixelSize, int width, GLubyte *pDst)
+{
+  int x = 0;
+
+#if defined(__SSSE3__)
+  if (pixelSize == 3)
+  {
+    const __m128i swizzle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+    /* Each load reads 16 bytes for 4 texels' 12; stop short of the row's end */
+    for (; x + 6 <= width; x += 4)
+    {
+      __m128i bgr = _mm_loadu_si128((const __m128i*)(pSrc + 3 * x));
+      _mm_storeu_si128((__m128i*)(pDst + 4 * x), _mm_or_si128(_mm_shuffle_epi8(bgr, swizzle), opaque));
+    }
+  }
+  else
+  {
+    const __m128i swizzle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    for (; x + 4 <= width; x += 4)
+    {
+      __m128i bgra = _mm_loadu_si128((const __m128i*)(pSrc + 4 * x));
+      _mm_storeu_si128((__m128i*)(pDst + 4 * x), _mm_shuffle_epi8(bgra, swizzle));
+    }
+  }
+#elif defined(__SSE2__)
+  /* No byte shuffle: swap blue and red within each 32-bit texel */
+  if (pixelSize == 4)
+  {
+    const __m128i greenAlpha = _mm_set1_epi32((int)0xFF00FF00);
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    for (; x + 4 <= width; x += 4)
+    {
+      __m128i bgra = _mm_loadu_si128((const __m128i*)(pSrc + 4 * x));
+      __m128i red = _mm_and_si128(_mm_srli_epi32(bgra, 16), lowByte);
+      __m128i blue = _mm_slli_epi32(_mm_and_si128(bgra, lowByte), 16);
+      _mm_storeu_si128((__m128i*)(pDst + 4 * x), _mm_or_si128(_mm_and_si128(bgra, greenAlpha), _mm_or_si128(red, blue)));
+    }
+  }
+#elif defined(FIREWHEEL_NEON)
+  if (pixelSize == 3)
+  {
+    for (; x + 16 <= width; x += 16)
+    {
+      uint8x16x3_t bgr = vld3q_u8(pSrc + 3 * x);
+      uint8x16x4_t rgba;
+      rgba.val[0] = bgr.val[2];
+      rgba.val[1] = bgr.val[1];
+      rgba.val[2] = bgr.val[0];
+      rgba.val[3] = vdupq_n_u8(255);
+      vst4q_u8(pDst + 4 * x, rgba);
+    }
+  }
+  else
+  {
+    for (; x + 16 <= width; x += 16)
+    {
+      uint8x16x4_t texels = vld4q_u8(pSrc + 4 * x);
+      uint8x16_t blue = texels.val[0];
+      texels.val[0] = texels.val[2];
+      texels.val[2] = blue;
+      vst4q_u8(pDst + 4 * x, texels);
+    }
+  }
+#endif
+
+  for (; x < width; x++)
+  {
+    const GLubyte *pTexel = pSrc + pixelSize * x;
+    pDst[4 * x + 0] = pTexel[2];
+    pDst[4 * x + 1] = pTexel[1];
+    pDst[4 * x + 2] = pTexel[0];
+    pDst[4 * x + 3] = (pixelSize == 4) ? pTexel[3] : 255;
+  }
+}
+
+/* Each output texel is the rounded mean of the 2x2 block under it: texels 2x
+   and 2x+1 of both rows. Linear values, four channels a texel. */
+void AverageTexelQuads(const GLushort *pRow0, const GLushort *pRow1, int dstWidth, GLushort *pDst);
+void AverageTexelQuads(const GLushort *pRow0, const GLushort *pRow1, int dstWidth, GLushort *pDst)
+{
+  int x = 0;
+
+#if defined(__SSE2__)
+  const __m128i half = _mm_set1_epi16(2);
+  for (; x + 2 <= dstWidth; x += 2)
+  {
+    /* a holds source texels 2x and 2x+1, b the next two; their 64-bit halves
+       pair up into the two output texels */
+    __m128i a = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(pRow0 + 8 * x)),
+                              _mm_loadu_si128((const __m128i*)(pRow1 + 8 * x)));
+    __m128i b = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(pRow0 + 8 * x + 8)),
+                              _mm_loadu_si128((const __m128i*)(pRow1 + 8 * x + 8)));
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+    _mm_storeu_si128((__m128i*)(pDst + 4 * x), _mm_srli_epi16(_mm_add_epi16(sum, half), 2));
+  }
+#elif defined(FIREWHEEL_NEON)
+  for (; x + 2 <= dstWidth; x += 2)
+  {
+    uint16x8_t a = vaddq_u16(vld1q_u16(pRow0 + 8 * x), vld1q_u16(pRow1 + 8 * x));
+    uint16x8_t b = vaddq_u16(vld1q_u16(pRow0 + 8 * x + 8), vld1q_u16(pRow1 + 8 * x + 8));
+    uint16x8_t sum = vaddq_u16(vcombine_u16(vget_low_u16(a), vget_low_u16(b)),
+                               vcombine_u16(vget_high_u16(a), vget_high_u16(b)));
+    vst1q_u16(pDst + 4 * x, vrshrq_n_u16(sum, 2));
+  }
+#endif
+
+  for (; x < dstWidth; x++)
+    for (int c = 0; c < 4; c++)
+      pDst[4 * x + c] = (GLushort)((pRow0[8 * x + c] + pRow0[8 * x + 4 + c] +
+                                    pRow1[8 * x + c] + pRow1[8 * x + 4 + c] + 2) >> 2);
+}
+
+/* One source row to linear, as 2 * dstWidth texels; a 1 texel wide level
+   repeats its texel. */
+void DecodeLinearRow(const GLubyte *pSrc, int srcWidth, int dstWidth, GLushort *pDst);
+void DecodeLinearRow(const GLubyte *pSrc, int srcWidth, int dstWidth, GLushort *pDst)
+{
+  for (int x = 0; x < 2 * dstWidth; x++)
+  {
+    const GLubyte *pTexel = pSrc + 4 * ((x < srcWidth) ? x : srcWidth - 1);
+    pDst[4 * x + 0] = SRGB_TABLES.toLinear[pTexel[0]];
+    pDst[4 * x + 1] = SRGB_TABLES.toLinear[pTexel[1]];
+    pDst[4 * x + 2] = SRGB_TABLES.toLinear[pTexel[2]];
+    pDst[4 * x + 3] = (GLushort)((pTexel[3] * IMAGE_LINEAR_MAX + 127) / 255);
+  }
+}
+
+void EncodeLinearRow(const GLushort *pSrc, int width, GLubyte *pDst);
+void EncodeLinearRow(const GLushort *pSrc, int width, GLubyte *pDst)
+{
+  for (int x = 0; x < width; x++)
+  {
+    pDst[4 * x + 0] = SRGB_TABLES.fromLinear[pSrc[4 * x + 0]];
+    pDst[4 * x + 1] = SRGB_TABLES.fromLinear[pSrc[4 * x + 1]];
+    pDst[4 * x + 2] = SRGB_TABLES.fromLinear[pSrc[4 * x + 2]];
+    pDst[4 * x + 3] = (GLubyte)((pSrc[4 * x + 3] * 255 + IMAGE_LINEAR_MAX / 2) / IMAGE_LINEAR_MAX);
+  }
+}
+
+/* One level's worth of DownsampleRGBA(), for the worker pool */
+struct DownsampleJob
+{
+  const GLubyte *pSrc;
+  int            srcWidth, srcHeight;
+  GLubyte       *pDst;
+  int            dstWidth;
+};
+
+void DownsampleRows(int first, int last, void *pContext);
+void DownsampleRows(int first, int last, void *pContext)
+{
+  const DownsampleJob *pJob = static_cast<const DownsampleJob*>(pContext);
+  std::vector<GLushort> row0(8 * pJob->dstWidth), row1(8 * pJob->dstWidth), average(4 * pJob->dstWidth);
+
+  for (int y = first; y < last; y++)
+  {
+    int y1 = (2 * y + 1 < pJob->srcHeight) ? 2 * y + 1 : pJob->srcHeight - 1;
+    DecodeLinearRow(pJob->pSrc + 4 * (size_t)pJob->srcWidth * 2 * y, pJob->srcWidth, pJob->dstWidth, &row0[0]);
+    DecodeLinearRow(pJob->pSrc + 4 * (size_t)pJob->srcWidth * y1, pJob->srcWidth, pJob->dstWidth, &row1[0]);
+    AverageTexelQuads(&row0[0], &row1[0], pJob->dstWidth, &average[0]);
+    EncodeLinearRow(&average[0], pJob->dstWidth, pJob->pDst + 4 * (size_t)pJob->dstWidth * y);
+  }
+}
+
+/* The next mip level of an RGBA8 image, half its size rounded down; an odd
+   last row or column is left out, as with the driver's own box filter. With
+   a pool, its rows are split between the workers. */
+void DownsampleRGBA(const GLubyte *pSrc, int srcWidth, int srcHeight, GLubyte *pDst, WorkerPool *pWorkers);
+void DownsampleRGBA(const GLubyte *pSrc, int srcWidth, int srcHeight, GLubyte *pDst, WorkerPool *pWorkers)
+{
+  DownsampleJob job;
+  job.pSrc = pSrc;
+  job.srcWidth = srcWidth;
+  job.srcHeight = srcHeight;
+  job.pDst = pDst;
+  job.dstWidth = (srcWidth > 1) ? srcWidth / 2 : 1;
+  int dstHeight = (srcHeight > 1) ? srcHeight / 2 : 1;
+
+  if (pWorkers != NULL)
+    pWorkers->ParallelFor(dstHeight, DownsampleRows, &job, IMAGE_ROWS_PER_WORKER);
+  else
+    DownsampleRows(0, dstHeight, &job);
+}
+
+/* Fills in levels 1 to nbrLevels - 1 after the first, which is width x height
+   at pLevels; the levels are back to back, as GetRGBAMipChainSize() counts. */
+void BuildRGBAMipChain(GLubyte *pLevels, int width, int height, int nbrLevels, WorkerPool *pWorkers);
+void BuildRGBAMipChain(GLubyte *pLevels, int width, int height, int nbrLevels, WorkerPool *pWorkers)
+{
+  for (int level = 1; level < nbrLevels; level++)
+  {
+    GLubyte *pNext = pLevels + GetRGBAMipChainSize(width, height, 1);
+    DownsampleRGBA(pLevels, width, height, pNext, pWorkers);
+    pLevels = pNext;
+    width = (width > 1) ? width / 2 : 1;
+    height = (height > 1) ? height / 2 : 1;
+  }
+}
+
+/* Where output texel i of dstSize falls among srcSize texels, with centers
+   lined up: the texel before it, and the next one's weight in 256ths. */
+void GetResampleTap(int srcSize, int dstSize, int i, int &first, int &weight);
+void GetResampleTap(int srcSize, int dstSize, int i, int &first, int &weight)
+{
+  int position = (2 * i + 1) * srcSize * 128 / dstSize - 128;
+  if (position < 0)
+    position = 0;
+  first = position >> 8;
+  weight = position & 255;
+  if (first >= srcSize - 1)
+  {
+    first = srcSize - 1;
+    weight = 0;
+  }
+}
+
+/* One ResampleRGBA(), for the worker pool */
+struct ResampleJob
+{
+  const GLubyte *pSrc;
+  int            srcWidth, srcHeight;
+  GLubyte       *pDst;
+  int            dstWidth, dstHeight;
+};
+
+void ResampleRows(int first, int last, void *pContext);
+void ResampleRows(int first, int last, void *pContext)
+{
+  const ResampleJob *pJob = static_cast<const ResampleJob*>(pContext);
+  int srcWidth = pJob->srcWidth, dstWidth = pJob->dstWidth;
+  std::vector<GLushort> row0(8 * ((srcWidth + 1) / 2)), row1(8 * ((srcWidth + 1) / 2)), resampled(4 * dstWidth);
+  std::vector<int> x0(dstWidth), x1(dstWidth), tx(dstWidth);
+
+  for (int x = 0; x < dstWidth; x++)
+  {
+    GetResampleTap(srcWidth, dstWidth, x, x0[x], tx[x]);
+    x1[x] = (x0[x] + 1 < srcWidth) ? x0[x] + 1 : x0[x];
+  }
+
+  for (int y = first; y < last; y++)
+  {
+    int y0, ty;
+    GetResampleTap(pJob->srcHeight, pJob->dstHeight, y, y0, ty);
+    int y1 = (y0 + 1 < pJob->srcHeight) ? y0 + 1 : y0;
+    DecodeLinearRow(pJob->pSrc + 4 * (size_t)srcWidth * y0, srcWidth, (srcWidth + 1) / 2, &row0[0]);
+    DecodeLinearRow(pJob->pSrc + 4 * (size_t)srcWidth * y1, srcWidth, (srcWidth + 1) / 2, &row1[0]);
+
+    for (int x = 0; x < dstWidth; x++)
+      for (int c = 0; c < 4; c++)
+      {
+        int top = row0[4 * x0[x] + c] * (256 - tx[x]) + row0[4 * x1[x] + c] * tx[x];
+        int bottom = row1[4 * x0[x] + c] * (256 - tx[x]) + row1[4 * x1[x] + c] * tx[x];
+        resampled[4 * x + c] = (GLushort)((top * (256 - ty) + bottom * ty + 32768) >> 16);
+      }
+    EncodeLinearRow(&resampled[0], dstWidth, pJob->pDst + 4 * (size_t)dstWidth * y);
+  }
+}
+
+/* An RGBA8 image stretched or shrunk to dstWidth x dstHeight, bilinearly, so
+   shrinking it to much under half its size aliases; stretching it is fine.
+   With a pool, its rows are split between the workers. */
+void ResampleRGBA(const GLubyte *pSrc, int srcWidth, int srcHeight, GLubyte *pDst, int dstWidth, int dstHeight,
+                  WorkerPool *pWorkers);
+void ResampleRGBA(const GLubyte *pSrc, int srcWidth, int srcHeight, GLubyte *pDst, int dstWidth, int dstHeight,
+                  WorkerPool *pWorkers)
+{
+  ResampleJob job;
+  job.pSrc = pSrc;
+  job.srcWidth = srcWidth;
+  job.srcHeight = srcHeight;
+  job.pDst = pDst;
+  job.dstWidth = dstWidth;
+  job.dstHeight = dstHeight;
+
+  if (pWorkers != NULL)
+    pWorkers->ParallelFor(dstHeight, ResampleRows, &job, IMAGE_ROWS_PER_WORKER);
+  else
+    ResampleRows(0, dstHeight, &job);
+}
+
+#endif
@@ -0,0 +1,97 @@
+//
+//  KTXFormat.h
+//  Firewheel
+//
+//  The parts of the KTX format that need no OpenGL context: the header's
+//  constants and byte order, and decoding of the DXT1 and DXT5 blocks. Shared
+//  by KTXImage, which uploads the files, and Tools/bmp2ktx, which writes them.
+//
+
+#ifndef Firewheel_KTXFormat_h
+#define Firewheel_KTXFormat_h
+
+#include <GLTools.h>
+#include <cstring>
+
+const int KTX_HEADER_SIZE = 64;
+const int KTX_MAX_LEVELS = 16;
+const GLubyte KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const unsigned long KTX_ENDIANNESS = 0x04030201UL;
+
+/* Bytes in each 4x4 block */
+const int DXT1_BLOCK_SIZE = 8;
+const int DXT5_BLOCK_SIZE = 16;
+
+inline unsigned long ReadKTXLong(const GLubyte *p)
+  { return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24); }
+
+/* RGB565 to 8 bits a channel, replicating the top bits into the bottom. */
+void DecodeRGB565(unsigned int color, GLubyte rgba[4]);
+void DecodeRGB565(unsigned int color, GLubyte rgba[4])
+{
+  unsigned int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+  rgba[0] = (GLubyte)((r << 3) | (r >> 2));
+  rgba[1] = (GLubyte)((g << 2) | (g >> 4));
+  rgba[2] = (GLubyte)((b << 3) | (b >> 2));
+  rgba[3] = 255;
+}
+
+/* One 4x4 block to RGBA, row by row. DXT5's color half always uses the four
+   color mode; only DXT1 has the three colors and transparent black one. */
+void DecodeDXTBlock(GLenum format, const GLubyte *pBlock, GLubyte texels[16][4]);
+void DecodeDXTBlock(GLenum format, const GLubyte *pBlock, GLubyte texels[16][4])
+{
+  GLubyte alpha[8];
+  bool dxt5 = (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+  if (dxt5)
+  {
+    alpha[0] = pBlock[0];
+    alpha[1] = pBlock[1];
+    if (alpha[0] > alpha[1])
+      for (int i = 1; i < 7; i++)
+        alpha[i + 1] = (GLubyte)(((7 - i) * alpha[0] + i * alpha[1]) / 7);
+    else
+    {
+      for (int i = 1; i < 5; i++)
+        alpha[i + 1] = (GLubyte)(((5 - i) * alpha[0] + i * alpha[1]) / 5);
+      alpha[6] = 0;
+      alpha[7] = 255;
+    }
+    pBlock += 8;
+  }
+
+  GLubyte palette[4][4];
+  unsigned int color0 = pBlock[0] | (pBlock[1] << 8), color1 = pBlock[2] | (pBlock[3] << 8);
+  DecodeRGB565(color0, palette[0]);
+  DecodeRGB565(color1, palette[1]);
+  for (int c = 0; c < 4; c++)
+  {
+    if (color0 > color1 || dxt5)
+    {
+      palette[2][c] = (GLubyte)((2 * palette[0][c] + palette[1][c]) / 3);
+      palette[3][c] = (GLubyte)((palette[0][c] + 2 * palette[1][c]) / 3);
+    }
+    else
+    {
+      palette[2][c] = (GLubyte)((palette[0][c] + palette[1][c]) / 2);
+      palette[3][c] = 0;
+    }
+  }
+  unsigned long indexes = ReadKTXLong(pBlock + 4);
+  for (int i = 0; i < 16; i++)
+    memcpy(texels[i], palette[(indexes >> (2 * i)) & 3], 4);
+
+  if (dxt5)
+  {
+    /* 48 bits of 3 bit indexes, least significant first */
+    const GLubyte *pIndexes = pBlock - 6;
+    for (int i = 0; i < 16; i++)
+    {
+      int bit = 3 * i;
+      unsigned int bits = pIndexes[bit / 8] | ((bit / 8 + 1 < 6) ? (pIndexes[bit / 8 + 1] << 8) : 0);
+      texels[i][3] = alpha[(bits >> (bit % 8)) & 7];
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,271 @@
+//
+//  KTXImage.h
+//  Firewheel
+//
+//  Reads KTX textures made offline by Tools/bmp2ktx: the whole mip chain,
+//  DXT1 or DXT5 compressed or plain RGB(A)8, read in place from a mapping of
+//  the file and handed to OpenGL as it is, so nothing is built at startup.
+//
+
+#ifndef Firewheel_KTXImage_h
+#define Firewheel_KTXImage_h
+
+#include <GLTools.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "MappedFile.h"
+#include "KTXFormat.h"
+
+/* An open, validated KTX file holding a 2D texture and its mip levels:
+     KTXImage image;
+     if (image.Open(szFileName))
+       image.TexImage2D(GL_TEXTURE_2D, !KTXImage::CanUploadCompressed());
+   Without S3TC support the levels are decoded to RGBA8 on the way, which
+   keeps the look and loses the memory savings. */
+class KTXImage
+{
+public:
+  KTXImage();
+  ~KTXImage() { Close(); }
+
+  bool Open(const char *szFileName);
+  void Close();
+
+  static bool CanUploadCompressed() { return GLEW_EXT_texture_compression_s3tc != GL_FALSE; }
+
+  GLint  GetWidth() const        { return GetLevelWidth(0); }
+  GLint  GetHeight() const       { return GetLevelHeight(0); }
+  GLenum GetInternalFormat() const { return internalFormat; }
+  bool   IsCompressed() const    { return blockSize != 0; }
+  int    GetLevelCount() const   { return nbrLevels; }
+
+  /* A file may leave the mip chain to the loader (mipmaps still to be generated) */
+  bool   NeedsMipmaps() const    { return needsMipmaps; }
+
+  GLint  GetLevelWidth(int level) const  { return (width >> level) > 0 ? (width >> level) : 1; }
+  GLint  GetLevelHeight(int level) const { return (height >> level) > 0 ? (height >> level) : 1; }
+  const GLubyte* GetLevelData(int level) const { return pLevels[level]; }
+  size_t GetLevelSize(int level) const { return levelSizes[level]; }
+
+  /* Bytes each level takes once uploaded from memory, decoded or not, and the
+     levels from firstLevel down back to back, as CopyLevels() lays them out. */
+  size_t GetUploadSize(int level, bool decode) const;
+  size_t GetUploadSize(bool decode, int firstLevel = 0) const;
+  void CopyLevels(GLubyte *pDst, bool decode, int firstLevel = 0) const;
+  void DecodeLevel(int level, GLubyte *pDst) const;
+
+  /* The levels from firstLevel down, which becomes the base level, from the
+     mapping or from a copy made by CopyLevels() (which may be an offset into
+     a bound pixel unpack buffer). */
+  void TexImage2D(GLenum target, bool decode, int firstLevel = 0) const;
+  void TexImage2D(GLenum target, const GLubyte *pCopy, bool decode, int firstLevel = 0) const;
+
+private:
+  bool Fail(const char *szFileName, const char *szReason);
+  void UploadLevel(GLenum target, int level, const GLvoid *pData, bool decoded) const;
+
+  MappedFile     file;
+  GLenum         internalFormat, format;
+  int            blockSize;     /* 0 for uncompressed */
+  int            bytesPerPixel; /* uncompressed only */
+  GLint          width, height;
+  int            nbrLevels;
+  bool           needsMipmaps;
+  const GLubyte *pLevels[KTX_MAX_LEVELS];
+  size_t         levelSizes[KTX_MAX_LEVELS];
+
+  KTXImage(const KTXImage&);
+  KTXImage& operator=(const KTXImage&);
+};
+
+KTXImage::KTXImage()
+  : internalFormat(0), format(0), blockSize(0), bytesPerPixel(0), width(0), height(0), nbrLevels(0), needsMipmaps(false)
+{
+}
+
+bool KTXImage::Fail(const char *szFileName, const char *szReason)
+{
+  fprintf(stderr, "%s: %s\n", szFileName, szReason);
+  Close();
+  return false;
+}
+
+bool KTXImage::Open(const char *szFileName)
+{
+  Close();
+
+  if (!file.Open(szFileName))
+    return Fail(szFileName, "can't open");
+  const GLubyte *pFile = file.GetData();
+  size_t fileSize = file.GetSize();
+
+  if (fileSize < (size_t)KTX_HEADER_SIZE || memcmp(pFile, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+    return Fail(szFileName, "not a KTX file");
+  if (ReadKTXLong(pFile + 12) != KTX_ENDIANNESS)
+    return Fail(szFileName, "KTX file is the wrong way round for this machine");
+
+  GLenum type = ReadKTXLong(pFile + 16);
+  format = ReadKTXLong(pFile + 24);
+  internalFormat = ReadKTXLong(pFile + 28);
+  GLint fileWidth = (GLint)ReadKTXLong(pFile + 36);
+  GLint fileHeight = (GLint)ReadKTXLong(pFile + 40);
+  unsigned long depth = ReadKTXLong(pFile + 44), arrayElements = ReadKTXLong(pFile + 48), faces = ReadKTXLong(pFile + 52);
+  unsigned long fileLevels = ReadKTXLong(pFile + 56), keyValueSize = ReadKTXLong(pFile + 60);
+
+  if (fileWidth <= 0 || fileHeight <= 0 || depth != 0 || arrayElements != 0 || faces != 1)
+    return Fail(szFileName, "only plain 2D KTX textures are supported");
+
+  if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+    blockSize = DXT1_BLOCK_SIZE;
+  else if (internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+    blockSize = DXT5_BLOCK_SIZE;
+  else if (internalFormat == GL_RGB8 && format == GL_RGB && type == GL_UNSIGNED_BYTE)
+    bytesPerPixel = 3;
+  else if (internalFormat == GL_RGBA8 && format == GL_RGBA && type == GL_UNSIGNED_BYTE)
+    bytesPerPixel = 4;
+  else
+    return Fail(szFileName, "KTX format not supported (DXT1, DXT5, RGB8 and RGBA8 are)");
+
+  width = fileWidth;
+  height = fileHeight;
+  needsMipmaps = (fileLevels == 0);
+
+  /* Down to 1x1 at most */
+  int maxLevels = 1;
+  while (maxLevels < KTX_MAX_LEVELS && ((width >> maxLevels) > 0 || (height >> maxLevels) > 0))
+    maxLevels++;
+  if (fileLevels > (unsigned long)maxLevels)
+    return Fail(szFileName, "too many KTX mip levels");
+  nbrLevels = needsMipmaps ? 1 : (int)fileLevels;
+
+  /* Each level is its size, then its data, padded to 4 bytes */
+  size_t offset = (size_t)KTX_HEADER_SIZE + keyValueSize;
+  for (int level = 0; level < nbrLevels; level++)
+  {
+    if (offset > fileSize || fileSize - offset < 4)
+      return Fail(szFileName, "KTX file is truncated");
+    size_t size = ReadKTXLong(pFile + offset);
+    offset += 4;
+    if (size != GetUploadSize(level, false))
+      return Fail(szFileName, "KTX level has the wrong size");
+    if (fileSize - offset < size)
+      return Fail(szFileName, "KTX file is truncated");
+
+    pLevels[level] = pFile + offset;
+    levelSizes[level] = size;
+    offset += (size + 3) & ~(size_t)3;
+  }
+  return true;
+}
+
+void KTXImage::Close()
+{
+  file.Close();
+  internalFormat = format = 0;
+  blockSize = bytesPerPixel = 0;
+  width = height = 0;
+  nbrLevels = 0;
+  needsMipmaps = false;
+}
+
+/* Uncompressed rows are padded to 4 bytes, in the file and once decoded */
+size_t KTXImage::GetUploadSize(int level, bool decode) const
+{
+  size_t levelWidth = GetLevelWidth(level), levelHeight = GetLevelHeight(level);
+  if (decode && IsCompressed())
+    return 4 * levelWidth * levelHeight;
+  if (IsCompressed())
+    return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize;
+  return ((bytesPerPixel * levelWidth + 3) & ~(size_t)3) * levelHeight;
+}
+
+size_t KTXImage::GetUploadSize(bool decode, int firstLevel) const
+{
+  size_t size = 0;
+  for (int level = firstLevel; level < nbrLevels; level++)
+    size += GetUploadSize(level, decode);
+  return size;
+}
+
+void KTXImage::CopyLevels(GLubyte *pDst, bool decode, int firstLevel) const
+{
+  for (int level = firstLevel; level < nbrLevels; level++)
+  {
+    if (decode && IsCompressed())
+      DecodeLevel(level, pDst);
+    else
+      memcpy(pDst, pLevels[level], levelSizes[level]);
+    pDst += GetUploadSize(level, decode);
+  }
+}
+
+/* To tightly packed RGBA, clipping the blocks that hang over the edges */
+void KTXImage::DecodeLevel(int level, GLubyte *pDst) const
+{
+  GLint levelWidth = GetLevelWidth(level), levelHeight = GetLevelHeight(level);
+  const GLubyte *pBlock = pLevels[level];
+  GLubyte texels[16][4];
+
+  for (int y = 0; y < levelHeight; y += 4)
+    for (int x = 0; x < levelWidth; x += 4, pBlock += blockSize)
+    {
+      DecodeDXTBlock(internalFormat, pBlock, texels);
+      for (int row = 0; row < 4 && y + row < levelHeight; row++)
+        for (int column = 0; column < 4 && x + column < levelWidth; column++)
+          memcpy(pDst + 4 * ((y + row) * levelWidth + x + column), texels[4 * row + column], 4);
+    }
+}
+
+void KTXImage::UploadLevel(GLenum target, int level, const GLvoid *pData, bool decoded) const
+{
+  GLint levelWidth = GetLevelWidth(level), levelHeight = GetLevelHeight(level);
+  if (decoded && IsCompressed())
+  {
+    GLenum decodedFormat = (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? GL_RGB8 : GL_RGBA8;
+    glTexImage2D(target, level, decodedFormat, levelWidth, levelHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, pData);
+  }
+  else if (IsCompressed())
+    glCompressedTexImage2D(target, level, internalFormat, levelWidth, levelHeight, 0,
+                           (GLsizei)GetUploadSize(level, false), pData);
+  else
+    glTexImage2D(target, level, internalFormat, levelWidth, levelHeight, 0, format, GL_UNSIGNED_BYTE, pData);
+}
+
+void KTXImage::TexImage2D(GLenum target, bool decode, int firstLevel) const
+{
+  std::vector<GLubyte> decoded;
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int level = firstLevel; level < nbrLevels; level++)
+  {
+    if (decode && IsCompressed())
+    {
+      decoded.resize(GetUploadSize(level, true));
+      DecodeLevel(level, &decoded[0]);
+      UploadLevel(target, level, &decoded[0], true);
+    }
+    else
+      UploadLevel(target, level, pLevels[level], false);
+  }
+
+  /* A partial chain is still a complete texture */
+  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, firstLevel);
+  if (!needsMipmaps)
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, nbrLevels - 1);
+}
+
+void KTXImage::TexImage2D(GLenum target, const GLubyte *pCopy, bool decode, int firstLevel) const
+{
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int level = firstLevel; level < nbrLevels; level++)
+  {
+    UploadLevel(target, level, pCopy, decode);
+    pCopy += GetUploadSize(level, decode);
+  }
+  glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, firstLevel);
+  if (!needsMipmaps)
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, nbrLevels - 1);
+}
+
+#endif
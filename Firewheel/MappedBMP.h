@@ -0,0 +1,162 @@
+//
+//  MappedBMP.h
+//  Firewheel
+//
+//  Reads BMP images straight out of a memory mapping of the file: the header
+//  is checked where it lies, and the pixel rows are handed to OpenGL from the
+//  mapping, with no intermediate copy of the image.
+//
+
+#ifndef Firewheel_MappedBMP_h
+#define Firewheel_MappedBMP_h
+
+#include <GLTools.h>
+#include <cstdio>
+
+#include "MappedFile.h"
+
+/* Offsets into the file header (14 bytes) and the info header that follows */
+const int BMP_FILE_HEADER_SIZE = 14;
+const int BMP_MIN_INFO_SIZE = 40;
+const int BMP_BITFIELDS_MASKS_SIZE = 12;
+
+const unsigned long BMP_COMPRESSION_RGB = 0;
+const unsigned long BMP_COMPRESSION_BITFIELDS = 3;
+
+/* BMP fields are little endian and not necessarily aligned. */
+inline unsigned long ReadBMPLong(const GLubyte *p)
+  { return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24); }
+inline unsigned int ReadBMPShort(const GLubyte *p)
+  { return (unsigned int)p[0] | ((unsigned int)p[1] << 8); }
+
+/* An open, validated BMP. Uncompressed 24 bit, and 32 bit either uncompressed
+   or with the usual BGRA bit fields, in either row order; rows are padded to 4
+   bytes as the format requires. Anything else fails Open(), with a message.
+
+     MappedBMP image;
+     if (image.Open(szFileName))
+       image.TexImage2D(GL_TEXTURE_2D);
+
+   GetRow(0) is always the bottom row, which is where OpenGL starts too. */
+class MappedBMP
+{
+public:
+  MappedBMP();
+  ~MappedBMP() { Close(); }
+
+  bool Open(const char *szFileName);
+  void Close();
+
+  GLint  GetWidth() const        { return width; }
+  GLint  GetHeight() const       { return height; }
+  int    GetBytesPerPixel() const { return bytesPerPixel; }
+  GLenum GetFormat() const       { return (bytesPerPixel == 4) ? GL_BGRA : GL_BGR; }
+  const GLubyte* GetRow(int y) const
+    { return topDown ? pPixels + (height - 1 - y) * rowStride : pPixels + y * rowStride; }
+  long   GetRowStride() const    { return rowStride; }
+  size_t GetImageSize() const    { return (size_t)rowStride * height; }
+  bool   IsTopDown() const       { return topDown; }
+
+  /* Upload level 0 from the mapping; bottom-up files go in one call. */
+  void TexImage2D(GLenum target) const;
+
+private:
+  bool Fail(const char *szFileName, const char *szReason);
+
+  MappedFile     file;
+  const GLubyte *pPixels;
+  GLint          width, height;
+  int            bytesPerPixel;
+  long           rowStride;
+  bool           topDown;
+
+  MappedBMP(const MappedBMP&);
+  MappedBMP& operator=(const MappedBMP&);
+};
+
+MappedBMP::MappedBMP()
+  : pPixels(NULL), width(0), height(0), bytesPerPixel(0), rowStride(0), topDown(false)
+{
+}
+
+bool MappedBMP::Fail(const char *szFileName, const char *szReason)
+{
+  fprintf(stderr, "%s: %s\n", szFileName, szReason);
+  Close();
+  return false;
+}
+
+bool MappedBMP::Open(const char *szFileName)
+{
+  Close();
+
+  if (!file.Open(szFileName))
+    return Fail(szFileName, "can't open");
+  const GLubyte *pFile = file.GetData();
+  size_t fileSize = file.GetSize();
+
+  /* File header, then at least a BITMAPINFOHEADER */
+  if (fileSize < (size_t)(BMP_FILE_HEADER_SIZE + BMP_MIN_INFO_SIZE) || pFile[0] != 'B' || pFile[1] != 'M')
+    return Fail(szFileName, "not a BMP file");
+
+  const GLubyte *pInfo = pFile + BMP_FILE_HEADER_SIZE;
+  unsigned long pixelOffset = ReadBMPLong(pFile + 10);
+  unsigned long infoSize = ReadBMPLong(pInfo);
+  GLint fileWidth = (GLint)ReadBMPLong(pInfo + 4);
+  GLint fileHeight = (GLint)ReadBMPLong(pInfo + 8);   /* negative for top-down rows */
+  unsigned int planes = ReadBMPShort(pInfo + 12);
+  unsigned int bits = ReadBMPShort(pInfo + 14);
+  unsigned long compression = ReadBMPLong(pInfo + 16);
+
+  if (infoSize < (unsigned long)BMP_MIN_INFO_SIZE || planes != 1 || fileWidth <= 0 || fileHeight == 0)
+    return Fail(szFileName, "bad BMP header");
+  if (bits != 24 && bits != 32)
+    return Fail(szFileName, "only 24 and 32 bit BMPs are supported");
+
+  if (compression == BMP_COMPRESSION_BITFIELDS && bits == 32)
+  {
+    /* The masks follow a 40 byte header, or sit inside a larger one */
+    const GLubyte *pMasks = pInfo + BMP_MIN_INFO_SIZE;
+    if ((size_t)(pMasks - pFile) + BMP_BITFIELDS_MASKS_SIZE > fileSize ||
+        ReadBMPLong(pMasks) != 0x00FF0000UL || ReadBMPLong(pMasks + 4) != 0x0000FF00UL || ReadBMPLong(pMasks + 8) != 0x000000FFUL)
+      return Fail(szFileName, "unsupported BMP bit fields");
+  }
+  else if (compression != BMP_COMPRESSION_RGB)
+    return Fail(szFileName, "compressed BMPs are not supported");
+
+  width = fileWidth;
+  topDown = (fileHeight < 0);
+  height = topDown ? -fileHeight : fileHeight;
+  bytesPerPixel = bits / 8;
+  rowStride = ((long)width * bytesPerPixel + 3) & ~3L;
+
+  if (pixelOffset > fileSize || (size_t)rowStride * height > fileSize - pixelOffset)
+    return Fail(szFileName, "BMP file is truncated");
+
+  pPixels = pFile + pixelOffset;
+  return true;
+}
+
+void MappedBMP::Close()
+{
+  file.Close();
+  pPixels = NULL;
+  width = height = 0;
+}
+
+/* Rows padded to 4 bytes are exactly what an unpack alignment of 4 expects. A
+   top-down file is sent a row at a time, bottom row first, to flip it. */
+void MappedBMP::TexImage2D(GLenum target) const
+{
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  if (!topDown)
+    glTexImage2D(target, 0, GL_RGB, width, height, 0, GetFormat(), GL_UNSIGNED_BYTE, pPixels);
+  else
+  {
+    glTexImage2D(target, 0, GL_RGB, width, height, 0, GetFormat(), GL_UNSIGNED_BYTE, NULL);
+    for (int y = 0; y < height; y++)
+      glTexSubImage2D(target, 0, 0, y, width, 1, GetFormat(), GL_UNSIGNED_BYTE, GetRow(y));
+  }
+}
+
+#endif
@@ -0,0 +1,111 @@
+//
+//  MappedFile.h
+//  Firewheel
+//
+//  A read-only memory mapping of a whole file, for the image loaders to read
+//  their headers and pixels in place.
+//
+
+#ifndef Firewheel_MappedFile_h
+#define Firewheel_MappedFile_h
+
+#include <cstddef>
+
+#if defined(__WIN32__) || defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+/* Open() fails quietly; the loaders say what they were trying to read. */
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile() { Close(); }
+
+  bool Open(const char *szFileName);
+  void Close();
+
+  const unsigned char* GetData() const { return pData; }
+  size_t GetSize() const               { return size; }
+
+private:
+  const unsigned char *pData;
+  size_t               size;
+
+#if defined(__WIN32__) || defined(_WIN32)
+  HANDLE hFile, hMapping;
+#endif
+
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+MappedFile::MappedFile()
+  : pData(NULL), size(0)
+{
+#if defined(__WIN32__) || defined(_WIN32)
+  hFile = INVALID_HANDLE_VALUE;
+  hMapping = NULL;
+#endif
+}
+
+bool MappedFile::Open(const char *szFileName)
+{
+  Close();
+
+#if defined(__WIN32__) || defined(_WIN32)
+  hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return false;
+  size = (size_t)GetFileSize(hFile, NULL);
+  hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (hMapping != NULL)
+    pData = (const unsigned char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+  int fd = open(szFileName, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0)
+  {
+    size = (size_t)info.st_size;
+    void *pMapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pMapping != MAP_FAILED)
+      pData = (const unsigned char*)pMapping;
+  }
+  close(fd);  /* the mapping keeps the file */
+#endif
+
+  if (pData == NULL)
+  {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close()
+{
+#if defined(__WIN32__) || defined(_WIN32)
+  if (pData != NULL)
+    UnmapViewOfFile(pData);
+  if (hMapping != NULL)
+    CloseHandle(hMapping);
+  if (hFile != INVALID_HANDLE_VALUE)
+    CloseHandle(hFile);
+  hMapping = NULL;
+  hFile = INVALID_HANDLE_VALUE;
+#else
+  if (pData != NULL)
+    munmap((void*)pData, size);
+#endif
+  pData = NULL;
+  size = 0;
+}
+
+#endif
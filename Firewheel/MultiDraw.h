@@ -0,0 +1,398 @@
+//
+//  MultiDraw.h
+//  Firewheel
+//
+//  Packs the rides' triangle meshes into shared buffers so that a run of draws
+//  sharing a texture goes to the GPU as a single multi-draw call, with each
+//  draw's matrices, light and color fetched from a per-frame buffer. Draws
+//  whose textures are layers of a TextureArray don't split runs at all.
+//
+
+#ifndef Firewheel_MultiDraw_h
+#define Firewheel_MultiDraw_h
+
+#include <GLTools.h>
+#include <GLBatchBase.h>
+#include <GLTriangleBatch.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdio>
+
+#include "TextureArray.h"
+
+/* A draw's number goes in the top bits of its base vertex, above the 16 bits
+   of its mesh's GLushort indexes; the vertex shader splits gl_VertexID back up. */
+const int MULTI_DRAW_INDEX_SHIFT = 16;
+const int MAX_MULTI_DRAWS = 0x7FFF;
+
+/* Texels (RGBA32F) per draw record: mvp matrix (4), modelview (4), normal
+   matrix columns (3), light position, color, and the mesh's first vertex
+   with how the draw is textured and its layer. Vertices are two texels:
+   position + s, normal + t. */
+const int MULTI_DRAW_RECORD_TEXELS = 14;
+const int MULTI_DRAW_VERTEX_TEXELS = 2;
+
+/* Texture units for the two buffers and the texture array; unit 0 is left to
+   the draws' own textures */
+const GLint MULTI_DRAW_VERTEX_UNIT = 1;
+const GLint MULTI_DRAW_RECORD_UNIT = 2;
+const GLint MULTI_DRAW_LAYER_UNIT = 3;
+
+/* How a draw is textured, in its record */
+const GLfloat MULTI_DRAW_UNTEXTURED = 0.0f;
+const GLfloat MULTI_DRAW_BOUND_TEXTURE = 1.0f;
+const GLfloat MULTI_DRAW_ARRAY_LAYER = 2.0f;
+
+/* The point light diffuse shader, textured or not, with its inputs pulled from
+   the buffers by vertex and draw number rather than taken from attributes and
+   uniforms. There are no vertex attributes at all. INDEX_SHIFT, RECORD_TEXELS
+   and VERTEX_TEXELS are defined ahead of it from the constants above, and the
+   mesh's texel is the record's last. */
+static const char *szMultiDrawVP = "uniform samplerBuffer vertexPool;"
+                                   "uniform samplerBuffer drawRecords;"
+                                   "out vec4 vFragColor;"
+                                   "out vec2 vTex;"
+                                   "flat out vec2 vTexture;"
+                                   "void main(void) "
+                                   "{"
+                                   " int record = (gl_VertexID >> INDEX_SHIFT) * RECORD_TEXELS;"
+                                   " vec4 vMesh = texelFetch(drawRecords, record + RECORD_TEXELS - 1);"
+                                   " int vertex = (int(vMesh.x) + (gl_VertexID & ((1 << INDEX_SHIFT) - 1))) * VERTEX_TEXELS;"
+                                   " vec4 vPositionS = texelFetch(vertexPool, vertex);"
+                                   " vec4 vNormalT = texelFetch(vertexPool, vertex + 1);"
+                                   " vec4 vVertex = vec4(vPositionS.xyz, 1.0);"
+                                   " mat4 mvpMatrix = mat4(texelFetch(drawRecords, record), texelFetch(drawRecords, record + 1),"
+                                   "                       texelFetch(drawRecords, record + 2), texelFetch(drawRecords, record + 3));"
+                                   " mat4 mvMatrix = mat4(texelFetch(drawRecords, record + 4), texelFetch(drawRecords, record + 5),"
+                                   "                      texelFetch(drawRecords, record + 6), texelFetch(drawRecords, record + 7));"
+                                   " mat3 normalMatrix = mat3(texelFetch(drawRecords, record + 8).xyz, texelFetch(drawRecords, record + 9).xyz,"
+                                   "                          texelFetch(drawRecords, record + 10).xyz);"
+                                   " vec3 vLightPos = texelFetch(drawRecords, record + 11).xyz;"
+                                   " vec4 vColor = texelFetch(drawRecords, record + 12);"
+                                   " vec3 vNorm = normalize(normalMatrix * vNormalT.xyz);"
+                                   " vec4 ecPosition = mvMatrix * vVertex;"
+                                   " vec3 vLightDir = normalize(vLightPos - ecPosition.xyz / ecPosition.w);"
+                                   " vFragColor = vec4(vColor.rgb * max(0.0, dot(vNorm, vLightDir)), vColor.a);"
+                                   " vTex = vec2(vPositionS.w, vNormalT.w);"
+                                   " vTexture = vMesh.yz;"
+                                   " gl_Position = mvpMatrix * vVertex;"
+                                   "}";
+
+static const char *szMultiDrawFP = "#version 140\n"
+                                   "uniform sampler2D textureUnit0;"
+                                   "uniform sampler2DArray textureLayers;"
+                                   "in vec4 vFragColor;"
+                                   "in vec2 vTex;"
+                                   "flat in vec2 vTexture;"
+                                   "out vec4 vOutColor;"
+                                   "void main(void) "
+                                   "{"
+                                   " if (vTexture.x > 1.5)"
+                                   "  vOutColor = vFragColor * texture(textureLayers, vec3(vTex, vTexture.y));"
+                                   " else if (vTexture.x > 0.5)"
+                                   "  vOutColor = vFragColor * texture(textureUnit0, vTex);"
+                                   " else"
+                                   "  vOutColor = vFragColor;"
+                                   "}";
+
+/* Typical pass, with the draws already in submission order:
+     pool.Begin();
+     for each draw: pooled = pool.Add(...)   (false: draw it the usual way)
+     pool.Upload();
+     for each run of pooled draws whose NeedsBinding() textures agree:
+       bind that texture, if any, then pool.Draw(first, count)
+
+   Meshes are taken into the pool the first time they are drawn, read back
+   from the batch's buffers; only GLTriangleBatch meshes can be pooled. Both
+   buffers are read as buffer textures, so a mesh that would take the vertex
+   pool, or a draw that would take the records, past GL_MAX_TEXTURE_BUFFER_SIZE
+   texels isn't pooled either. Needs
+   base vertex draws and texture buffers (OpenGL 3.2); without them the pool
+   stays disabled and everything is drawn the usual way. */
+class MultiDrawPool
+{
+public:
+  MultiDrawPool();
+
+  void SetupRenderingContext();
+  void ShutdownRenderingContext();
+
+  void SetEnabled(bool enable) { enabled = enable; }
+  bool IsEnabled() const       { return enabled && supported; }
+  bool IsSupported() const     { return supported; }
+
+  /* Optional; its textures are sampled from the array rather than bound */
+  void SetTextureArray(const TextureArray *array) { pTextureArray = array; }
+  bool NeedsBinding(GLuint texture) const;
+
+  /* texture is 0 for an untextured draw */
+  void Begin();
+  bool Add(GLBatchBase *pBatch, const M3DMatrix44f mModelView, const M3DMatrix44f mProjection,
+           const M3DVector4f vLightEyePos, const M3DVector4f vColor, GLuint texture);
+  void Upload();
+  void Draw(int first, int count);
+
+  int GetMeshCount() const { return (int)meshes.size(); }
+
+private:
+  struct PooledMesh
+  {
+    GLint   firstVertex;
+    GLsizei indexCount;
+    GLsizei firstIndex;
+  };
+
+  int FindMesh(GLBatchBase *pBatch);
+
+  bool   supported;
+  bool   enabled;
+  GLuint program;
+  GLuint vertexArray;
+  GLuint vertexBuffer, indexBuffer, recordBuffer;
+  GLuint vertexTexture, recordTexture;
+  GLint  maxBufferTexels;  /* of either buffer texture */
+  int    maxDraws;         /* per pass, within the draw number's bits and the records' texels */
+  const TextureArray *pTextureArray;
+
+  /* Batch -> index into meshes, or -1 for a batch that can't be pooled */
+  std::map<GLBatchBase*, int> meshIndex;
+  std::vector<PooledMesh>     meshes;
+  std::vector<GLfloat>        vertexData;
+  std::vector<GLushort>       indexData;
+  bool                        meshesChanged;
+
+  /* This pass's draws */
+  std::vector<GLfloat>        records;
+  std::vector<GLsizei>        counts;
+  std::vector<const GLvoid*>  offsets;
+  std::vector<GLint>          baseVertices;
+};
+
+MultiDrawPool::MultiDrawPool()
+  : supported(false), enabled(true), program(0), vertexArray(0),
+    vertexBuffer(0), indexBuffer(0), recordBuffer(0), vertexTexture(0), recordTexture(0),
+    maxBufferTexels(0), maxDraws(0), pTextureArray(NULL), meshesChanged(false)
+{
+}
+
+void MultiDrawPool::SetupRenderingContext()
+{
+  supported = (GLEW_VERSION_3_2 || (GLEW_ARB_draw_elements_base_vertex && GLEW_ARB_texture_buffer_object));
+  if (!supported)
+    return;
+
+  char szDefines[128];
+  sprintf(szDefines, "#version 140\n#define INDEX_SHIFT %d\n#define RECORD_TEXELS %d\n#define VERTEX_TEXELS %d\n",
+          MULTI_DRAW_INDEX_SHIFT, MULTI_DRAW_RECORD_TEXELS, MULTI_DRAW_VERTEX_TEXELS);
+  std::string vertexShader = std::string(szDefines) + szMultiDrawVP;
+
+  program = gltLoadShaderPairSrcWithAttributes(vertexShader.c_str(), szMultiDrawFP, 0);
+  if (program == 0)
+  {
+    fprintf(stderr, "Multi-draw shader failed to build; drawing one part at a time\n");
+    supported = false;
+    return;
+  }
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "textureUnit0"), 0);
+  glUniform1i(glGetUniformLocation(program, "vertexPool"), MULTI_DRAW_VERTEX_UNIT);
+  glUniform1i(glGetUniformLocation(program, "drawRecords"), MULTI_DRAW_RECORD_UNIT);
+  glUniform1i(glGetUniformLocation(program, "textureLayers"), MULTI_DRAW_LAYER_UNIT);
+
+  /* At least 65536 texels; the records take MULTI_DRAW_RECORD_TEXELS per draw */
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxBufferTexels);
+  maxDraws = maxBufferTexels / MULTI_DRAW_RECORD_TEXELS;
+  if (maxDraws > MAX_MULTI_DRAWS)
+    maxDraws = MAX_MULTI_DRAWS;
+
+  /* No attributes, just the pooled indexes */
+  glGenBuffers(1, &vertexBuffer);
+  glGenBuffers(1, &indexBuffer);
+  glGenBuffers(1, &recordBuffer);
+  glGenVertexArrays(1, &vertexArray);
+  glBindVertexArray(vertexArray);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+  glBindVertexArray(0);
+
+  /* A generated name isn't a buffer until it's first bound, and the buffer
+     textures need real ones */
+  glBindBuffer(GL_TEXTURE_BUFFER, vertexBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, recordBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  glGenTextures(1, &vertexTexture);
+  glBindTexture(GL_TEXTURE_BUFFER, vertexTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vertexBuffer);
+  glGenTextures(1, &recordTexture);
+  glBindTexture(GL_TEXTURE_BUFFER, recordTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, recordBuffer);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void MultiDrawPool::ShutdownRenderingContext()
+{
+  if (!supported)
+    return;
+
+  glDeleteTextures(1, &vertexTexture);
+  glDeleteTextures(1, &recordTexture);
+  glDeleteVertexArrays(1, &vertexArray);
+  glDeleteBuffers(1, &vertexBuffer);
+  glDeleteBuffers(1, &indexBuffer);
+  glDeleteBuffers(1, &recordBuffer);
+  glDeleteProgram(program);
+  program = 0;
+
+  meshIndex.clear();
+  meshes.clear();
+  vertexData.clear();
+  indexData.clear();
+}
+
+/* The batch's place in the pool, reading it into the pool the first time it's seen. */
+int MultiDrawPool::FindMesh(GLBatchBase *pBatch)
+{
+  std::map<GLBatchBase*, int>::iterator found = meshIndex.find(pBatch);
+  if (found != meshIndex.end())
+    return found->second;
+
+  GLTriangleBatch *pTriangles = dynamic_cast<GLTriangleBatch*>(pBatch);
+  if (pTriangles == NULL || pTriangles->GetIndexCount() == 0)
+  {
+    meshIndex[pBatch] = -1;
+    return -1;
+  }
+
+  GLuint i, nVerts = pTriangles->GetVertexCount(), nIndexes = pTriangles->GetIndexCount();
+  size_t pooledTexels = vertexData.size() / 4;
+  if (pooledTexels + (size_t)nVerts * MULTI_DRAW_VERTEX_TEXELS > (size_t)maxBufferTexels)
+  {
+    meshIndex[pBatch] = -1;
+    return -1;
+  }
+
+  std::vector<GLfloat> verts(3 * nVerts), norms(3 * nVerts), texCoords(2 * nVerts);
+  std::vector<GLushort> indexes(nIndexes);
+  pTriangles->CopyMesh((M3DVector3f*)&verts[0], (M3DVector3f*)&norms[0], (M3DVector2f*)&texCoords[0], &indexes[0]);
+
+  PooledMesh mesh;
+  mesh.firstVertex = (GLint)(vertexData.size() / (4 * MULTI_DRAW_VERTEX_TEXELS));
+  mesh.indexCount = (GLsizei)nIndexes;
+  mesh.firstIndex = (GLsizei)indexData.size();
+
+  for (i = 0; i < nVerts; i++)
+  {
+    vertexData.insert(vertexData.end(), &verts[3 * i], &verts[3 * i] + 3);
+    vertexData.push_back(texCoords[2 * i]);
+    vertexData.insert(vertexData.end(), &norms[3 * i], &norms[3 * i] + 3);
+    vertexData.push_back(texCoords[2 * i + 1]);
+  }
+  indexData.insert(indexData.end(), indexes.begin(), indexes.end());
+
+  meshes.push_back(mesh);
+  meshIndex[pBatch] = (int)meshes.size() - 1;
+  meshesChanged = true;
+  return (int)meshes.size() - 1;
+}
+
+bool MultiDrawPool::NeedsBinding(GLuint texture) const
+{
+  return texture != 0 && (pTextureArray == NULL || pTextureArray->GetLayer(texture) < 0);
+}
+
+void MultiDrawPool::Begin()
+{
+  records.clear();
+  counts.clear();
+  offsets.clear();
+  baseVertices.clear();
+}
+
+bool MultiDrawPool::Add(GLBatchBase *pBatch, const M3DMatrix44f mModelView, const M3DMatrix44f mProjection,
+                        const M3DVector4f vLightEyePos, const M3DVector4f vColor, GLuint texture)
+{
+  if ((int)counts.size() >= maxDraws)
+    return false;
+  int m = FindMesh(pBatch);
+  if (m < 0)
+    return false;
+  const PooledMesh &mesh = meshes[m];
+
+  /* The same matrices the stock lighting shaders are given */
+  M3DMatrix44f mMVP;
+  M3DMatrix33f mNormal;
+  m3dMatrixMultiply44(mMVP, mProjection, mModelView);
+  m3dExtractRotationMatrix33(mNormal, mModelView);
+  for (int j = 0; j < 3; j++)
+    m3dNormalizeVector3(&mNormal[3 * j]);
+
+  records.insert(records.end(), mMVP, mMVP + 16);
+  records.insert(records.end(), mModelView, mModelView + 16);
+  for (int j = 0; j < 3; j++)
+  {
+    records.insert(records.end(), &mNormal[3 * j], &mNormal[3 * j] + 3);
+    records.push_back(0.0f);
+  }
+  records.insert(records.end(), vLightEyePos, vLightEyePos + 4);
+  records.insert(records.end(), vColor, vColor + 4);
+  int layer = (texture != 0 && pTextureArray != NULL) ? pTextureArray->GetLayer(texture) : -1;
+  records.push_back((GLfloat)mesh.firstVertex);
+  if (layer >= 0)
+    records.push_back(MULTI_DRAW_ARRAY_LAYER);
+  else
+    records.push_back((texture != 0) ? MULTI_DRAW_BOUND_TEXTURE : MULTI_DRAW_UNTEXTURED);
+  records.push_back((layer >= 0) ? (GLfloat)layer : 0.0f);
+  records.push_back(0.0f);
+
+  counts.push_back(mesh.indexCount);
+  offsets.push_back((const GLvoid*)(sizeof(GLushort) * mesh.firstIndex));
+  baseVertices.push_back((GLint)(baseVertices.size() << MULTI_DRAW_INDEX_SHIFT));
+  return true;
+}
+
+/* New meshes, if any, and this pass's draw records; orphans last pass's records. */
+void MultiDrawPool::Upload()
+{
+  if (meshesChanged)
+  {
+    glBindBuffer(GL_TEXTURE_BUFFER, vertexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * vertexData.size(), &vertexData[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexData.size(), &indexData[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    meshesChanged = false;
+  }
+
+  if (records.empty())
+    return;
+  glBindBuffer(GL_TEXTURE_BUFFER, recordBuffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * records.size(), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(GLfloat) * records.size(), &records[0]);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+/* Draws [first, first + count) of this pass's draws, with whatever texture is bound to unit 0
+   for the ones that need binding. */
+void MultiDrawPool::Draw(int first, int count)
+{
+  glUseProgram(program);
+
+  glActiveTexture(GL_TEXTURE0 + MULTI_DRAW_VERTEX_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, vertexTexture);
+  glActiveTexture(GL_TEXTURE0 + MULTI_DRAW_RECORD_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, recordTexture);
+  if (pTextureArray != NULL)
+  {
+    glActiveTexture(GL_TEXTURE0 + MULTI_DRAW_LAYER_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, pTextureArray->GetName());
+  }
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindVertexArray(vertexArray);
+  glMultiDrawElementsBaseVertex(GL_TRIANGLES, &counts[first], GL_UNSIGNED_SHORT,
+                                (GLvoid**)&offsets[first], count, &baseVertices[first]);
+  glBindVertexArray(0);
+}
+
+#endif
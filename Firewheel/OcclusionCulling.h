@@ -0,0 +1,187 @@
+//
+//  OcclusionCulling.h
+//  Firewheel
+//
+//  Skips rides that were hidden behind other rides, using hardware occlusion
+//  queries on bounding box proxies.
+//
+
+#ifndef Firewheel_OcclusionCulling_h
+#define Firewheel_OcclusionCulling_h
+
+#include <GLTools.h>
+#include <GLShaderManager.h>
+#include <GLBatch.h>
+#include <GLMatrixStack.h>
+#include <GLGeometryTransform.h>
+
+#include "Culling.h"
+
+const int MAX_OCCLUSION_OBJECTS = 16;
+
+const GLfloat OCCLUSION_PROXY_COLOR[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+/* How close the camera may come to a box before it counts as inside; must be
+   more than the near plane distance so the box's faces are never clipped. */
+const GLfloat OCCLUSION_CAMERA_MARGIN = 0.5f;
+
+/* Each frame, after the scene has been drawn, a query is issued for every
+   object that was in the frustum: its bounding box is drawn with color and
+   depth writes off, and the query counts the samples that passed the depth
+   test. Early next frame the results are read back; an object whose box had no
+   samples pass is hidden behind what was drawn and is skipped.
+
+   Reading last frame's results keeps the CPU from waiting on the GPU, at the
+   price of one frame of lag. That lag is always on the safe side: a skipped
+   object is still queried, so it reappears one frame after it comes into
+   view. Whenever there is any doubt the object is drawn:
+     - its query from last frame hasn't finished yet
+     - it had no query last frame (it was outside the frustum)
+     - the camera is inside its box, where the box's front faces are clipped
+       away and the query would come back empty
+
+   The objects are picked out of the caller's per-object arrays by id, so
+   only the ones that are actually drawn get a proxy and a query.
+
+   Counters cover the last frame: queries issued, and draws saved. */
+class OcclusionCuller
+{
+public:
+  OcclusionCuller();
+
+  /* objectIds[] index visibility[] and bounds[] below */
+  void SetupRenderingContext(const int objectIds[], int count);
+  void ShutdownRenderingContext();
+
+  /* Read last frame's results and mark objects found hidden as outside in
+     visibility[] (from the frustum test, indexed by object id). */
+  void CollectResults(GLT_FRUSTUM_TEST visibility[]);
+
+  /* Query the boxes around bounds[] (world space) for the objects that were in
+     the frustum. Call after the scene is drawn, with the camera on modelView. */
+  void IssueQueries(const BoundingSphere bounds[], const M3DVector3f vCameraPosition, GLMatrixStack &modelViewMatrix,
+                    GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline);
+
+  void SetEnabled(bool enable) { enabled = enable; }
+  bool IsEnabled() const       { return enabled; }
+
+  int GetQueryCount() const     { return nbrQueries; }
+  int GetDrawsSavedCount() const { return nbrSaved; }
+
+private:
+  int     objectIds[MAX_OCCLUSION_OBJECTS];
+  GLuint  queries[MAX_OCCLUSION_OBJECTS];
+  bool    pending[MAX_OCCLUSION_OBJECTS];
+  bool    inFrustum[MAX_OCCLUSION_OBJECTS];
+  int     nbrObjects;
+  GLBatch proxyBatch;
+  bool    enabled;
+
+  int nbrQueries;
+  int nbrSaved;
+};
+
+OcclusionCuller::OcclusionCuller()
+  : nbrObjects(0), enabled(true), nbrQueries(0), nbrSaved(0)
+{
+  for (int i = 0; i < MAX_OCCLUSION_OBJECTS; i++)
+  {
+    objectIds[i] = 0;
+    queries[i] = 0;
+    pending[i] = false;
+    inFrustum[i] = false;
+  }
+}
+
+void OcclusionCuller::SetupRenderingContext(const int ids[], int count)
+{
+  nbrObjects = (count < MAX_OCCLUSION_OBJECTS) ? count : MAX_OCCLUSION_OBJECTS;
+  for (int i = 0; i < nbrObjects; i++)
+    objectIds[i] = ids[i];
+  glGenQueries(nbrObjects, queries);
+
+  /* Unit cube, scaled to each object's box when queried */
+  gltMakeCube(proxyBatch, 1.0f);
+}
+
+void OcclusionCuller::ShutdownRenderingContext()
+{
+  glDeleteQueries(nbrObjects, queries);
+  for (int i = 0; i < nbrObjects; i++)
+    pending[i] = false;
+}
+
+void OcclusionCuller::CollectResults(GLT_FRUSTUM_TEST visibility[])
+{
+  nbrSaved = 0;
+
+  for (int i = 0; i < nbrObjects; i++)
+  {
+    GLT_FRUSTUM_TEST &objectVisibility = visibility[objectIds[i]];
+    inFrustum[i] = (objectVisibility != GLT_FRUSTUM_OUTSIDE);
+
+    if (!pending[i])
+      continue;
+
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE)
+      continue;  /* Still in flight; poll again next frame */
+
+    GLuint samples = 0;
+    glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samples);
+    pending[i] = false;
+
+    if (enabled && samples == 0 && inFrustum[i])
+    {
+      objectVisibility = GLT_FRUSTUM_OUTSIDE;
+      nbrSaved++;
+    }
+  }
+}
+
+void OcclusionCuller::IssueQueries(const BoundingSphere bounds[], const M3DVector3f vCameraPosition, GLMatrixStack &modelViewMatrix,
+                                   GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline)
+{
+  nbrQueries = 0;
+  if (!enabled)
+    return;
+
+  /* Test against the depth buffer without changing anything */
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+
+  for (int i = 0; i < nbrObjects; i++)
+  {
+    /* An object with a query still in flight keeps it; one outside the frustum needs none. */
+    if (pending[i] || !inFrustum[i])
+      continue;
+
+    /* Camera inside the box (allowing for the near plane): no query, so it's drawn next frame */
+    const BoundingSphere &s = bounds[objectIds[i]];
+    bool inside = true;
+    for (int j = 0; j < 3; j++)
+      if (fabsf(vCameraPosition[j] - s.center[j]) > s.radius + OCCLUSION_CAMERA_MARGIN)
+        inside = false;
+    if (inside)
+      continue;
+
+    modelViewMatrix.PushMatrix();
+      modelViewMatrix.Translate(s.center[0], s.center[1], s.center[2]);
+      modelViewMatrix.Scale(s.radius, s.radius, s.radius);
+      shaderManager.UseStockShader(GLT_SHADER_FLAT, transformPipeline.GetModelViewProjectionMatrix(), OCCLUSION_PROXY_COLOR);
+
+      glBeginQuery(GL_SAMPLES_PASSED, queries[i]);
+      proxyBatch.Draw();
+      glEndQuery(GL_SAMPLES_PASSED);
+    modelViewMatrix.PopMatrix();
+
+    pending[i] = true;
+    nbrQueries++;
+  }
+
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+#endif
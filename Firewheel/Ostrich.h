@@ -20,10 +20,17 @@
 #include <cmath>
 #include <ctime>
 
+#include "Culling.h"
+#include "DrawList.h"
+
 const GLfloat OSTRICH_BODY_COLOR[] = { .375, 0.2, 0.067, 1.0 };
 const GLfloat OSTRICH_SKIN_COLOR[] = { .97, .8, .79, 1.0 };
 const GLfloat OSTRICH_BEAK_COLOR[] = { 0.8, 0.8, 0.0, 1.0 };
 
+/* Loose fit from the feet up to the head, from the offsets used in Draw */
+const GLfloat OSTRICH_BOUNDING_CENTER[] = { 0.05f, -0.15f, 0.0f };
+const GLfloat OSTRICH_BOUNDING_RADIUS = 0.35f;
+
 class Ostrich
 {
 public:
@@ -31,7 +38,8 @@ public:
 
   void SetupRenderingContext();
   void Update();
-  void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos);
+  void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos);
+  const BoundingSphere& GetBoundingSphere() const { return bounds; }
 
 private:
   GLTriangleBatch head;
@@ -40,6 +48,8 @@ private:
   GLTriangleBatch body;
   GLTriangleBatch tailfeather[3];
   GLTriangleBatch legs[2];
+
+  BoundingSphere bounds;
 };
 
 /* ------------------- */
@@ -47,7 +57,7 @@ private:
 
 Ostrich::Ostrich()
 {
-  
+  SetBoundingSphere(bounds, OSTRICH_BOUNDING_CENTER[0], OSTRICH_BOUNDING_CENTER[1], OSTRICH_BOUNDING_CENTER[2], OSTRICH_BOUNDING_RADIUS);
 }
 
 /* -------------------------------------------------- */
@@ -78,7 +88,7 @@ void Ostrich::Update()
 /* ----------------------------------------- */
 /* Render the components of the Ostrich body */
 
-void Ostrich::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos)
+void Ostrich::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos)
 {
 	// Get the light position in eye space
 	M3DVector4f	vLightTransformed;
@@ -92,9 +102,7 @@ void Ostrich::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
   
     /* body */
     modelViewMatrix.PushMatrix();
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_BODY_COLOR, 0);
-      body.Draw();
+      drawList.AddLit(body, modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_BODY_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* Tailfeather */
@@ -104,9 +112,7 @@ void Ostrich::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Translate(-0.05, 0.0, 0.09);
         modelViewMatrix.Rotate(-12, 0.0, 1.0, 0.0);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_BODY_COLOR, 0);
-        tailfeather[0].Draw();
+        drawList.AddLit(tailfeather[0], modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_BODY_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
 
@@ -117,9 +123,7 @@ void Ostrich::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Translate(0.0, 0.0, 0.09);
         modelViewMatrix.Rotate(-12, 0.0, 1.0, 0.0);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_BODY_COLOR, 0);
-        tailfeather[0].Draw();
+        drawList.AddLit(tailfeather[0], modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_BODY_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
 
@@ -131,9 +135,7 @@ void Ostrich::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Translate(-0.05, 0.0, 0.09);
         modelViewMatrix.Rotate(-12, 0.0, 1.0, 0.0);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_BODY_COLOR, 0);
-        tailfeather[0].Draw();
+        drawList.AddLit(tailfeather[0], modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_BODY_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
 
@@ -142,42 +144,32 @@ void Ostrich::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(90, 0.0, 1.0, 0.0);
       modelViewMatrix.Rotate(-65, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR, 0);
-      kneck.Draw();
+      drawList.AddLit(kneck, modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* head */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.14, 0.3, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                 transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR, 0);
-      head.Draw();
+      drawList.AddLit(head, modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* beak */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.175, 0.3, 0.0);
       modelViewMatrix.Rotate(90, 0.0, 1.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_BEAK_COLOR, 0);
-      beak.Draw();
+      drawList.AddLit(beak, modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_BEAK_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* legs 1 */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(105, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR, 0);
-      legs[0].Draw();
+      drawList.AddLit(legs[0], modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR);
     modelViewMatrix.PopMatrix();
     
     /* legs 2 */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(75, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR, 0);
-      legs[1].Draw();
+      drawList.AddLit(legs[1], modelViewMatrix.GetMatrix(), vLightTransformed, OSTRICH_SKIN_COLOR);
     modelViewMatrix.PopMatrix();
 
   modelViewMatrix.PopMatrix();
@@ -0,0 +1,245 @@
+//
+//  ReflectionTexture.h
+//  Firewheel
+//
+//  Offscreen target for the floor's reflection: the mirrored scene is drawn
+//  into a texture at a fraction of the window's resolution, and the ground
+//  shader blends it in, instead of redrawing the mirrored scene at full size.
+//
+
+#ifndef Firewheel_ReflectionTexture_h
+#define Firewheel_ReflectionTexture_h
+
+#include <GLTools.h>
+
+/* Resolution modes, as divisors of the window size; 0 draws the reflection
+   straight into the window as before. */
+const int NBR_REFLECTION_MODES = 3;
+const int REFLECTION_DIVISORS[NBR_REFLECTION_MODES] = { 0, 2, 4 };
+
+/* With the camera still, the texture is only redrawn every this many frames;
+   the rides still move, but the lag hardly shows in a half-transparent floor. */
+const int REFLECTION_STILL_INTERVAL = 2;
+
+/* Ground texture modulated by the color, over the reflection, with the color's
+   alpha for the blend. The reflection covers the whole window, so the fragment's
+   window position, scaled to [0, 1], is its texture coordinate. */
+static const char *szReflectingGroundVP = "uniform mat4 mvpMatrix;"
+                                          "attribute vec4 vVertex;"
+                                          "attribute vec2 vTexCoord0;"
+                                          "varying vec2 vTex;"
+                                          "void main(void) "
+                                          "{"
+                                          " vTex = vTexCoord0;"
+                                          " gl_Position = mvpMatrix * vVertex;"
+                                          "}";
+
+static const char *szReflectingGroundFP =
+#ifdef OPENGL_ES
+                                          "precision mediump float;"
+#endif
+                                          "uniform vec4 vColor;"
+                                          "uniform vec2 vInverseWindowSize;"
+                                          "uniform sampler2D groundUnit;"
+                                          "uniform sampler2D reflectionUnit;"
+                                          "varying vec2 vTex;"
+                                          "void main(void) "
+                                          "{"
+                                          " vec4 ground = vColor * texture2D(groundUnit, vTex);"
+                                          " vec3 reflection = texture2D(reflectionUnit, gl_FragCoord.xy * vInverseWindowSize).rgb;"
+                                          " gl_FragColor = vec4(mix(reflection, ground.rgb, ground.a), 1.0);"
+                                          "}";
+
+/* Typical frame, with the camera matrix for the frame:
+     if (reflection.NeedsUpdate(mCamera))
+     {
+       reflection.BeginRender();
+       ... draw the mirrored scene ...
+       reflection.EndRender();
+     }
+     ... bind the ground texture, then reflection.UseGroundShader(...) and draw the ground ...
+
+   When the reflection isn't drawn at all for a frame, Invalidate() so the
+   next frame that needs it doesn't reuse an old picture. */
+class ReflectionTexture
+{
+public:
+  ReflectionTexture();
+
+  void SetupRenderingContext();
+  void ShutdownRenderingContext();
+
+  /* Window size changes, and 0 (off), 2 (half) or 4 (quarter resolution) */
+  void Resize(int nWidth, int nHeight);
+  void SetResolutionDivisor(int divisor);
+  /* What EndRender() goes back to; 0, the window, unless drawing offscreen */
+  void SetWindowFramebuffer(GLuint newWindowFramebuffer) { windowFramebuffer = newWindowFramebuffer; }
+  int  GetResolutionDivisor() const { return divisor; }
+  bool IsEnabled() const            { return divisor > 0; }
+
+  bool NeedsUpdate(const M3DMatrix44f mCamera);
+  void Invalidate() { valid = false; }
+
+  void BeginRender();
+  void EndRender();
+
+  void UseGroundShader(const M3DMatrix44f mvpMatrix, const GLfloat vColor[4], GLint groundUnit);
+
+  int GetUpdateCount() const { return nbrUpdates; }
+
+private:
+  void AllocateTargets();
+  void FreeTargets();
+
+  GLuint framebuffer;
+  GLuint colorTexture;
+  GLuint depthBuffer;
+  GLuint groundShader;
+  GLuint windowFramebuffer;
+
+  int  windowWidth, windowHeight;
+  int  divisor;
+  int  width, height;
+
+  bool         valid;
+  int          framesSinceUpdate;
+  M3DMatrix44f mLastCamera;
+  int          nbrUpdates;
+};
+
+ReflectionTexture::ReflectionTexture()
+  : framebuffer(0), colorTexture(0), depthBuffer(0), groundShader(0), windowFramebuffer(0),
+    windowWidth(1), windowHeight(1), divisor(0), width(0), height(0),
+    valid(false), framesSinceUpdate(0), nbrUpdates(0)
+{
+  m3dLoadIdentity44(mLastCamera);
+}
+
+void ReflectionTexture::SetupRenderingContext()
+{
+  groundShader = gltLoadShaderPairSrcWithAttributes(szReflectingGroundVP, szReflectingGroundFP, 2,
+                                                    GLT_ATTRIBUTE_VERTEX, "vVertex",
+                                                    GLT_ATTRIBUTE_TEXTURE0, "vTexCoord0");
+  AllocateTargets();
+}
+
+void ReflectionTexture::ShutdownRenderingContext()
+{
+  FreeTargets();
+  glDeleteProgram(groundShader);
+  groundShader = 0;
+}
+
+void ReflectionTexture::Resize(int nWidth, int nHeight)
+{
+  windowWidth = (nWidth > 0) ? nWidth : 1;
+  windowHeight = (nHeight > 0) ? nHeight : 1;
+  AllocateTargets();
+}
+
+void ReflectionTexture::SetResolutionDivisor(int newDivisor)
+{
+  divisor = (newDivisor > 0) ? newDivisor : 0;
+  AllocateTargets();
+}
+
+/* Texture and depth buffer at the current fraction of the window; none when off. */
+void ReflectionTexture::AllocateTargets()
+{
+  FreeTargets();
+  valid = false;
+  if (divisor <= 0 || groundShader == 0)
+    return;
+
+  width = (windowWidth + divisor - 1) / divisor;
+  height = (windowHeight + divisor - 1) / divisor;
+
+  glGenTextures(1, &colorTexture);
+  glBindTexture(GL_TEXTURE_2D, colorTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenRenderbuffers(1, &depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+  glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+  GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, windowFramebuffer);
+
+  /* Fall back to drawing straight into the window */
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+  {
+    fprintf(stderr, "Reflection framebuffer incomplete (0x%04x)\n", status);
+    FreeTargets();
+    divisor = 0;
+  }
+}
+
+void ReflectionTexture::FreeTargets()
+{
+  if (framebuffer != 0)
+    glDeleteFramebuffers(1, &framebuffer);
+  if (depthBuffer != 0)
+    glDeleteRenderbuffers(1, &depthBuffer);
+  if (colorTexture != 0)
+    glDeleteTextures(1, &colorTexture);
+  framebuffer = depthBuffer = colorTexture = 0;
+  width = height = 0;
+}
+
+/* Always after the camera moves; otherwise every REFLECTION_STILL_INTERVAL frames. */
+bool ReflectionTexture::NeedsUpdate(const M3DMatrix44f mCamera)
+{
+  bool moved = false;
+  for (int i = 0; i < 16 && !moved; i++)
+    moved = (mCamera[i] != mLastCamera[i]);
+  m3dCopyMatrix44(mLastCamera, mCamera);
+
+  framesSinceUpdate++;
+  if (valid && !moved && framesSinceUpdate < REFLECTION_STILL_INTERVAL)
+    return false;
+
+  framesSinceUpdate = 0;
+  return true;
+}
+
+void ReflectionTexture::BeginRender()
+{
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width, height);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void ReflectionTexture::EndRender()
+{
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, windowFramebuffer);
+  glViewport(0, 0, windowWidth, windowHeight);
+  valid = true;
+  nbrUpdates++;
+}
+
+/* The ground texture must already be bound to groundUnit; the reflection goes on the next unit. */
+void ReflectionTexture::UseGroundShader(const M3DMatrix44f mvpMatrix, const GLfloat vColor[4], GLint groundUnit)
+{
+  glActiveTexture(GL_TEXTURE0 + groundUnit + 1);
+  glBindTexture(GL_TEXTURE_2D, colorTexture);
+  glActiveTexture(GL_TEXTURE0);
+
+  glUseProgram(groundShader);
+  glUniformMatrix4fv(glGetUniformLocation(groundShader, "mvpMatrix"), 1, GL_FALSE, mvpMatrix);
+  glUniform4fv(glGetUniformLocation(groundShader, "vColor"), 1, vColor);
+  glUniform2f(glGetUniformLocation(groundShader, "vInverseWindowSize"), 1.0f / float(windowWidth), 1.0f / float(windowHeight));
+  glUniform1i(glGetUniformLocation(groundShader, "groundUnit"), groundUnit);
+  glUniform1i(glGetUniformLocation(groundShader, "reflectionUnit"), groundUnit + 1);
+}
+
+#endif
@@ -24,6 +24,8 @@
 #include <ctime>
 
 #include "CarTextured.h"
+#include "Culling.h"
+#include "DrawList.h"
 
 /* R_POLES */
 const GLfloat R_POLE_COLOR[] = { 0.67f, 0.67f, 0.67f, 1.0f };
@@ -51,6 +53,10 @@ const GLint FRAME_INNER_SLICES = 30;
 
 const GLint NUMBER_CARS = 3;
 
+/* Where Draw places the ride, relative to its own origin */
+const GLfloat TRACK_CENTER_OFFSET = 3.0f;
+const GLfloat R_POLE_BASE_HEIGHT = -0.7f;
+
 /* DATA FILE */
 const char* COASTER_DATA_FILE = "roller_coaster_data.txt";
 const char* RUNNER_DATA_FILE = "runner_data.txt";
@@ -64,9 +70,13 @@ class Track
 
     void SetupRenderingContext();
     void Update();
-    void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos);
+    void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos);
+    void SetCuller(SceneCuller *sceneCuller);
+    const BoundingSphere& GetBoundingSphere() const { return bounds; }
 
   private:
+    void ComputeBounds();
+
     GLTriangleBatch frame;
     GLTriangleBatch r_poles[NUMBER_R_POLES];
     GLTriangleBatch circuit[NUMBER_RUNNER];
@@ -77,11 +87,51 @@ class Track
     GLfloat runner_verts[NUMBER_RUNNER][3];
 
     Car cars[NUMBER_CARS];
+
+    BoundingSphere bounds;
+    BoundingSphere r_poleBounds[NUMBER_R_POLES];
+    SceneCuller *culler;
 };
 
-Track::Track()
+Track::Track() : culler(NULL)
 {
-  
+  SetBoundingSphere(bounds, 0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+/* Optional culler used to skip support poles that are out of view. */
+void Track::SetCuller(SceneCuller *sceneCuller)
+{
+  culler = sceneCuller;
+}
+
+/* Bounds depend on the pole lengths and runner points read from the data files. */
+void Track::ComputeBounds()
+{
+  M3DVector3f points[2 * NUMBER_R_POLES + NUMBER_RUNNER];
+  int i, nbrPoints = 0;
+
+  for ( i = 0; i < NUMBER_R_POLES; i++ )
+  {
+    GLfloat sinRot, cosRot;
+    m3dSinCosf(m3dDegToRadf(i * 360.0f/NUMBER_R_POLES), sinRot, cosRot);
+
+    /* Same placement as Draw: the pole stands up from the base height on a circle */
+    GLfloat x = TRACK_CENTER_OFFSET + FRAME_OUTER_RADIUS*cosRot;
+    GLfloat z = -FRAME_OUTER_RADIUS*sinRot;
+    GLfloat halfLength = 0.5f * r_poleLength[i];
+
+    SetBoundingSphere(r_poleBounds[i], x, R_POLE_BASE_HEIGHT + halfLength, z, halfLength + R_POLE_BASE_RADIUS);
+
+    m3dLoadVector3(points[nbrPoints++], x, R_POLE_BASE_HEIGHT, z);
+    m3dLoadVector3(points[nbrPoints++], x, R_POLE_BASE_HEIGHT + r_poleLength[i], z);
+  }
+
+  /* The runner line loop is drawn without the center offset */
+  for ( i = 0; i < NUMBER_RUNNER; i++ )
+    m3dCopyVector3(points[nbrPoints++], runner_verts[i]);
+
+  ComputeBoundingSphere(bounds, points, nbrPoints);
+  bounds.radius += FRAME_INNER_RADIUS;
 }
 
 Track::~Track()
@@ -142,6 +192,8 @@ void Track::SetupRenderingContext()
 
   /* bottom eliptical frame */
   gltMakeTorus(frame, FRAME_OUTER_RADIUS, FRAME_INNER_RADIUS, FRAME_OUTER_SLICES, FRAME_INNER_SLICES);
+
+  ComputeBounds();
 }
 
 void Track::Update()
@@ -149,13 +201,17 @@ void Track::Update()
   
 }
 
-void Track::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos)
+void Track::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos)
 {
   int i = 0;
 
+  /* Pole bounds are relative to the track's origin */
+  M3DMatrix44f mTrack;
+  modelViewMatrix.GetMatrix(mTrack);
+
   modelViewMatrix.PushMatrix();
   
-    modelViewMatrix.Translate(3.0, 0.0, 0.0);
+    modelViewMatrix.Translate(TRACK_CENTER_OFFSET, 0.0, 0.0);
 
     /* ---------------------- */
     /* Bottom eliptical frame */
@@ -163,9 +219,7 @@ void Track::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(-90, 1.0f, 0.0f, 0.0f);
       modelViewMatrix.Translate(0.0f, 0.0f, -0.65f);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightEyePos, FRAME_COLOR);
-      frame.Draw();
+      drawList.AddLit(frame, modelViewMatrix.GetMatrix(), vLightEyePos, FRAME_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* -------------------------------------- */
@@ -174,22 +228,25 @@ void Track::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
     modelViewMatrix.PushMatrix();
       for ( i = 0; i < NUMBER_R_POLES; i++ )
       {
+        if (culler != NULL && !culler->IsVisible(r_poleBounds[i], mTrack))
+          continue;
+
         GLfloat currentRotation = i * 360.0f/NUMBER_R_POLES;
+        GLfloat sinRot, cosRot;
+        m3dSinCosf(m3dDegToRadf(currentRotation), sinRot, cosRot);
 
         /* rotate support beam verticle, start in center and spread out at coords x=cos(rot), y=sin(rot) */
         modelViewMatrix.PushMatrix();
           modelViewMatrix.Rotate(-90, 1.0f, 0.0f, 0.0f);
-          modelViewMatrix.Translate(0.0f, 0.0f, -0.7f);
-          modelViewMatrix.Translate(3*cosf(m3dDegToRad(currentRotation)), 3*sinf(m3dDegToRad(currentRotation)), 0.0f);
+          modelViewMatrix.Translate(0.0f, 0.0f, R_POLE_BASE_HEIGHT);
+          modelViewMatrix.Translate(FRAME_OUTER_RADIUS*cosRot, FRAME_OUTER_RADIUS*sinRot, 0.0f);
 
       M3DVector3f vout = { 0.0f, 0.0f, 0.0f };
       M3DVector3f vin  = { 0.0f, 0.0f, 0.0f };
       m3dTransformVector3(vout, vin, modelViewMatrix.GetMatrix());
       
       //printf("%f %f %f\n", vout[0], vout[1], vout[2]);
-          shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                       transformPipeline.GetProjectionMatrix(), vLightEyePos, R_POLE_COLOR);
-          r_poles[i].Draw();
+          drawList.AddLit(r_poles[i], modelViewMatrix.GetMatrix(), vLightEyePos, R_POLE_COLOR);
         modelViewMatrix.PopMatrix();
       }
     modelViewMatrix.PopMatrix();
@@ -203,14 +260,14 @@ void Track::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
       for ( i = 0; i < NUMBER_RUNNER; i++ )
       {
         GLfloat currentRotation = i * 360.0f/NUMBER_RUNNER;
+        GLfloat sinRot, cosRot;
+        m3dSinCosf(m3dDegToRadf(currentRotation), sinRot, cosRot);
 
         /* rotate support beam verticle, start in center and spread out at coords x=cos(rot), y=sin(rot) */\
         modelViewMatrix.PushMatrix();
           modelViewMatrix.Rotate(-90, 1.0f, 0.0f, 0.0f);
           modelViewMatrix.Translate(0.0f, 0.0f, r_poleLength[i]-0.69f);
-          modelViewMatrix.Translate(cosf(m3dDegToRad(currentRotation)), sinf(m3dDegToRad(currentRotation)), 0.0f);
-          shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-                                       transformPipeline.GetProjectionMatrix(), vLightEyePos, R_POLE_COLOR);
+          modelViewMatrix.Translate(cosRot, sinRot, 0.0f);
         //circuit[i].Draw();
         modelViewMatrix.PopMatrix();  
       }
@@ -229,11 +286,9 @@ void Track::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
     modelViewMatrix.GetMatrix(mCamera);
     m3dTransformVector4(vLightTransformed, LIGHT_POSITION, mCamera);
     
-    // Gave up making the shader work :(
-    // shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-    //                              transformPipeline.GetProjectionMatrix(), vLightTransformed, R_POLE_COLOR, 0);
-
-    lineLoop.Draw();
+    /* The loop used to be drawn with whatever shader the last runner left bound;
+       recorded draws carry their own, so give it the track's transform. */
+    drawList.AddLit(lineLoop, modelViewMatrix.GetMatrix(), vLightTransformed, R_POLE_COLOR);
   modelViewMatrix.PopMatrix();
 
   /* ---- */
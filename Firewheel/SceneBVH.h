@@ -0,0 +1,379 @@
+//
+//  SceneBVH.h
+//  Firewheel
+//
+//  Bounding volume hierarchy over the park's objects, for the queries that
+//  have to look at the whole scene: which objects are in view, which object
+//  is under the mouse, and how far away something is for level of detail.
+//
+
+#ifndef Firewheel_SceneBVH_h
+#define Firewheel_SceneBVH_h
+
+#include <GLTools.h>
+#include <GLFrustum.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "Culling.h"
+
+/* Objects per leaf; small leaves keep the per-object tests down. */
+const int BVH_LEAF_SIZE = 4;
+
+/* Deepest possible traversal; a median split never gets near this. */
+const int BVH_MAX_STACK = 64;
+
+/* A node covers objects [first, first + count) of the hierarchy's object order.
+   Leaves have no children (left < 0); children always come after their parent
+   in the node array, so a reverse sweep visits children before parents. */
+struct BVHNode
+{
+  M3DVector3f boxMin;
+  M3DVector3f boxMax;
+  int left, right;
+  int first, count;
+};
+
+/* Objects are world-space bounding spheres identified by the index AddObject
+   returns. Build() once after adding them; when objects move, update them with
+   SetObjectBounds() and call Refit(), which keeps the tree shape and only
+   recomputes the boxes. Rebuild if objects have moved far from where they were
+   at Build() time, since the boxes will then overlap heavily. */
+class SceneBVH
+{
+public:
+  SceneBVH();
+
+  int  AddObject(const BoundingSphere &worldBounds);
+  void SetObjectBounds(int id, const BoundingSphere &worldBounds);
+  const BoundingSphere& GetObjectBounds(int id) const { return objects[id]; }
+  int  GetObjectCount() const { return (int)objects.size(); }
+
+  void Build();
+  void Refit();
+
+  /* Optional culler whose switch the frustum queries follow */
+  void SetCuller(SceneCuller *sceneCuller) { culler = sceneCuller; }
+
+  /* Classify every object against the planes (normals pointing inwards, as
+     from GLFrustum::GetPlanes). Whole subtrees inside or outside the volume are
+     settled without looking at their objects. Any convex volume works, not just
+     a six-sided frustum. With the culler switched off every object is inside.
+     results needs one entry per object; returns the number that are not outside. */
+  int QueryFrustum(const M3DVector4f planes[], GLT_FRUSTUM_TEST results[], int nPlanes = 6) const;
+
+  /* Nearest object hit by the ray, or -1. vDirection must be unit length.
+     The distance along the ray to the hit goes into pDistance if given. */
+  int Pick(const M3DVector3f vOrigin, const M3DVector3f vDirection, float *pDistance = NULL) const;
+
+  /* Distance from vPoint to the object's bounding sphere (0 if inside it), and
+     the level of detail for that distance: 0 nearer than thresholds[0], 1
+     nearer than thresholds[1], and so on, nThresholds when farther than all. */
+  float GetDistance(int id, const M3DVector3f vPoint) const;
+  int SelectLOD(int id, const M3DVector3f vPoint, const float thresholds[], int nThresholds) const;
+
+private:
+  struct CenterLess
+  {
+    const std::vector<BoundingSphere> *pObjects;
+    int axis;
+    bool operator()(int a, int b) const { return (*pObjects)[a].center[axis] < (*pObjects)[b].center[axis]; }
+  };
+
+  int  BuildNode(int first, int count);
+  void FitNode(BVHNode &node) const;
+
+  std::vector<BoundingSphere> objects;
+  std::vector<int>            order;
+  std::vector<BVHNode>        nodes;
+  SceneCuller                *culler;
+};
+
+SceneBVH::SceneBVH() : culler(NULL)
+{
+}
+
+int SceneBVH::AddObject(const BoundingSphere &worldBounds)
+{
+  objects.push_back(worldBounds);
+  return (int)objects.size() - 1;
+}
+
+void SceneBVH::SetObjectBounds(int id, const BoundingSphere &worldBounds)
+{
+  objects[id] = worldBounds;
+}
+
+/* Box around the spheres of the node's objects (leaves), or its children. */
+void SceneBVH::FitNode(BVHNode &node) const
+{
+  int i, j;
+
+  if (node.left >= 0)
+  {
+    const BVHNode &a = nodes[node.left];
+    const BVHNode &b = nodes[node.right];
+    for (j = 0; j < 3; j++)
+    {
+      node.boxMin[j] = (a.boxMin[j] < b.boxMin[j]) ? a.boxMin[j] : b.boxMin[j];
+      node.boxMax[j] = (a.boxMax[j] > b.boxMax[j]) ? a.boxMax[j] : b.boxMax[j];
+    }
+    return;
+  }
+
+  for (i = 0; i < node.count; i++)
+  {
+    const BoundingSphere &s = objects[order[node.first + i]];
+    for (j = 0; j < 3; j++)
+    {
+      float lo = s.center[j] - s.radius;
+      float hi = s.center[j] + s.radius;
+      if (i == 0 || lo < node.boxMin[j]) node.boxMin[j] = lo;
+      if (i == 0 || hi > node.boxMax[j]) node.boxMax[j] = hi;
+    }
+  }
+}
+
+/* Top down: split the objects at the median center along the widest spread of centers. */
+int SceneBVH::BuildNode(int first, int count)
+{
+  int index = (int)nodes.size();
+  BVHNode node;
+  node.left = node.right = -1;
+  node.first = first;
+  node.count = count;
+  nodes.push_back(node);
+
+  if (count > BVH_LEAF_SIZE)
+  {
+    M3DVector3f cMin, cMax;
+    int i, j;
+    m3dCopyVector3(cMin, objects[order[first]].center);
+    m3dCopyVector3(cMax, cMin);
+    for (i = 1; i < count; i++)
+      for (j = 0; j < 3; j++)
+      {
+        float c = objects[order[first + i]].center[j];
+        if (c < cMin[j]) cMin[j] = c;
+        if (c > cMax[j]) cMax[j] = c;
+      }
+
+    CenterLess less;
+    less.pObjects = &objects;
+    less.axis = 0;
+    for (j = 1; j < 3; j++)
+      if (cMax[j] - cMin[j] > cMax[less.axis] - cMin[less.axis])
+        less.axis = j;
+
+    int half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, less);
+
+    /* nodes may reallocate while building the children, so no references across these calls */
+    int left = BuildNode(first, half);
+    int right = BuildNode(first + half, count - half);
+    nodes[index].left = left;
+    nodes[index].right = right;
+  }
+
+  FitNode(nodes[index]);
+  return index;
+}
+
+void SceneBVH::Build()
+{
+  int count = (int)objects.size();
+
+  order.resize(count);
+  for (int i = 0; i < count; i++)
+    order[i] = i;
+
+  nodes.clear();
+  nodes.reserve(count > 0 ? 2 * count : 1);
+  if (count > 0)
+    BuildNode(0, count);
+}
+
+void SceneBVH::Refit()
+{
+  for (int i = (int)nodes.size() - 1; i >= 0; i--)
+    FitNode(nodes[i]);
+}
+
+int SceneBVH::QueryFrustum(const M3DVector4f planes[], GLT_FRUSTUM_TEST results[], int nPlanes) const
+{
+  int i, p, nVisible = 0;
+  int nbrObjects = (int)objects.size();
+
+  if (culler != NULL && !culler->IsEnabled())
+  {
+    for (i = 0; i < nbrObjects; i++)
+      results[i] = GLT_FRUSTUM_INSIDE;
+    return nbrObjects;
+  }
+
+  for (i = 0; i < nbrObjects; i++)
+    results[i] = GLT_FRUSTUM_OUTSIDE;
+  if (nodes.empty())
+    return 0;
+
+  int stack[BVH_MAX_STACK];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const BVHNode &node = nodes[stack[--top]];
+
+    /* Box against planes: the center's distance plus how far the box reaches along the normal */
+    GLT_FRUSTUM_TEST nodeResult = GLT_FRUSTUM_INSIDE;
+    for (p = 0; p < nPlanes; p++)
+    {
+      float dist = planes[p][3], reach = 0.0f;
+      for (i = 0; i < 3; i++)
+      {
+        float center = 0.5f * (node.boxMin[i] + node.boxMax[i]);
+        float extent = 0.5f * (node.boxMax[i] - node.boxMin[i]);
+        dist += planes[p][i] * center;
+        reach += fabsf(planes[p][i]) * extent;
+      }
+      if (dist + reach <= 0.0f)
+      {
+        nodeResult = GLT_FRUSTUM_OUTSIDE;
+        break;
+      }
+      if (dist - reach < 0.0f)
+        nodeResult = GLT_FRUSTUM_INTERSECT;
+    }
+
+    if (nodeResult == GLT_FRUSTUM_OUTSIDE)
+      continue;
+
+    if (nodeResult == GLT_FRUSTUM_INSIDE)
+    {
+      for (i = 0; i < node.count; i++)
+        results[order[node.first + i]] = GLT_FRUSTUM_INSIDE;
+      nVisible += node.count;
+      continue;
+    }
+
+    if (node.left >= 0)
+    {
+      stack[top++] = node.left;
+      stack[top++] = node.right;
+      continue;
+    }
+
+    /* Straddling leaf: classify its spheres one by one */
+    for (i = 0; i < node.count; i++)
+    {
+      int id = order[node.first + i];
+      const BoundingSphere &s = objects[id];
+      GLT_FRUSTUM_TEST result = GLT_FRUSTUM_INSIDE;
+      for (p = 0; p < nPlanes; p++)
+      {
+        float dist = m3dGetDistanceToPlane(s.center, planes[p]);
+        if (dist + s.radius <= 0.0f)
+        {
+          result = GLT_FRUSTUM_OUTSIDE;
+          break;
+        }
+        if (dist - s.radius < 0.0f)
+          result = GLT_FRUSTUM_INTERSECT;
+      }
+      results[id] = result;
+      if (result != GLT_FRUSTUM_OUTSIDE)
+        nVisible++;
+    }
+  }
+
+  return nVisible;
+}
+
+int SceneBVH::Pick(const M3DVector3f vOrigin, const M3DVector3f vDirection, float *pDistance) const
+{
+  int i, j;
+  int nearest = -1;
+  float nearestDistance = 0.0f;
+
+  if (nodes.empty())
+    return -1;
+
+  /* Slab test setup; an infinite reciprocal for an axis-parallel ray works out */
+  M3DVector3f inverse;
+  for (j = 0; j < 3; j++)
+    inverse[j] = 1.0f / vDirection[j];
+
+  int stack[BVH_MAX_STACK];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const BVHNode &node = nodes[stack[--top]];
+
+    /* Ray against box, skipping boxes that start beyond the best hit so far */
+    float tNear = 0.0f, tFar = 1.0e30f;
+    for (j = 0; j < 3 && tNear <= tFar; j++)
+    {
+      float t0 = (node.boxMin[j] - vOrigin[j]) * inverse[j];
+      float t1 = (node.boxMax[j] - vOrigin[j]) * inverse[j];
+      if (t0 > t1) { float t = t0; t0 = t1; t1 = t; }
+      if (t0 > tNear) tNear = t0;
+      if (t1 < tFar) tFar = t1;
+    }
+    if (tNear > tFar || (nearest >= 0 && tNear > nearestDistance))
+      continue;
+
+    if (node.left >= 0)
+    {
+      stack[top++] = node.left;
+      stack[top++] = node.right;
+      continue;
+    }
+
+    for (i = 0; i < node.count; i++)
+    {
+      int id = order[node.first + i];
+      const BoundingSphere &s = objects[id];
+
+      /* m3dRaySphereTest can't tell a miss from a ray that starts inside the sphere */
+      float distance;
+      if (m3dGetDistanceSquared3(vOrigin, s.center) <= s.radius * s.radius)
+        distance = 0.0f;
+      else
+      {
+        distance = m3dRaySphereTest(vOrigin, vDirection, s.center, s.radius);
+        if (distance < 0.0f)
+          continue;
+      }
+
+      if (nearest < 0 || distance < nearestDistance)
+      {
+        nearest = id;
+        nearestDistance = distance;
+      }
+    }
+  }
+
+  if (nearest >= 0 && pDistance != NULL)
+    *pDistance = nearestDistance;
+  return nearest;
+}
+
+float SceneBVH::GetDistance(int id, const M3DVector3f vPoint) const
+{
+  float distance = m3dGetDistance3(vPoint, objects[id].center) - objects[id].radius;
+  return (distance > 0.0f) ? distance : 0.0f;
+}
+
+int SceneBVH::SelectLOD(int id, const M3DVector3f vPoint, const float thresholds[], int nThresholds) const
+{
+  float distance = GetDistance(id, vPoint);
+  int level = 0;
+  while (level < nThresholds && distance >= thresholds[level])
+    level++;
+  return level;
+}
+
+#endif
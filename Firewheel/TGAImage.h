@@ -0,0 +1,284 @@
+//
+//  TGAImage.h
+//  Firewheel
+//
+//  Reads Targa images, plain or run-length encoded, straight out of a memory
+//  mapping of the file, and writes them, run-length encoded by default. The
+//  decoder goes through the packets a row at a time, so an image is never
+//  held twice, and hands each row to the same SIMD swizzle the BMPs use.
+//
+
+#ifndef Firewheel_TGAImage_h
+#define Firewheel_TGAImage_h
+
+#include <GLTools.h>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include "MappedFile.h"
+#include "ImagePipeline.h"
+
+const int TGA_HEADER_SIZE = 18;
+
+/* Image types; RLE adds 8 */
+const int TGA_TYPE_TRUE_COLOR = 2;
+const int TGA_TYPE_GREY       = 3;
+const int TGA_TYPE_RLE        = 8;
+
+/* Descriptor bits: alpha bits in the low four, then the origin */
+const int TGA_DESCRIPTOR_RIGHT_TO_LEFT = 0x10;
+const int TGA_DESCRIPTOR_TOP_DOWN      = 0x20;
+
+/* A packet's first byte: high bit for a run, then one less than its pixel count */
+const int TGA_PACKET_RUN       = 0x80;
+const int TGA_MAX_PACKET_SIZE  = 128;
+
+/* TGA fields are little endian and not necessarily aligned. */
+inline unsigned int ReadTGAShort(const GLubyte *p)
+  { return (unsigned int)p[0] | ((unsigned int)p[1] << 8); }
+
+/* An open, validated TGA: 24 or 32 bit true color, or 8 bit grey, either row
+   order, plain or RLE. Anything else, or packets that run past the end of
+   the file, fails Open(), with a message; a decode can't fail after that.
+
+     TGAImage image;
+     if (image.Open(szFileName))
+       image.DecodeRGBA(pDst);   // GetWidth() * GetHeight() * 4 bytes */
+class TGAImage
+{
+public:
+  TGAImage();
+  ~TGAImage() { Close(); }
+
+  bool Open(const char *szFileName);
+  void Close();
+
+  GLint  GetWidth() const         { return width; }
+  GLint  GetHeight() const        { return height; }
+  int    GetBytesPerPixel() const { return bytesPerPixel; }
+  bool   IsCompressed() const     { return compressed; }
+
+  /* RGBA8, bottom row first as OpenGL wants it, grey spread over RGB */
+  void DecodeRGBA(GLubyte *pDst) const;
+
+private:
+  bool Fail(const char *szFileName, const char *szReason);
+  bool CheckPackets(const GLubyte *pEnd) const;
+  void ConvertRow(const GLubyte *pSrc, GLubyte *pDst) const;
+
+  MappedFile     file;
+  const GLubyte *pPixels;
+  GLint          width, height;
+  int            bytesPerPixel;
+  bool           compressed;
+  bool           topDown;
+
+  TGAImage(const TGAImage&);
+  TGAImage& operator=(const TGAImage&);
+};
+
+TGAImage::TGAImage()
+  : pPixels(NULL), width(0), height(0), bytesPerPixel(0), compressed(false), topDown(false)
+{
+}
+
+bool TGAImage::Fail(const char *szFileName, const char *szReason)
+{
+  fprintf(stderr, "%s: %s\n", szFileName, szReason);
+  Close();
+  return false;
+}
+
+bool TGAImage::Open(const char *szFileName)
+{
+  Close();
+
+  if (!file.Open(szFileName))
+    return Fail(szFileName, "can't open");
+  const GLubyte *pFile = file.GetData();
+  size_t fileSize = file.GetSize();
+  if (fileSize < (size_t)TGA_HEADER_SIZE)
+    return Fail(szFileName, "not a TGA file");
+
+  /* A color map is allowed, and skipped, ahead of true color pixels */
+  int idLength = pFile[0], colorMapType = pFile[1], imageType = pFile[2];
+  unsigned int colorMapLength = ReadTGAShort(pFile + 5), colorMapBits = pFile[7];
+  GLint fileWidth = (GLint)ReadTGAShort(pFile + 12), fileHeight = (GLint)ReadTGAShort(pFile + 14);
+  int bits = pFile[16], descriptor = pFile[17];
+
+  int baseType = imageType & ~TGA_TYPE_RLE;
+  if (colorMapType > 1 || (baseType != TGA_TYPE_TRUE_COLOR && baseType != TGA_TYPE_GREY))
+    return Fail(szFileName, "only true color and grey TGAs are supported");
+  if ((baseType == TGA_TYPE_TRUE_COLOR && bits != 24 && bits != 32) || (baseType == TGA_TYPE_GREY && bits != 8))
+    return Fail(szFileName, "only 24 and 32 bit color and 8 bit grey TGAs are supported");
+  if (fileWidth == 0 || fileHeight == 0 || (descriptor & TGA_DESCRIPTOR_RIGHT_TO_LEFT))
+    return Fail(szFileName, "bad TGA header");
+
+  size_t pixelOffset = TGA_HEADER_SIZE + idLength + (colorMapType ? colorMapLength * ((colorMapBits + 7) / 8) : 0);
+  width = fileWidth;
+  height = fileHeight;
+  bytesPerPixel = bits / 8;
+  compressed = (imageType & TGA_TYPE_RLE) != 0;
+  topDown = (descriptor & TGA_DESCRIPTOR_TOP_DOWN) != 0;
+
+  if (pixelOffset > fileSize)
+    return Fail(szFileName, "TGA file is truncated");
+  pPixels = pFile + pixelOffset;
+  if (compressed ? !CheckPackets(pFile + fileSize) : (size_t)bytesPerPixel * width * height > fileSize - pixelOffset)
+    return Fail(szFileName, "TGA file is truncated");
+  return true;
+}
+
+/* Walks the packet headers only: they must cover the image within the file */
+bool TGAImage::CheckPackets(const GLubyte *pEnd) const
+{
+  const GLubyte *pPacket = pPixels;
+  for (size_t left = (size_t)width * height; left > 0; )
+  {
+    if (pPacket >= pEnd)
+      return false;
+    size_t count = (*pPacket & (TGA_PACKET_RUN - 1)) + 1;
+    size_t dataSize = (*pPacket & TGA_PACKET_RUN) ? bytesPerPixel : count * bytesPerPixel;
+    pPacket++;
+    if (count > left || dataSize > (size_t)(pEnd - pPacket))
+      return false;
+    pPacket += dataSize;
+    left -= count;
+  }
+  return true;
+}
+
+void TGAImage::Close()
+{
+  file.Close();
+  pPixels = NULL;
+  width = height = bytesPerPixel = 0;
+  compressed = topDown = false;
+}
+
+void TGAImage::ConvertRow(const GLubyte *pSrc, GLubyte *pDst) const
+{
+  if (bytesPerPixel != 1)
+  {
+    ConvertBGRToRGBA(pSrc, bytesPerPixel, width, pDst);
+    return;
+  }
+  for (int x = 0; x < width; x++)
+  {
+    pDst[4 * x + 0] = pDst[4 * x + 1] = pDst[4 * x + 2] = pSrc[x];
+    pDst[4 * x + 3] = 255;
+  }
+}
+
+/* Packets may carry on from one row into the next, so a run's pixel stays put
+   until the run is used up. */
+void TGAImage::DecodeRGBA(GLubyte *pDst) const
+{
+  size_t rowSize = (size_t)bytesPerPixel * width;
+  std::vector<GLubyte> row(compressed ? rowSize : 0);
+  const GLubyte *pPacket = pPixels;
+  int left = 0;
+  bool run = false;
+
+  for (int fileRow = 0; fileRow < height; fileRow++)
+  {
+    const GLubyte *pRow = compressed ? &row[0] : pPixels + rowSize * fileRow;
+    if (compressed)
+    {
+      for (int x = 0; x < width; )
+      {
+        if (left == 0)
+        {
+          run = (*pPacket & TGA_PACKET_RUN) != 0;
+          left = (*pPacket & (TGA_PACKET_RUN - 1)) + 1;
+          pPacket++;
+        }
+        int count = (left < width - x) ? left : width - x;
+        if (run)
+        {
+          for (int i = 0; i < count; i++)
+            memcpy(&row[(x + i) * bytesPerPixel], pPacket, bytesPerPixel);
+          if (count == left)
+            pPacket += bytesPerPixel;
+        }
+        else
+        {
+          memcpy(&row[x * bytesPerPixel], pPacket, count * bytesPerPixel);
+          pPacket += count * bytesPerPixel;
+        }
+        left -= count;
+        x += count;
+      }
+    }
+
+    int y = topDown ? height - 1 - fileRow : fileRow;
+    ConvertRow(pRow, pDst + 4 * (size_t)width * y);
+  }
+}
+
+/* Writes bottom-up rows of BGR, BGRA or grey pixels (pixelSize 3, 4 or 1),
+   tightly packed, as a TGA. Compressed, packets stop at the end of each row,
+   and two or more of the same pixel go out as a run. */
+bool WriteTGA(const char *szFileName, GLint width, GLint height, int pixelSize, const GLubyte *pPixels, bool compress = true);
+bool WriteTGA(const char *szFileName, GLint width, GLint height, int pixelSize, const GLubyte *pPixels, bool compress)
+{
+  if (width <= 0 || height <= 0 || width > 0xFFFF || height > 0xFFFF || (pixelSize != 1 && pixelSize != 3 && pixelSize != 4))
+    return false;
+
+  GLubyte header[TGA_HEADER_SIZE];
+  memset(header, 0, sizeof(header));
+  header[2] = (GLubyte)(((pixelSize == 1) ? TGA_TYPE_GREY : TGA_TYPE_TRUE_COLOR) + (compress ? TGA_TYPE_RLE : 0));
+  header[12] = (GLubyte)(width & 0xFF);
+  header[13] = (GLubyte)(width >> 8);
+  header[14] = (GLubyte)(height & 0xFF);
+  header[15] = (GLubyte)(height >> 8);
+  header[16] = (GLubyte)(pixelSize * 8);
+  header[17] = (GLubyte)((pixelSize == 4) ? 8 : 0);
+
+  size_t imageSize = (size_t)pixelSize * width * height;
+  std::vector<GLubyte> packets;
+  if (compress)
+  {
+    packets.reserve(imageSize / 2);
+    for (int y = 0; y < height; y++)
+    {
+      const GLubyte *pRow = pPixels + (size_t)pixelSize * width * y;
+      int x = 0;
+      while (x < width)
+      {
+        int count = 1;
+        while (x + count < width && count < TGA_MAX_PACKET_SIZE &&
+               memcmp(pRow + pixelSize * (x + count), pRow + pixelSize * x, pixelSize) == 0)
+          count++;
+        if (count > 1)
+        {
+          packets.push_back((GLubyte)(TGA_PACKET_RUN | (count - 1)));
+          packets.insert(packets.end(), pRow + pixelSize * x, pRow + pixelSize * (x + 1));
+          x += count;
+          continue;
+        }
+
+        /* Raw up to where the next run starts */
+        while (x + count < width && count < TGA_MAX_PACKET_SIZE &&
+               (x + count + 1 >= width || memcmp(pRow + pixelSize * (x + count), pRow + pixelSize * (x + count + 1), pixelSize) != 0))
+          count++;
+        packets.push_back((GLubyte)(count - 1));
+        packets.insert(packets.end(), pRow + pixelSize * x, pRow + pixelSize * (x + count));
+        x += count;
+      }
+    }
+  }
+
+  FILE *pFile = fopen(szFileName, "wb");
+  if (pFile == NULL)
+    return false;
+  bool written = (fwrite(header, sizeof(header), 1, pFile) == 1);
+  if (compress)
+    written = written && fwrite(&packets[0], packets.size(), 1, pFile) == 1;
+  else
+    written = written && fwrite(pPixels, imageSize, 1, pFile) == 1;
+  return (fclose(pFile) == 0) && written;
+}
+
+#endif
@@ -0,0 +1,275 @@
+//
+//  TextureArray.h
+//  Firewheel
+//
+//  The rides' textures gathered as layers of one array texture, so draws that
+//  use different ones can share a single binding and pick their own layer.
+//
+
+#ifndef Firewheel_TextureArray_h
+#define Firewheel_TextureArray_h
+
+#include <GLTools.h>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cfloat>
+
+#include "TextureStreamer.h"
+
+/* Every layer has the same size; images are resampled to it. Wide enough for
+   the car walls, which are the widest images and fill most of the screen. */
+const GLint TEXTURE_ARRAY_WIDTH = 1024;
+const GLint TEXTURE_ARRAY_HEIGHT = 512;
+
+/* Register each texture with the file it was loaded from, then set it up
+   with room for the most images drawn at once:
+     textureArray.AddTexture(capTexture[i], CAP_TEXTURE_FILENAME[i]);
+     ...
+     textureArray.SetupRenderingContext(&textureStreamer, nbrLayers);
+   Textures loaded from the same file share a layer. Touch() each texture
+   drawn from the array, or that would be if its layer were in, and Update()
+   once a frame (the TextureManager does, given the array): each image that
+   was drawn is streamed into a free layer, or the layer of the image gone
+   longest undrawn, by the streamer's loaders, a few uploads a frame like any
+   other texture. A texture's GetLayer() is -1 until its image is in, or for
+   good if it won't load, so its draws go on using the regular 2D texture
+   meanwhile. Without array textures (OpenGL 3.0), setting up fails and every
+   GetLayer() is -1. */
+class TextureArray
+{
+public:
+  TextureArray();
+
+  void AddTexture(GLuint texture, const char *szFileName);
+  bool SetupRenderingContext(TextureStreamer *pStreamer, int nbrLayers);
+  void ShutdownRenderingContext();
+
+  /* Drawn this frame, this far from the eye */
+  void Touch(GLuint texture, float distance);
+  /* Starts at most maxRequests loads, nearest first; returns how many it did */
+  int  Update(int maxRequests);
+
+  GLuint GetName() const { return arrayTexture; }
+  int GetFileCount() const  { return (int)files.size(); }
+  int GetLayerCount() const { return (int)layers.size(); }
+  int GetResidentCount() const;
+  int GetLoadingCount() const { return nbrLoading; }
+
+  /* The storage, every layer and level of it, whatever they hold */
+  size_t GetBytes() const;
+
+  /* The layer holding the texture's image, or -1 if it isn't in the array (yet) */
+  int GetLayer(GLuint texture) const;
+
+private:
+  enum FileState { FILE_EVICTED, FILE_LOADING, FILE_RESIDENT, FILE_FAILED };
+
+  struct File
+  {
+    const char  *szFileName;
+    FileState    state;
+    int          layer;           /* while loading or resident */
+    unsigned int lastUsedFrame;
+    float        nearest;         /* this frame's closest use */
+  };
+
+  struct Layer
+  {
+    TextureArray *pArray;         /* for the streamer's callback */
+    int           file;           /* whose image it holds, or is getting; -1 for none */
+  };
+
+  static void LayerStreamed(GLuint texture, bool loaded, void *pLayer);
+  int FindLayer(unsigned int drawnFrame) const;
+
+  TextureStreamer      *pStreamer;
+  std::vector<File>     files;
+  std::vector<Layer>    layers;
+  std::map<GLuint, int> fileOf;
+  GLuint                arrayTexture;
+  unsigned int          frame;
+  int                   nbrLoading;
+};
+
+TextureArray::TextureArray()
+  : pStreamer(NULL), arrayTexture(0), frame(1), nbrLoading(0)
+{
+}
+
+void TextureArray::AddTexture(GLuint texture, const char *szFileName)
+{
+  int file;
+  for (file = 0; file < (int)files.size(); file++)
+    if (strcmp(files[file].szFileName, szFileName) == 0)
+      break;
+  if (file == (int)files.size())
+  {
+    File added;
+    added.szFileName = szFileName;
+    added.state = FILE_EVICTED;
+    added.layer = -1;
+    added.lastUsedFrame = 0;
+    added.nearest = FLT_MAX;
+    files.push_back(added);
+  }
+  fileOf[texture] = file;
+}
+
+/* Gives every level its storage; the layers are filled in as they're drawn */
+bool TextureArray::SetupRenderingContext(TextureStreamer *pTextureStreamer, int nbrLayers)
+{
+  pStreamer = pTextureStreamer;
+  if (nbrLayers > (int)files.size())
+    nbrLayers = (int)files.size();
+  if (nbrLayers <= 0 || !(GLEW_VERSION_3_0 || GLEW_EXT_texture_array))
+  {
+    fileOf.clear();
+    return false;
+  }
+
+  int nbrLevels = GetMipLevelCount(TEXTURE_ARRAY_WIDTH, TEXTURE_ARRAY_HEIGHT);
+  glGenTextures(1, &arrayTexture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, nbrLevels - 1);
+  GLint width = TEXTURE_ARRAY_WIDTH, height = TEXTURE_ARRAY_HEIGHT;
+  for (int level = 0; level < nbrLevels; level++)
+  {
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB8, width, height, nbrLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    width = (width > 1) ? width / 2 : 1;
+    height = (height > 1) ? height / 2 : 1;
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  /* The streamer holds on to these, so they don't move from here on */
+  Layer empty;
+  empty.pArray = this;
+  empty.file = -1;
+  layers.assign(nbrLayers, empty);
+  return true;
+}
+
+/* After the streamer's, so nothing is still on its way into the layers */
+void TextureArray::ShutdownRenderingContext()
+{
+  if (arrayTexture != 0)
+    glDeleteTextures(1, &arrayTexture);
+  arrayTexture = 0;
+  fileOf.clear();
+  layers.clear();
+  nbrLoading = 0;
+}
+
+void TextureArray::Touch(GLuint texture, float distance)
+{
+  std::map<GLuint, int>::iterator found = fileOf.find(texture);
+  if (found == fileOf.end())
+    return;
+
+  File &file = files[found->second];
+  if (file.lastUsedFrame != frame)
+  {
+    file.lastUsedFrame = frame;
+    file.nearest = distance;
+  }
+  else if (distance < file.nearest)
+    file.nearest = distance;
+}
+
+/* Works on what the last frame drew, like the TextureManager's Update() */
+int TextureArray::Update(int maxRequests)
+{
+  unsigned int drawnFrame = frame++;
+  int requests = 0;
+
+  while (requests < maxRequests)
+  {
+    int wanted = -1;
+    for (int f = 0; f < (int)files.size(); f++)
+      if (files[f].state == FILE_EVICTED && files[f].lastUsedFrame == drawnFrame &&
+          (wanted < 0 || files[f].nearest < files[wanted].nearest))
+        wanted = f;
+    int layer = (wanted >= 0) ? FindLayer(drawnFrame) : -1;
+    if (layer < 0)
+      break;
+
+    if (layers[layer].file >= 0)
+    {
+      files[layers[layer].file].state = FILE_EVICTED;
+      files[layers[layer].file].layer = -1;
+    }
+    layers[layer].file = wanted;
+    files[wanted].state = FILE_LOADING;
+    files[wanted].layer = layer;
+    nbrLoading++;
+    requests++;
+    pStreamer->LoadLayer(arrayTexture, layer, TEXTURE_ARRAY_WIDTH, TEXTURE_ARRAY_HEIGHT, files[wanted].szFileName,
+                         LayerStreamed, &layers[layer]);
+  }
+  return requests;
+}
+
+/* An empty layer, or else the one whose image has gone longest undrawn; never
+   one still loading, or drawn last frame. */
+int TextureArray::FindLayer(unsigned int drawnFrame) const
+{
+  int oldest = -1;
+  for (int layer = 0; layer < (int)layers.size(); layer++)
+  {
+    int file = layers[layer].file;
+    if (file < 0)
+      return layer;
+    if (files[file].state == FILE_RESIDENT && files[file].lastUsedFrame != drawnFrame &&
+        (oldest < 0 || files[file].lastUsedFrame < files[layers[oldest].file].lastUsedFrame))
+      oldest = layer;
+  }
+  return oldest;
+}
+
+/* A file that fails gives its layer back and stays out of the array */
+void TextureArray::LayerStreamed(GLuint /*texture*/, bool loaded, void *pLayer)
+{
+  Layer *layer = static_cast<Layer*>(pLayer);
+  TextureArray *self = layer->pArray;
+  File &file = self->files[layer->file];
+
+  self->nbrLoading--;
+  if (loaded)
+    file.state = FILE_RESIDENT;
+  else
+  {
+    file.state = FILE_FAILED;
+    file.layer = -1;
+    layer->file = -1;
+  }
+}
+
+int TextureArray::GetResidentCount() const
+{
+  int count = 0;
+  for (size_t file = 0; file < files.size(); file++)
+    if (files[file].state == FILE_RESIDENT)
+      count++;
+  return count;
+}
+
+/* Uncompressed texels are taken as four bytes, as drivers keep RGB */
+size_t TextureArray::GetBytes() const
+{
+  return layers.size() * GetRGBAMipChainSize(TEXTURE_ARRAY_WIDTH, TEXTURE_ARRAY_HEIGHT,
+                                              GetMipLevelCount(TEXTURE_ARRAY_WIDTH, TEXTURE_ARRAY_HEIGHT));
+}
+
+int TextureArray::GetLayer(GLuint texture) const
+{
+  std::map<GLuint, int>::const_iterator found = fileOf.find(texture);
+  if (found == fileOf.end() || files[found->second].state != FILE_RESIDENT)
+    return -1;
+  return files[found->second].layer;
+}
+
+#endif
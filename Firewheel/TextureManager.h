@@ -0,0 +1,457 @@
+//
+//  TextureManager.h
+//  Firewheel
+//
+//  Keeps the textures within a memory budget: each is loaded when first drawn,
+//  with as many mip levels as its distance calls for, and the ones that have
+//  gone longest undrawn are dropped back to a placeholder when over budget.
+//  A TextureArray's storage counts against the same budget, and its layers
+//  are loaded alongside the textures, as they're drawn.
+//  Each image file is loaded once, however many parts of the park use it;
+//  where the GL has sampler objects, its filtering and wrapping live in those
+//  instead, so uses that want different modes still share the one texture.
+//
+
+#ifndef Firewheel_TextureManager_h
+#define Firewheel_TextureManager_h
+
+#include <GLTools.h>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cfloat>
+#include <cmath>
+
+#include "TextureStreamer.h"
+#include "TextureArray.h"
+
+/* Closer than this, a texture gets every level; each doubling of the distance
+   beyond it drops the largest remaining level. */
+const float TEXTURE_FULL_DETAIL_DISTANCE = 4.0f;
+const int   MAX_TEXTURE_DISTANCE_LEVELS = 6;
+
+/* Loads and reloads started per Update(), on top of what is already streaming */
+const int   TEXTURE_REQUESTS_PER_FRAME = 2;
+
+/* Levels dropped from every texture when the ones in use don't fit the budget */
+const int   MAX_TEXTURE_DETAIL_BIAS = 4;
+
+/* Acquire() each texture by the file it comes from instead of loading it,
+   Prefetch() the ones wanted from the start, and have the draw list Touch()
+   each texture it binds and TouchLayer() the ones pooled draws take from the
+   array. Update() once a frame, before the streamer's, then loads what was
+   drawn and evicts to the budget. The texture names never change, so draw
+   lists and caches holding them stay good.
+
+   Acquiring a file again returns the same texture, with another reference
+   to it, and the manager deletes it once each Acquire() has its Release().
+   The sampler object handed back holds the modes asked for; draws bind it
+   with the texture, or leave it to the draw list to bind the modes the
+   texture was first acquired with. Without sampler objects, the modes are
+   the texture's own and only uses that agree on them share it. */
+class TextureManager
+{
+public:
+  TextureManager();
+
+  void SetupRenderingContext(TextureStreamer *pStreamer, size_t budgetBytes);
+  void ShutdownRenderingContext();
+
+  GLuint Acquire(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode, GLuint *pSampler = NULL);
+  void   Release(GLuint texture);
+  void   Prefetch(GLuint texture);
+
+  /* Shared sampler objects; 0 without them, or for a texture not acquired here */
+  GLuint GetSampler(GLenum minFilter, GLenum magFilter, GLenum wrapMode);
+  GLuint GetSampler(GLuint texture) const;
+  bool   UsesSamplers() const { return useSamplers; }
+
+  /* Optional; Update() loads its layers too, and its storage is counted */
+  void SetTextureArray(TextureArray *pArray);
+
+  /* Drawn this frame, this far from the eye: bound, or from its layer of the array */
+  void Touch(GLuint texture, float distance);
+  void TouchLayer(GLuint texture, float distance);
+  void Update();
+
+  size_t GetBudget() const        { return budgetBytes; }
+  size_t GetResidentBytes() const { return residentBytes + arrayBytes; }
+  int    GetResidentCount() const;
+  int    GetDetailBias() const    { return detailBias; }
+  int    GetTextureCount() const  { return (int)entries.size(); }
+  int    GetLoadingCount() const  { return nbrLoading + ((pTextureArray != NULL) ? pTextureArray->GetLoadingCount() : 0); }
+
+private:
+  enum TextureState { TEXTURE_EVICTED, TEXTURE_LOADING, TEXTURE_RESIDENT, TEXTURE_FAILED };
+
+  struct Entry
+  {
+    std::string  key;
+    const char  *szFileName;
+    GLenum       minFilter, magFilter, wrapMode;  /* loaded with; the first Acquire()'s */
+    GLuint       sampler;
+    int          references;
+    bool         released;        /* deleted once its load is done */
+
+    TextureState state;
+    int          firstLevel;      /* asked of the streamer, last time */
+    size_t       bytes;           /* while resident */
+    unsigned int lastUsedFrame;
+    float        nearest;         /* this frame's closest use */
+  };
+
+  /* Sampler state, ordered for the sampler map */
+  struct SamplerModes
+  {
+    GLenum minFilter, magFilter, wrapMode;
+    bool operator<(const SamplerModes &other) const
+    {
+      if (minFilter != other.minFilter)
+        return minFilter < other.minFilter;
+      return (magFilter != other.magFilter) ? (magFilter < other.magFilter) : (wrapMode < other.wrapMode);
+    }
+  };
+
+  static void TextureStreamed(GLuint texture, bool loaded, void *pSelf);
+  static size_t MeasureTexture(GLuint texture);
+  std::string MakeKey(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode) const;
+  void Delete(GLuint texture);
+  int  GetWantedLevel(const Entry &entry) const;
+  void Request(GLuint texture, Entry &entry, int firstLevel);
+  void Evict(GLuint texture, Entry &entry);
+
+  TextureStreamer *pStreamer;
+  TextureArray    *pTextureArray;
+  std::map<GLuint, Entry> entries;
+  std::map<std::string, GLuint> byKey;
+  std::map<SamplerModes, GLuint> samplers;
+  bool         useSamplers;
+  size_t       budgetBytes, residentBytes;
+  size_t       arrayBytes;
+  unsigned int frame;
+  int          detailBias;
+  int          nbrLoading;
+};
+
+TextureManager::TextureManager()
+  : pStreamer(NULL), pTextureArray(NULL), useSamplers(false), budgetBytes(0), residentBytes(0), arrayBytes(0),
+    frame(1), detailBias(0), nbrLoading(0)
+{
+}
+
+void TextureManager::SetupRenderingContext(TextureStreamer *pTextureStreamer, size_t budget)
+{
+  pStreamer = pTextureStreamer;
+  budgetBytes = budget;
+  useSamplers = (GLEW_VERSION_3_3 || GLEW_ARB_sampler_objects);
+}
+
+/* After the streamer's, so nothing is still on its way into the textures */
+void TextureManager::ShutdownRenderingContext()
+{
+  for (std::map<GLuint, Entry>::iterator entry = entries.begin(); entry != entries.end(); ++entry)
+    glDeleteTextures(1, &entry->first);
+  for (std::map<SamplerModes, GLuint>::iterator sampler = samplers.begin(); sampler != samplers.end(); ++sampler)
+    glDeleteSamplers(1, &sampler->second);
+  entries.clear();
+  byKey.clear();
+  samplers.clear();
+  pTextureArray = NULL;
+  residentBytes = arrayBytes = 0;
+  nbrLoading = 0;
+}
+
+/* Once it's set up, so its storage is there to count */
+void TextureManager::SetTextureArray(TextureArray *pArray)
+{
+  pTextureArray = pArray;
+  arrayBytes = (pArray != NULL) ? pArray->GetBytes() : 0;
+}
+
+/* Files are told apart by name; without sampler objects, by their modes too */
+std::string TextureManager::MakeKey(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode) const
+{
+  std::string key(szFileName);
+  if (!useSamplers)
+  {
+    char szModes[32];
+    sprintf(szModes, "|%x|%x|%x", minFilter, magFilter, wrapMode);
+    key += szModes;
+  }
+  return key;
+}
+
+GLuint TextureManager::Acquire(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode, GLuint *pSampler)
+{
+  std::string key = MakeKey(szFileName, minFilter, magFilter, wrapMode);
+  if (pSampler != NULL)
+    *pSampler = GetSampler(minFilter, magFilter, wrapMode);
+
+  std::map<std::string, GLuint>::iterator shared = byKey.find(key);
+  if (shared != byKey.end())
+  {
+    Entry &entry = entries[shared->second];
+    entry.references++;
+
+    /* A sampler that wants mip levels needs the image to have them */
+    if (TextureStreamer::IsMipmapped(minFilter) && !TextureStreamer::IsMipmapped(entry.minFilter))
+    {
+      entry.minFilter = minFilter;
+      if (entry.state == TEXTURE_RESIDENT)
+        Request(shared->second, entry, entry.firstLevel);
+    }
+    return shared->second;
+  }
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  byKey[key] = texture;
+
+  Entry entry;
+  entry.key = key;
+  entry.szFileName = szFileName;
+  entry.minFilter = minFilter;
+  entry.magFilter = magFilter;
+  entry.wrapMode = wrapMode;
+  entry.sampler = GetSampler(minFilter, magFilter, wrapMode);
+  entry.references = 1;
+  entry.released = false;
+  entry.state = TEXTURE_EVICTED;
+  entry.firstLevel = 0;
+  entry.bytes = 0;
+  entry.lastUsedFrame = 0;
+  entry.nearest = FLT_MAX;
+  entries[texture] = entry;
+
+  TextureStreamer::SetPlaceholder(texture);
+  return texture;
+}
+
+/* One still streaming in is deleted when the streamer is done with it */
+void TextureManager::Release(GLuint texture)
+{
+  std::map<GLuint, Entry>::iterator found = entries.find(texture);
+  if (found == entries.end() || found->second.references == 0 || --found->second.references > 0)
+    return;
+
+  byKey.erase(found->second.key);
+  if (found->second.state == TEXTURE_LOADING)
+    found->second.released = true;
+  else
+    Delete(texture);
+}
+
+void TextureManager::Delete(GLuint texture)
+{
+  Entry &entry = entries[texture];
+  residentBytes -= entry.bytes;
+  entries.erase(texture);
+  glDeleteTextures(1, &texture);
+}
+
+GLuint TextureManager::GetSampler(GLenum minFilter, GLenum magFilter, GLenum wrapMode)
+{
+  if (!useSamplers)
+    return 0;
+
+  SamplerModes modes;
+  modes.minFilter = minFilter;
+  modes.magFilter = magFilter;
+  modes.wrapMode = wrapMode;
+  std::map<SamplerModes, GLuint>::iterator found = samplers.find(modes);
+  if (found != samplers.end())
+    return found->second;
+
+  GLuint sampler;
+  glGenSamplers(1, &sampler);
+  glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+  glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrapMode);
+  glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrapMode);
+  samplers[modes] = sampler;
+  return sampler;
+}
+
+GLuint TextureManager::GetSampler(GLuint texture) const
+{
+  std::map<GLuint, Entry>::const_iterator found = entries.find(texture);
+  return (found != entries.end()) ? found->second.sampler : 0;
+}
+
+void TextureManager::Prefetch(GLuint texture)
+{
+  std::map<GLuint, Entry>::iterator found = entries.find(texture);
+  if (found != entries.end() && found->second.state == TEXTURE_EVICTED)
+    Request(texture, found->second, detailBias);
+}
+
+void TextureManager::Touch(GLuint texture, float distance)
+{
+  std::map<GLuint, Entry>::iterator found = entries.find(texture);
+  if (found == entries.end())
+    return;
+
+  Entry &entry = found->second;
+  if (entry.lastUsedFrame != frame)
+  {
+    entry.lastUsedFrame = frame;
+    entry.nearest = distance;
+  }
+  else if (distance < entry.nearest)
+    entry.nearest = distance;
+}
+
+void TextureManager::TouchLayer(GLuint texture, float distance)
+{
+  if (pTextureArray != NULL)
+    pTextureArray->Touch(texture, distance);
+}
+
+int TextureManager::GetWantedLevel(const Entry &entry) const
+{
+  int level = 0;
+  for (float reach = 2.0f * TEXTURE_FULL_DETAIL_DISTANCE; entry.nearest >= reach && level < MAX_TEXTURE_DISTANCE_LEVELS; reach *= 2.0f)
+    level++;
+  return level + detailBias;
+}
+
+/* Works on what the last frame drew: loads it, or reloads it at the detail its
+   distance now calls for (a level finer right away, coarser once it's two
+   levels too fine or over budget), and has the array load the layers it drew
+   from, then evicts the least recently drawn textures to fit the budget. The
+   array's storage is counted whole, whatever its layers hold, so only the
+   textures make room. */
+void TextureManager::Update()
+{
+  unsigned int drawnFrame = frame++;
+  int requests = 0;
+  std::map<GLuint, Entry>::iterator entry;
+
+  for (entry = entries.begin(); entry != entries.end() && requests < TEXTURE_REQUESTS_PER_FRAME; ++entry)
+  {
+    if (entry->second.lastUsedFrame != drawnFrame)
+      continue;
+    int wanted = GetWantedLevel(entry->second), loaded = entry->second.firstLevel;
+    bool coarser = (wanted > loaded + 1) || (wanted > loaded && GetResidentBytes() > budgetBytes);
+    if (entry->second.state == TEXTURE_EVICTED ||
+        (entry->second.state == TEXTURE_RESIDENT && (wanted < loaded || coarser)))
+    {
+      Request(entry->first, entry->second, wanted);
+      requests++;
+    }
+  }
+  if (pTextureArray != NULL)
+    requests += pTextureArray->Update(TEXTURE_REQUESTS_PER_FRAME - requests);
+
+  while (GetResidentBytes() > budgetBytes)
+  {
+    std::map<GLuint, Entry>::iterator oldest = entries.end();
+    for (entry = entries.begin(); entry != entries.end(); ++entry)
+      if (entry->second.state == TEXTURE_RESIDENT && entry->second.lastUsedFrame != drawnFrame &&
+          (oldest == entries.end() || entry->second.lastUsedFrame < oldest->second.lastUsedFrame))
+        oldest = entry;
+    if (oldest == entries.end())
+      break;
+    Evict(oldest->first, oldest->second);
+  }
+
+  /* What's in use doesn't fit: everything a level coarser. Once the reloads
+     have settled, and there's room to spare, a level finer again. */
+  if (GetLoadingCount() == 0 && requests == 0)
+  {
+    if (GetResidentBytes() > budgetBytes && detailBias < MAX_TEXTURE_DETAIL_BIAS)
+      detailBias++;
+    else if (GetResidentBytes() < budgetBytes / 4 && detailBias > 0)
+      detailBias--;
+  }
+}
+
+/* Without loader threads, the streamer calls back before this returns */
+void TextureManager::Request(GLuint texture, Entry &entry, int firstLevel)
+{
+  bool evicted = (entry.state == TEXTURE_EVICTED);
+  entry.state = TEXTURE_LOADING;
+  entry.firstLevel = firstLevel;
+  nbrLoading++;
+
+  if (evicted)
+    pStreamer->Load(texture, entry.szFileName, entry.minFilter, entry.magFilter, entry.wrapMode,
+                    TextureStreamed, this, firstLevel);
+  else
+    pStreamer->Reload(texture, entry.szFileName, entry.minFilter, entry.magFilter, entry.wrapMode,
+                      TextureStreamed, this, firstLevel);
+}
+
+void TextureManager::Evict(GLuint texture, Entry &entry)
+{
+  TextureStreamer::SetPlaceholder(texture);
+  residentBytes -= entry.bytes;
+  entry.bytes = 0;
+  entry.state = TEXTURE_EVICTED;
+}
+
+void TextureManager::TextureStreamed(GLuint texture, bool loaded, void *pSelf)
+{
+  TextureManager *self = static_cast<TextureManager*>(pSelf);
+  std::map<GLuint, Entry>::iterator found = self->entries.find(texture);
+  if (found == self->entries.end())
+    return;
+
+  Entry &entry = found->second;
+  if (entry.state == TEXTURE_LOADING)
+    self->nbrLoading--;
+  if (entry.released)
+  {
+    entry.state = TEXTURE_EVICTED;
+    self->Delete(texture);
+    return;
+  }
+
+  /* A failed reload keeps what it had */
+  self->residentBytes -= entry.bytes;
+  if (loaded || entry.bytes != 0)
+  {
+    entry.bytes = MeasureTexture(texture);
+    entry.state = TEXTURE_RESIDENT;
+  }
+  else
+    entry.state = TEXTURE_FAILED;
+  self->residentBytes += entry.bytes;
+}
+
+/* What the driver holds for each level from the base down; uncompressed
+   texels are taken as four bytes, as drivers keep RGB. */
+size_t TextureManager::MeasureTexture(GLuint texture)
+{
+  GLint baseLevel = 0, compressed = GL_FALSE;
+  size_t bytes = 0;
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, baseLevel, GL_TEXTURE_COMPRESSED, &compressed);
+  for (GLint level = baseLevel; level < KTX_MAX_LEVELS; level++)
+  {
+    GLint width = 0, height = 0, size = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+    if (width == 0 || height == 0)
+      break;
+    if (compressed)
+      glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    else
+      size = 4 * width * height;
+    bytes += size;
+  }
+  return bytes;
+}
+
+int TextureManager::GetResidentCount() const
+{
+  int count = 0;
+  for (std::map<GLuint, Entry>::const_iterator entry = entries.begin(); entry != entries.end(); ++entry)
+    if (entry->second.state == TEXTURE_RESIDENT)
+      count++;
+  return count;
+}
+
+#endif
@@ -0,0 +1,717 @@
+//
+//  TextureStreamer.h
+//  Firewheel
+//
+//  Loads textures in the background: loader threads read the images, the GL
+//  thread uploads them through a small pool of pixel buffer objects a few per
+//  frame, and each texture shows a plain placeholder until its image is in.
+//  A KTX file made by Tools/bmp2ktx is used in place of the BMP it was made
+//  from, mip chain and all, when it sits beside it. A BMP or TGA is decoded
+//  to RGBA8 and given its mip levels by the loaders (see ImagePipeline.h), so
+//  the driver neither converts BGR nor builds mipmaps itself. Layers of an
+//  array texture are streamed the same way, resampled to the array's size.
+//
+
+#ifndef Firewheel_TextureStreamer_h
+#define Firewheel_TextureStreamer_h
+
+#include <GLTools.h>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include "Threading.h"
+#include "MappedBMP.h"
+#include "TGAImage.h"
+#include "KTXImage.h"
+#include "ImagePipeline.h"
+
+const int MAX_TEXTURE_LOADER_THREADS = 4;
+
+/* Staging buffers; also the most images that can be between reading and upload */
+const int TEXTURE_STAGING_BUFFERS = 4;
+
+/* Uploads (with their mipmaps) per Update(), to keep frames short while streaming */
+const int TEXTURE_UPLOADS_PER_FRAME = 2;
+
+const GLubyte TEXTURE_PLACEHOLDER_COLOR[4] = { 160, 160, 160, 255 };
+
+/* Called on the GL thread, from Update(), once the texture has its image or
+   has given up on it (loaded is false, and the placeholder stays). */
+typedef void (*TextureStreamedFunction)(GLuint texture, bool loaded, void *pContext);
+
+/* Each image goes through
+     queued -> opened (loader: file mapped, header checked)
+            -> staging (GL thread: buffer mapped for it)
+            -> copied (loader: RGBA levels written into the buffer)
+            -> uploaded (GL thread: texture levels from the buffer)
+   so the only GL work is mapping and the uploads themselves, and the pixels
+   go from the file mapping straight into the driver's buffer. Load() and
+   Update() must be called on the GL thread.
+
+   Files ending in .tga are read as Targa images, and anything else as BMP.
+   With image workers, a loader splits each image's rows between them, one
+   image at a time. */
+class TextureStreamer
+{
+public:
+  TextureStreamer();
+  ~TextureStreamer() { ShutdownRenderingContext(); }
+
+  void SetupRenderingContext(int nbrThreads, int nbrImageWorkers = 0);
+  void ShutdownRenderingContext();
+
+  /* The texture gets the placeholder right away and its image later; Reload()
+     keeps whatever it has until then. A first level above 0 leaves out that
+     many of the largest mip levels, for textures that are only seen small. */
+  void Load(GLuint texture, const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode,
+            TextureStreamedFunction callback = NULL, void *pContext = NULL, int firstLevel = 0);
+  void Reload(GLuint texture, const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode,
+              TextureStreamedFunction callback = NULL, void *pContext = NULL, int firstLevel = 0);
+
+  /* One layer of an array texture whose levels are all there already, width
+     x height down to 1x1; the image is resampled to fit, and the layer keeps
+     what it has until then. A KTX beside the image isn't used, being made
+     at the image's own size. The callback is given the array texture. */
+  void LoadLayer(GLuint arrayTexture, GLint layer, GLint width, GLint height, const char *szFileName,
+                 TextureStreamedFunction callback = NULL, void *pContext = NULL);
+  void Update();
+
+  static void SetPlaceholder(GLuint texture);
+  static bool IsMipmapped(GLenum minFilter);
+
+  int GetPendingCount();
+
+private:
+  enum JobState { JOB_QUEUED, JOB_OPENING, JOB_OPENED, JOB_STAGING, JOB_COPYING, JOB_COPIED, JOB_FAILED };
+
+  struct Job
+  {
+    GLuint      texture;
+    const char *szFileName;
+    GLenum      minFilter, magFilter, wrapMode;
+    TextureStreamedFunction callback;
+    void       *pContext;
+    int         firstLevel;
+    GLint       layer;      /* of the array texture; -1 for a 2D texture */
+
+    JobState    state;
+    std::string ktxFileName;
+    bool        isKTX;
+    KTXImage    ktx;        /* kept open until uploaded; its levels give the layout */
+    MappedBMP   image;
+    TGAImage    tga;
+    bool        isTGA;
+    GLint       width, height;  /* a layer's are the array's, from the start */
+    int         nbrLevels;
+    size_t      size;
+    int         buffer;
+    GLubyte    *pStaging;
+  };
+
+  void Request(GLuint texture, const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode,
+               TextureStreamedFunction callback, void *pContext, int firstLevel);
+  Job *NewJob(GLuint texture, const char *szFileName, TextureStreamedFunction callback, void *pContext);
+  void Queue(Job *pJob);
+  static void LoaderMain(void *pSelf);
+  static size_t GetCopySize(GLint imageWidth, GLint imageHeight, int firstLevel, bool mipmapped,
+                            GLint &width, GLint &height, int &nbrLevels);
+  void CopyImage(const MappedBMP *pBMP, const TGAImage *pTGA, int firstLevel, int nbrLevels, GLubyte *pDst);
+  void CopyLayer(const MappedBMP *pBMP, const TGAImage *pTGA, GLint width, GLint height, int nbrLevels, GLubyte *pDst);
+  void ConvertImage(const MappedBMP *pBMP, const TGAImage *pTGA, GLubyte *pDst);
+  void ConvertBMP(const MappedBMP &image, GLubyte *pDst);
+  static void ConvertBMPRows(int first, int last, void *pContext);
+  static void UploadBMP(GLint width, GLint height, int firstLevel, int nbrLevels, const GLubyte *pPixels);
+  static void UploadLayer(GLint layer, GLint width, GLint height, int nbrLevels, const GLubyte *pPixels);
+  static void ClearLevels(int firstLevel, int endLevel);
+  static void GenerateMipmaps(GLenum minFilter);
+  static std::string GetKTXFileName(const char *szFileName);
+  static bool IsTGAFileName(const char *szFileName);
+  static bool FileExists(const char *szFileName);
+  void Finish(Job *pJob);
+
+  Thread    loaders[MAX_TEXTURE_LOADER_THREADS];
+  int       nbrLoaders;
+  Mutex     mutex;
+  Condition wake;
+  bool      stopping;
+  bool      decodeCompressed;  /* no S3TC: loaders decode KTX levels to RGBA */
+
+  WorkerPool imageWorkers;
+  Mutex      imageMutex;       /* the loader using the workers */
+
+  /* Guarded by mutex; only the GL thread adds and removes jobs */
+  std::vector<Job*> jobs;
+
+  GLuint buffers[TEXTURE_STAGING_BUFFERS];
+  bool   bufferInUse[TEXTURE_STAGING_BUFFERS];
+};
+
+TextureStreamer::TextureStreamer()
+  : nbrLoaders(0), stopping(false), decodeCompressed(false)
+{
+  for (int i = 0; i < TEXTURE_STAGING_BUFFERS; i++)
+  {
+    buffers[i] = 0;
+    bufferInUse[i] = false;
+  }
+}
+
+void TextureStreamer::SetupRenderingContext(int nbrThreads, int nbrImageWorkers)
+{
+  glGenBuffers(TEXTURE_STAGING_BUFFERS, buffers);
+  decodeCompressed = !KTXImage::CanUploadCompressed();
+
+  if (nbrThreads < 1)
+    nbrThreads = 1;
+  if (nbrThreads > MAX_TEXTURE_LOADER_THREADS)
+    nbrThreads = MAX_TEXTURE_LOADER_THREADS;
+
+  stopping = false;
+  for (nbrLoaders = 0; nbrLoaders < nbrThreads; nbrLoaders++)
+    if (!loaders[nbrLoaders].Start(LoaderMain, this))
+      break;
+  if (nbrImageWorkers > 0)
+    imageWorkers.Start(nbrImageWorkers);
+}
+
+/* Stops the loaders and drops whatever hasn't been uploaded; no callbacks. */
+void TextureStreamer::ShutdownRenderingContext()
+{
+  {
+    ScopedLock lock(mutex);
+    stopping = true;
+    wake.Broadcast();
+  }
+  for (int i = 0; i < nbrLoaders; i++)
+    loaders[i].Join();
+  nbrLoaders = 0;
+  imageWorkers.Stop();
+
+  for (size_t j = 0; j < jobs.size(); j++)
+  {
+    if (jobs[j]->pStaging != NULL)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[jobs[j]->buffer]);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    delete jobs[j];
+  }
+  jobs.clear();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (buffers[0] != 0)
+    glDeleteBuffers(TEXTURE_STAGING_BUFFERS, buffers);
+  for (int i = 0; i < TEXTURE_STAGING_BUFFERS; i++)
+  {
+    buffers[i] = 0;
+    bufferInUse[i] = false;
+  }
+}
+
+void TextureStreamer::Load(GLuint texture, const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode,
+                           TextureStreamedFunction callback, void *pContext, int firstLevel)
+{
+  SetPlaceholder(texture);
+  Request(texture, szFileName, minFilter, magFilter, wrapMode, callback, pContext, firstLevel);
+}
+
+void TextureStreamer::Reload(GLuint texture, const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode,
+                             TextureStreamedFunction callback, void *pContext, int firstLevel)
+{
+  Request(texture, szFileName, minFilter, magFilter, wrapMode, callback, pContext, firstLevel);
+}
+
+/* A single texel is a complete texture for any filter, mipmapped or not; the
+   other levels are emptied, to give back whatever they held. */
+void TextureStreamer::SetPlaceholder(GLuint texture)
+{
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, TEXTURE_PLACEHOLDER_COLOR);
+  ClearLevels(1, KTX_MAX_LEVELS);
+}
+
+void TextureStreamer::Request(GLuint texture, const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode,
+                              TextureStreamedFunction callback, void *pContext, int firstLevel)
+{
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+
+  /* No loader threads: load it here and now */
+  if (nbrLoaders == 0)
+  {
+    std::string ktxFileName = GetKTXFileName(szFileName);
+    KTXImage ktx;
+    MappedBMP image;
+    TGAImage tga;
+    bool isTGA = IsTGAFileName(szFileName);
+    bool loaded = true;
+    if (FileExists(ktxFileName.c_str()) && ktx.Open(ktxFileName.c_str()))
+    {
+      firstLevel = (firstLevel < ktx.GetLevelCount()) ? firstLevel : ktx.GetLevelCount() - 1;
+      ktx.TexImage2D(GL_TEXTURE_2D, !KTXImage::CanUploadCompressed(), firstLevel);
+      ClearLevels(0, firstLevel);
+      if (ktx.NeedsMipmaps())
+        GenerateMipmaps(minFilter);
+    }
+    else if (isTGA ? tga.Open(szFileName) : image.Open(szFileName))
+    {
+      GLint width, height;
+      int nbrLevels;
+      std::vector<GLubyte> pixels(GetCopySize(isTGA ? tga.GetWidth() : image.GetWidth(), isTGA ? tga.GetHeight() : image.GetHeight(),
+                                              firstLevel, IsMipmapped(minFilter), width, height, nbrLevels));
+      CopyImage(isTGA ? NULL : &image, isTGA ? &tga : NULL, firstLevel, nbrLevels, &pixels[0]);
+      UploadBMP(width, height, firstLevel, nbrLevels, &pixels[0]);
+    }
+    else
+      loaded = false;
+    if (callback != NULL)
+      callback(texture, loaded, pContext);
+    return;
+  }
+
+  Job *pJob = NewJob(texture, szFileName, callback, pContext);
+  pJob->minFilter = minFilter;
+  pJob->magFilter = magFilter;
+  pJob->wrapMode = wrapMode;
+  pJob->firstLevel = firstLevel;
+  pJob->ktxFileName = GetKTXFileName(szFileName);
+  Queue(pJob);
+}
+
+void TextureStreamer::LoadLayer(GLuint arrayTexture, GLint layer, GLint width, GLint height, const char *szFileName,
+                                TextureStreamedFunction callback, void *pContext)
+{
+  int nbrLevels = GetMipLevelCount(width, height);
+
+  /* No loader threads: load it here and now */
+  if (nbrLoaders == 0)
+  {
+    MappedBMP image;
+    TGAImage tga;
+    bool isTGA = IsTGAFileName(szFileName);
+    bool loaded = isTGA ? tga.Open(szFileName) : image.Open(szFileName);
+    if (loaded)
+    {
+      std::vector<GLubyte> pixels(GetRGBAMipChainSize(width, height, nbrLevels));
+      CopyLayer(isTGA ? NULL : &image, isTGA ? &tga : NULL, width, height, nbrLevels, &pixels[0]);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+      UploadLayer(layer, width, height, nbrLevels, &pixels[0]);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    if (callback != NULL)
+      callback(arrayTexture, loaded, pContext);
+    return;
+  }
+
+  Job *pJob = NewJob(arrayTexture, szFileName, callback, pContext);
+  pJob->layer = layer;
+  pJob->width = width;
+  pJob->height = height;
+  pJob->nbrLevels = nbrLevels;
+  Queue(pJob);
+}
+
+/* A job for a 2D texture's whole image, until the caller says otherwise */
+TextureStreamer::Job *TextureStreamer::NewJob(GLuint texture, const char *szFileName, TextureStreamedFunction callback, void *pContext)
+{
+  Job *pJob = new Job;
+  pJob->texture = texture;
+  pJob->szFileName = szFileName;
+  pJob->minFilter = GL_LINEAR_MIPMAP_LINEAR;
+  pJob->magFilter = GL_LINEAR;
+  pJob->wrapMode = GL_CLAMP_TO_EDGE;
+  pJob->callback = callback;
+  pJob->pContext = pContext;
+  pJob->firstLevel = 0;
+  pJob->layer = -1;
+  pJob->state = JOB_QUEUED;
+  pJob->isKTX = false;
+  pJob->isTGA = IsTGAFileName(szFileName);
+  pJob->width = pJob->height = 0;
+  pJob->nbrLevels = 0;
+  pJob->size = 0;
+  pJob->buffer = -1;
+  pJob->pStaging = NULL;
+  return pJob;
+}
+
+void TextureStreamer::Queue(Job *pJob)
+{
+  ScopedLock lock(mutex);
+  jobs.push_back(pJob);
+  wake.Signal();
+}
+
+/* Takes the oldest job that needs a loader: opening a queued file, or copying
+   into a buffer the GL thread has staged. */
+void TextureStreamer::LoaderMain(void *pSelf)
+{
+  TextureStreamer *self = static_cast<TextureStreamer*>(pSelf);
+
+  for (;;)
+  {
+    Job *pJob = NULL;
+    {
+      ScopedLock lock(self->mutex);
+      while (!self->stopping && pJob == NULL)
+      {
+        for (size_t j = 0; j < self->jobs.size() && pJob == NULL; j++)
+          if (self->jobs[j]->state == JOB_QUEUED || self->jobs[j]->state == JOB_STAGING)
+            pJob = self->jobs[j];
+        if (pJob == NULL)
+          self->wake.Wait(self->mutex);
+      }
+      if (self->stopping)
+        return;
+      pJob->state = (pJob->state == JOB_QUEUED) ? JOB_OPENING : JOB_COPYING;
+    }
+
+    JobState next;
+    if (pJob->state == JOB_OPENING)
+    {
+      next = JOB_FAILED;
+      if (pJob->layer < 0 && FileExists(pJob->ktxFileName.c_str()) && pJob->ktx.Open(pJob->ktxFileName.c_str()))
+      {
+        int nbrLevels = pJob->ktx.GetLevelCount();
+        pJob->isKTX = true;
+        pJob->firstLevel = (pJob->firstLevel < nbrLevels) ? pJob->firstLevel : nbrLevels - 1;
+        pJob->size = pJob->ktx.GetUploadSize(self->decodeCompressed, pJob->firstLevel);
+        next = JOB_OPENED;
+      }
+      else if (pJob->isTGA ? pJob->tga.Open(pJob->szFileName) : pJob->image.Open(pJob->szFileName))
+      {
+        if (pJob->layer >= 0)
+          pJob->size = GetRGBAMipChainSize(pJob->width, pJob->height, pJob->nbrLevels);
+        else
+          pJob->size = GetCopySize(pJob->isTGA ? pJob->tga.GetWidth() : pJob->image.GetWidth(),
+                                   pJob->isTGA ? pJob->tga.GetHeight() : pJob->image.GetHeight(),
+                                   pJob->firstLevel, IsMipmapped(pJob->minFilter), pJob->width, pJob->height, pJob->nbrLevels);
+        next = JOB_OPENED;
+      }
+    }
+    else if (pJob->isKTX)
+    {
+      pJob->ktx.CopyLevels(pJob->pStaging, self->decodeCompressed, pJob->firstLevel);
+      next = JOB_COPIED;
+    }
+    else
+    {
+      if (pJob->layer >= 0)
+        self->CopyLayer(pJob->isTGA ? NULL : &pJob->image, pJob->isTGA ? &pJob->tga : NULL,
+                        pJob->width, pJob->height, pJob->nbrLevels, pJob->pStaging);
+      else
+        self->CopyImage(pJob->isTGA ? NULL : &pJob->image, pJob->isTGA ? &pJob->tga : NULL,
+                        pJob->firstLevel, pJob->nbrLevels, pJob->pStaging);
+      pJob->image.Close();
+      pJob->tga.Close();
+      next = JOB_COPIED;
+    }
+
+    ScopedLock lock(self->mutex);
+    pJob->state = next;
+  }
+}
+
+/* Once a frame: upload what the loaders have copied, and stage buffers for what they've opened. */
+void TextureStreamer::Update()
+{
+  std::vector<Job*> finished, opened;
+  int i, uploads = 0;
+
+  {
+    ScopedLock lock(mutex);
+    for (size_t j = 0; j < jobs.size(); )
+    {
+      Job *pJob = jobs[j];
+      if (pJob->state == JOB_FAILED || (pJob->state == JOB_COPIED && uploads < TEXTURE_UPLOADS_PER_FRAME))
+      {
+        if (pJob->state == JOB_COPIED)
+          uploads++;
+        finished.push_back(pJob);
+        jobs.erase(jobs.begin() + j);
+        continue;
+      }
+      if (pJob->state == JOB_OPENED)
+        opened.push_back(pJob);
+      j++;
+    }
+  }
+
+  for (size_t j = 0; j < finished.size(); j++)
+    Finish(finished[j]);
+
+  /* Orphan each buffer before mapping it, so its last upload needn't finish first */
+  bool staged = false;
+  for (size_t j = 0; j < opened.size(); j++)
+  {
+    for (i = 0; i < TEXTURE_STAGING_BUFFERS && bufferInUse[i]; i++)
+      ;
+    if (i == TEXTURE_STAGING_BUFFERS)
+      break;
+
+    Job *pJob = opened[j];
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, pJob->size, NULL, GL_STREAM_DRAW);
+    GLubyte *pStaging = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+    ScopedLock lock(mutex);
+    if (pStaging == NULL)
+      pJob->state = JOB_FAILED;
+    else
+    {
+      bufferInUse[i] = true;
+      pJob->buffer = i;
+      pJob->pStaging = pStaging;
+      pJob->state = JOB_STAGING;
+      staged = true;
+    }
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if (staged)
+  {
+    ScopedLock lock(mutex);
+    wake.Broadcast();
+  }
+}
+
+void TextureStreamer::Finish(Job *pJob)
+{
+  bool loaded = (pJob->state == JOB_COPIED);
+
+  if (pJob->pStaging != NULL)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[pJob->buffer]);
+    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE)
+      loaded = false;  /* contents were lost; keep the placeholder */
+
+    if (loaded && pJob->isKTX)
+    {
+      glBindTexture(GL_TEXTURE_2D, pJob->texture);
+      pJob->ktx.TexImage2D(GL_TEXTURE_2D, (const GLubyte*)0, decodeCompressed, pJob->firstLevel);
+      ClearLevels(0, pJob->firstLevel);
+      if (pJob->ktx.NeedsMipmaps())
+        GenerateMipmaps(pJob->minFilter);
+    }
+    else if (loaded && pJob->layer >= 0)
+    {
+      glBindTexture(GL_TEXTURE_2D_ARRAY, pJob->texture);
+      UploadLayer(pJob->layer, pJob->width, pJob->height, pJob->nbrLevels, (const GLubyte*)0);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    else if (loaded)
+    {
+      glBindTexture(GL_TEXTURE_2D, pJob->texture);
+      UploadBMP(pJob->width, pJob->height, pJob->firstLevel, pJob->nbrLevels, (const GLubyte*)0);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    bufferInUse[pJob->buffer] = false;
+  }
+
+  if (pJob->callback != NULL)
+    pJob->callback(pJob->texture, loaded, pJob->pContext);
+  delete pJob;
+}
+
+/* The image at firstLevel is the file's halved that many times, down to 1x1;
+   mipmapped, the levels below it follow, down to 1x1 too. */
+size_t TextureStreamer::GetCopySize(GLint imageWidth, GLint imageHeight, int firstLevel, bool mipmapped,
+                                    GLint &width, GLint &height, int &nbrLevels)
+{
+  width = (imageWidth >> firstLevel) > 0 ? (imageWidth >> firstLevel) : 1;
+  height = (imageHeight >> firstLevel) > 0 ? (imageHeight >> firstLevel) : 1;
+  nbrLevels = mipmapped ? GetMipLevelCount(width, height) : 1;
+  return GetRGBAMipChainSize(width, height, nbrLevels);
+}
+
+/* RGBA levels from firstLevel on, back to back. The file's own size and the
+   levels down to firstLevel are built aside, only to be halved again. One of
+   pBMP and pTGA is the open image. */
+void TextureStreamer::CopyImage(const MappedBMP *pBMP, const TGAImage *pTGA, int firstLevel, int nbrLevels, GLubyte *pDst)
+{
+  WorkerPool *pWorkers = (imageWorkers.GetWorkerCount() > 0) ? &imageWorkers : NULL;
+  if (pWorkers != NULL)
+    imageMutex.Lock();
+
+  GLint width = pTGA ? pTGA->GetWidth() : pBMP->GetWidth(), height = pTGA ? pTGA->GetHeight() : pBMP->GetHeight();
+  std::vector<GLubyte> scratch[2];
+  const GLubyte *pLevel = pDst;
+  if (firstLevel == 0)
+    ConvertImage(pBMP, pTGA, pDst);
+  else
+  {
+    scratch[0].resize(GetRGBAMipChainSize(width, height, 1));
+    ConvertImage(pBMP, pTGA, &scratch[0][0]);
+    pLevel = &scratch[0][0];
+    for (int level = 1; level <= firstLevel; level++)
+    {
+      GLint nextWidth = (width > 1) ? width / 2 : 1, nextHeight = (height > 1) ? height / 2 : 1;
+      GLubyte *pNext = pDst;
+      if (level < firstLevel)
+      {
+        scratch[level & 1].resize(GetRGBAMipChainSize(nextWidth, nextHeight, 1));
+        pNext = &scratch[level & 1][0];
+      }
+      DownsampleRGBA(pLevel, width, height, pNext, pWorkers);
+      pLevel = pNext;
+      width = nextWidth;
+      height = nextHeight;
+    }
+  }
+
+  BuildRGBAMipChain(pDst, width, height, nbrLevels, pWorkers);
+
+  if (pWorkers != NULL)
+    imageMutex.Unlock();
+}
+
+/* The image resampled to width x height, then its levels down to 1x1 */
+void TextureStreamer::CopyLayer(const MappedBMP *pBMP, const TGAImage *pTGA, GLint width, GLint height, int nbrLevels, GLubyte *pDst)
+{
+  WorkerPool *pWorkers = (imageWorkers.GetWorkerCount() > 0) ? &imageWorkers : NULL;
+  if (pWorkers != NULL)
+    imageMutex.Lock();
+
+  GLint imageWidth = pTGA ? pTGA->GetWidth() : pBMP->GetWidth(), imageHeight = pTGA ? pTGA->GetHeight() : pBMP->GetHeight();
+  std::vector<GLubyte> image(GetRGBAMipChainSize(imageWidth, imageHeight, 1));
+  ConvertImage(pBMP, pTGA, &image[0]);
+  ResampleRGBA(&image[0], imageWidth, imageHeight, pDst, width, height, pWorkers);
+  BuildRGBAMipChain(pDst, width, height, nbrLevels, pWorkers);
+
+  if (pWorkers != NULL)
+    imageMutex.Unlock();
+}
+
+/* A TGA's packets have to be decoded in order, so only a BMP's rows are split up */
+void TextureStreamer::ConvertImage(const MappedBMP *pBMP, const TGAImage *pTGA, GLubyte *pDst)
+{
+  if (pTGA != NULL)
+    pTGA->DecodeRGBA(pDst);
+  else
+    ConvertBMP(*pBMP, pDst);
+}
+
+struct ConvertBMPJob
+{
+  const MappedBMP *pImage;
+  GLubyte         *pDst;
+};
+
+/* Bottom row first, as GL wants it, whichever way round the file is */
+void TextureStreamer::ConvertBMP(const MappedBMP &image, GLubyte *pDst)
+{
+  ConvertBMPJob job;
+  job.pImage = &image;
+  job.pDst = pDst;
+  if (imageWorkers.GetWorkerCount() > 0)
+    imageWorkers.ParallelFor(image.GetHeight(), ConvertBMPRows, &job, IMAGE_ROWS_PER_WORKER);
+  else
+    ConvertBMPRows(0, image.GetHeight(), &job);
+}
+
+void TextureStreamer::ConvertBMPRows(int first, int last, void *pContext)
+{
+  const ConvertBMPJob *pJob = static_cast<const ConvertBMPJob*>(pContext);
+  int width = pJob->pImage->GetWidth();
+  for (int y = first; y < last; y++)
+    ConvertBGRToRGBA(pJob->pImage->GetRow(y), pJob->pImage->GetBytesPerPixel(), width, pJob->pDst + 4 * (size_t)width * y);
+}
+
+/* The RGBA texels go into an RGB texture: the files' alpha isn't meant to be
+   seen, and the ground blends with its texture's. */
+void TextureStreamer::UploadBMP(GLint width, GLint height, int firstLevel, int nbrLevels, const GLubyte *pPixels)
+{
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, firstLevel + nbrLevels - 1);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int level = firstLevel; level < firstLevel + nbrLevels; level++)
+  {
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+    pPixels += GetRGBAMipChainSize(width, height, 1);
+    width = (width > 1) ? width / 2 : 1;
+    height = (height > 1) ? height / 2 : 1;
+  }
+  ClearLevels(0, firstLevel);
+  ClearLevels(firstLevel + nbrLevels, KTX_MAX_LEVELS);
+}
+
+/* Into the bound array texture, whose levels already have their storage */
+void TextureStreamer::UploadLayer(GLint layer, GLint width, GLint height, int nbrLevels, const GLubyte *pPixels)
+{
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  for (int level = 0; level < nbrLevels; level++)
+  {
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pPixels);
+    pPixels += GetRGBAMipChainSize(width, height, 1);
+    width = (width > 1) ? width / 2 : 1;
+    height = (height > 1) ? height / 2 : 1;
+  }
+}
+
+/* Zero sized images free the larger levels a smaller first level leaves behind */
+void TextureStreamer::ClearLevels(int firstLevel, int endLevel)
+{
+  for (int level = firstLevel; level < endLevel; level++)
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+}
+
+bool TextureStreamer::IsMipmapped(GLenum minFilter)
+{
+  switch (minFilter) {
+    case GL_LINEAR_MIPMAP_LINEAR:
+    case GL_LINEAR_MIPMAP_NEAREST:
+    case GL_NEAREST_MIPMAP_LINEAR:
+    case GL_NEAREST_MIPMAP_NEAREST:
+      return true;
+  }
+  return false;
+}
+
+/* Only for KTX files made without their mip levels */
+void TextureStreamer::GenerateMipmaps(GLenum minFilter)
+{
+  if (IsMipmapped(minFilter))
+    glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+/* "Brass.bmp" -> "Brass.ktx" */
+std::string TextureStreamer::GetKTXFileName(const char *szFileName)
+{
+  std::string ktxFileName = szFileName;
+  size_t dot = ktxFileName.rfind('.');
+  if (dot != std::string::npos && ktxFileName.find_first_of("/\\", dot) == std::string::npos)
+    ktxFileName.erase(dot);
+  return ktxFileName + ".ktx";
+}
+
+bool TextureStreamer::IsTGAFileName(const char *szFileName)
+{
+  size_t length = strlen(szFileName);
+  return length >= 4 && (strcmp(szFileName + length - 4, ".tga") == 0 || strcmp(szFileName + length - 4, ".TGA") == 0);
+}
+
+bool TextureStreamer::FileExists(const char *szFileName)
+{
+  FILE *pFile = fopen(szFileName, "rb");
+  if (pFile == NULL)
+    return false;
+  fclose(pFile);
+  return true;
+}
+
+int TextureStreamer::GetPendingCount()
+{
+  ScopedLock lock(mutex);
+  return (int)jobs.size();
+}
+
+#endif
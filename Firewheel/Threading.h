@@ -0,0 +1,330 @@
+//
+//  Threading.h
+//  Firewheel
+//
+//  Thin portable wrappers around the native thread primitives (pthreads, or
+//  the Win32 equivalents), plus a small pool of persistent worker threads for
+//  splitting per-frame CPU work such as computing world matrices.
+//
+
+#ifndef Firewheel_Threading_h
+#define Firewheel_Threading_h
+
+#if defined(__WIN32__) || defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+/* ----- */
+/* Mutex */
+
+class Mutex
+{
+public:
+#if defined(__WIN32__) || defined(_WIN32)
+  Mutex()       { InitializeCriticalSection(&handle); }
+  ~Mutex()      { DeleteCriticalSection(&handle); }
+  void Lock()   { EnterCriticalSection(&handle); }
+  void Unlock() { LeaveCriticalSection(&handle); }
+  CRITICAL_SECTION handle;
+#else
+  Mutex()       { pthread_mutex_init(&handle, NULL); }
+  ~Mutex()      { pthread_mutex_destroy(&handle); }
+  void Lock()   { pthread_mutex_lock(&handle); }
+  void Unlock() { pthread_mutex_unlock(&handle); }
+  pthread_mutex_t handle;
+#endif
+
+private:
+  Mutex(const Mutex&);
+  Mutex& operator=(const Mutex&);
+};
+
+/* Holds a mutex for the lifetime of the enclosing scope. */
+class ScopedLock
+{
+public:
+  ScopedLock(Mutex &m) : mutex(m) { mutex.Lock(); }
+  ~ScopedLock() { mutex.Unlock(); }
+
+private:
+  Mutex &mutex;
+};
+
+/* ------------------ */
+/* Condition variable */
+
+class Condition
+{
+public:
+#if defined(__WIN32__) || defined(_WIN32)
+  Condition()                 { InitializeConditionVariable(&handle); }
+  ~Condition()                { }
+  void Wait(Mutex &m)         { SleepConditionVariableCS(&handle, &m.handle, INFINITE); }
+  void Signal()               { WakeConditionVariable(&handle); }
+  void Broadcast()            { WakeAllConditionVariable(&handle); }
+  CONDITION_VARIABLE handle;
+#else
+  Condition()                 { pthread_cond_init(&handle, NULL); }
+  ~Condition()                { pthread_cond_destroy(&handle); }
+  void Wait(Mutex &m)         { pthread_cond_wait(&handle, &m.handle); }
+  void Signal()               { pthread_cond_signal(&handle); }
+  void Broadcast()            { pthread_cond_broadcast(&handle); }
+  pthread_cond_t handle;
+#endif
+
+private:
+  Condition(const Condition&);
+  Condition& operator=(const Condition&);
+};
+
+/* ------ */
+/* Thread */
+
+typedef void (*ThreadFunction)(void *pArgument);
+
+class Thread
+{
+public:
+  Thread() : running(false), function(NULL), argument(NULL) { }
+  ~Thread() { Join(); }
+
+  bool Start(ThreadFunction func, void *pArgument)
+  {
+    if (running)
+      return false;
+
+    function = func;
+    argument = pArgument;
+#if defined(__WIN32__) || defined(_WIN32)
+    handle = CreateThread(NULL, 0, Trampoline, this, 0, NULL);
+    running = (handle != NULL);
+#else
+    running = (pthread_create(&handle, NULL, Trampoline, this) == 0);
+#endif
+    return running;
+  }
+
+  void Join()
+  {
+    if (!running)
+      return;
+#if defined(__WIN32__) || defined(_WIN32)
+    WaitForSingleObject(handle, INFINITE);
+    CloseHandle(handle);
+#else
+    pthread_join(handle, NULL);
+#endif
+    running = false;
+  }
+
+  bool IsRunning() const { return running; }
+
+private:
+#if defined(__WIN32__) || defined(_WIN32)
+  static DWORD WINAPI Trampoline(LPVOID pSelf)
+  {
+    Thread *self = static_cast<Thread*>(pSelf);
+    self->function(self->argument);
+    return 0;
+  }
+  HANDLE handle;
+#else
+  static void* Trampoline(void *pSelf)
+  {
+    Thread *self = static_cast<Thread*>(pSelf);
+    self->function(self->argument);
+    return NULL;
+  }
+  pthread_t handle;
+#endif
+
+  bool running;
+  ThreadFunction function;
+  void *argument;
+
+  Thread(const Thread&);
+  Thread& operator=(const Thread&);
+};
+
+/* Number of hardware threads, or 1 if it can't be determined. */
+int GetProcessorCount();
+int GetProcessorCount()
+{
+#if defined(__WIN32__) || defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (int)count : 1;
+#endif
+}
+
+/* ----------- */
+/* Worker pool */
+
+/* Called with a half-open range [first, last) of the items being processed. */
+typedef void (*WorkerRangeFunction)(int first, int last, void *pContext);
+
+const int MAX_WORKER_THREADS = 16;
+
+class WorkerPool
+{
+public:
+  WorkerPool();
+  ~WorkerPool();
+
+  /* Spin up the workers. The calling thread also takes a share of every job,
+     so a pool of N workers splits each job N+1 ways. */
+  void Start(int nbrWorkers);
+  void Stop();
+
+  /* Split [0, count) into contiguous ranges and run func on each, blocking until
+     all ranges are done. Jobs smaller than minPerThread items per thread are run
+     inline, since waking the workers costs more than the work itself. */
+  void ParallelFor(int count, WorkerRangeFunction func, void *pContext, int minPerThread = 1);
+
+  int GetWorkerCount() const { return nbrWorkers; }
+
+private:
+  struct WorkerSlot
+  {
+    WorkerPool *pool;
+    int index;
+  };
+
+  static void WorkerMain(void *pSlot);
+  void RunShare(int share);
+
+  Thread     workers[MAX_WORKER_THREADS];
+  WorkerSlot slots[MAX_WORKER_THREADS];
+  int        nbrWorkers;
+
+  Mutex      mutex;
+  Condition  wake;
+  Condition  done;
+  bool       stopping;
+  unsigned   generation;
+  int        pending;
+
+  /* Current job */
+  WorkerRangeFunction jobFunction;
+  void      *jobContext;
+  int        jobCount;
+  int        jobShares;
+};
+
+WorkerPool::WorkerPool()
+  : nbrWorkers(0), stopping(false), generation(0), pending(0),
+    jobFunction(NULL), jobContext(NULL), jobCount(0), jobShares(1)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+  Stop();
+}
+
+void WorkerPool::Start(int count)
+{
+  Stop();
+
+  if (count > MAX_WORKER_THREADS)
+    count = MAX_WORKER_THREADS;
+
+  stopping = false;
+  for (int i = 0; i < count; i++)
+  {
+    slots[i].pool = this;
+    slots[i].index = i;
+    if (!workers[i].Start(WorkerMain, &slots[i]))
+      break;
+    nbrWorkers++;
+  }
+}
+
+void WorkerPool::Stop()
+{
+  {
+    ScopedLock lock(mutex);
+    stopping = true;
+    wake.Broadcast();
+  }
+
+  for (int i = 0; i < nbrWorkers; i++)
+    workers[i].Join();
+  nbrWorkers = 0;
+}
+
+void WorkerPool::RunShare(int share)
+{
+  int first = (int)((long long)jobCount * share / jobShares);
+  int last  = (int)((long long)jobCount * (share + 1) / jobShares);
+  if (first < last)
+    jobFunction(first, last, jobContext);
+}
+
+void WorkerPool::WorkerMain(void *pSlot)
+{
+  WorkerSlot *slot = static_cast<WorkerSlot*>(pSlot);
+  WorkerPool *pool = slot->pool;
+  unsigned seen = 0;
+
+  for (;;)
+  {
+    {
+      ScopedLock lock(pool->mutex);
+      while (!pool->stopping && pool->generation == seen)
+        pool->wake.Wait(pool->mutex);
+      if (pool->stopping)
+        return;
+      seen = pool->generation;
+    }
+
+    /* Share 0 belongs to the calling thread. */
+    if (slot->index + 1 < pool->jobShares)
+      pool->RunShare(slot->index + 1);
+
+    ScopedLock lock(pool->mutex);
+    if (--pool->pending == 0)
+      pool->done.Signal();
+  }
+}
+
+void WorkerPool::ParallelFor(int count, WorkerRangeFunction func, void *pContext, int minPerThread)
+{
+  if (count <= 0)
+    return;
+
+  int shares = nbrWorkers + 1;
+  if (minPerThread > 1 && count / minPerThread < shares)
+    shares = count / minPerThread;
+
+  if (shares <= 1 || nbrWorkers == 0)
+  {
+    func(0, count, pContext);
+    return;
+  }
+
+  {
+    ScopedLock lock(mutex);
+    jobFunction = func;
+    jobContext = pContext;
+    jobCount = count;
+    jobShares = shares;
+    pending = nbrWorkers;
+    generation++;
+    wake.Broadcast();
+  }
+
+  RunShare(0);
+
+  ScopedLock lock(mutex);
+  while (pending > 0)
+    done.Wait(mutex);
+}
+
+#endif
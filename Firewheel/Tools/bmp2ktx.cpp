@@ -0,0 +1,390 @@
+//
+//  bmp2ktx.cpp
+//  Firewheel
+//
+//  Converts the park's BMP textures to KTX files holding their whole mip chain,
+//  DXT1 (the default), DXT5 or uncompressed RGB8, for KTXImage to load:
+//
+//    bmp2ktx [-dxt1 | -dxt5 | -rgb8] image.bmp [image.ktx]
+//
+//  TextureStreamer picks up a .ktx next to a .bmp of the same name. Needs no
+//  context, only the core OpenGL library that MappedBMP's upload links to (use
+//  -lGL elsewhere); built on its own, from the Firewheel directory:
+//
+//    c++ -O2 -IGLTools/include -IGLTools/include/GL Tools/bmp2ktx.cpp -o bmp2ktx -framework OpenGL
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../MappedBMP.h"
+#include "../KTXFormat.h"
+
+/* ------------------------------- */
+
+/* An RGBA8 image, bottom row first like OpenGL's */
+struct Image
+{
+  int width, height;
+  std::vector<GLubyte> texels;
+};
+
+void LoadImage(const MappedBMP &bmp, Image &image);
+void HalveImage(const Image &src, Image &dst);
+unsigned int EncodeRGB565(const float color[3]);
+void EncodeDXT1Block(const GLubyte texels[16][4], GLubyte *pBlock);
+void EncodeDXT5AlphaBlock(const GLubyte texels[16][4], GLubyte *pBlock);
+void EncodeLevel(const Image &image, GLenum internalFormat, std::vector<GLubyte> &data);
+void WriteLong(FILE *pFile, unsigned long value);
+bool WriteKTX(const char *szFileName, GLenum internalFormat, const std::vector< std::vector<GLubyte> > &levels,
+              int width, int height);
+
+/* ------------------------------- */
+
+int main(int argc, char* argv[])
+{
+  GLenum internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  int arg = 1;
+  if (arg < argc && strcmp(argv[arg], "-dxt1") == 0)
+    arg++;
+  else if (arg < argc && strcmp(argv[arg], "-dxt5") == 0)
+    internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, arg++;
+  else if (arg < argc && strcmp(argv[arg], "-rgb8") == 0)
+    internalFormat = GL_RGB8, arg++;
+
+  if (arg >= argc || argc - arg > 2)
+  {
+    fprintf(stderr, "usage: %s [-dxt1 | -dxt5 | -rgb8] image.bmp [image.ktx]\n", argv[0]);
+    return 1;
+  }
+
+  /* The output goes next to the input unless named */
+  std::string outputName;
+  if (arg + 1 < argc)
+    outputName = argv[arg + 1];
+  else
+  {
+    outputName = argv[arg];
+    size_t dot = outputName.rfind('.');
+    outputName = outputName.substr(0, dot) + ".ktx";
+  }
+
+  MappedBMP bmp;
+  if (!bmp.Open(argv[arg]))
+    return 1;
+
+  Image image[2];
+  LoadImage(bmp, image[0]);
+  bmp.Close();
+  int width = image[0].width, height = image[0].height;
+
+  /* Box filtered down to 1x1 */
+  std::vector< std::vector<GLubyte> > levels;
+  for (int level = 0; ; level++)
+  {
+    const Image &current = image[level % 2];
+    levels.push_back(std::vector<GLubyte>());
+    EncodeLevel(current, internalFormat, levels.back());
+    if (current.width == 1 && current.height == 1)
+      break;
+    HalveImage(current, image[(level + 1) % 2]);
+  }
+
+  if (!WriteKTX(outputName.c_str(), internalFormat, levels, width, height))
+    return 1;
+  return 0;
+}
+
+
+/* ------------------------------------- */
+/* BGR or BGRA rows to RGBA, alpha opaque */
+
+void LoadImage(const MappedBMP &bmp, Image &image)
+{
+  int pixelSize = bmp.GetBytesPerPixel();
+  image.width = bmp.GetWidth();
+  image.height = bmp.GetHeight();
+  image.texels.resize(4 * image.width * image.height);
+
+  for (int y = 0; y < image.height; y++)
+  {
+    const GLubyte *pRow = bmp.GetRow(y);
+    for (int x = 0; x < image.width; x++)
+    {
+      GLubyte *pTexel = &image.texels[4 * (y * image.width + x)];
+      pTexel[0] = pRow[pixelSize * x + 2];
+      pTexel[1] = pRow[pixelSize * x + 1];
+      pTexel[2] = pRow[pixelSize * x];
+      pTexel[3] = (pixelSize == 4) ? pRow[pixelSize * x + 3] : 255;
+    }
+  }
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Average of each 2x2 square; an odd last row or column is counted twice. */
+
+void HalveImage(const Image &src, Image &dst)
+{
+  dst.width = (src.width > 1) ? src.width / 2 : 1;
+  dst.height = (src.height > 1) ? src.height / 2 : 1;
+  dst.texels.resize(4 * dst.width * dst.height);
+
+  for (int y = 0; y < dst.height; y++)
+  {
+    int y0 = 2 * y, y1 = (2 * y + 1 < src.height) ? 2 * y + 1 : 2 * y;
+    for (int x = 0; x < dst.width; x++)
+    {
+      int x0 = 2 * x, x1 = (2 * x + 1 < src.width) ? 2 * x + 1 : 2 * x;
+      for (int c = 0; c < 4; c++)
+      {
+        int sum = src.texels[4 * (y0 * src.width + x0) + c] + src.texels[4 * (y0 * src.width + x1) + c] +
+                  src.texels[4 * (y1 * src.width + x0) + c] + src.texels[4 * (y1 * src.width + x1) + c];
+        dst.texels[4 * (y * dst.width + x) + c] = (GLubyte)((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+
+/* ----------------------------------- */
+/* Rounds each channel to 5, 6, 5 bits */
+
+unsigned int EncodeRGB565(const float color[3])
+{
+  int r = (int)(color[0] * 31.0f / 255.0f + 0.5f), g = (int)(color[1] * 63.0f / 255.0f + 0.5f), b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+  r = (r < 0) ? 0 : (r > 31) ? 31 : r;
+  g = (g < 0) ? 0 : (g > 63) ? 63 : g;
+  b = (b < 0) ? 0 : (b > 31) ? 31 : b;
+  return (unsigned int)((r << 11) | (g << 5) | b);
+}
+
+
+/* ------------------------------------------------------------------------------ */
+/* The end points are the block's extremes along its main axis of color (a few   */
+/* rounds of power iteration on the covariance), then each texel takes whichever */
+/* of the four palette colors is nearest. Always the four color mode.            */
+
+void EncodeDXT1Block(const GLubyte texels[16][4], GLubyte *pBlock)
+{
+  float mean[3] = { 0.0f, 0.0f, 0.0f };
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+      mean[c] += texels[i][c] / 16.0f;
+
+  float covariance[3][3] = { { 0.0f } };
+  for (int i = 0; i < 16; i++)
+    for (int j = 0; j < 3; j++)
+      for (int k = 0; k < 3; k++)
+        covariance[j][k] += (texels[i][j] - mean[j]) * (texels[i][k] - mean[k]);
+
+  float axis[3] = { 1.0f, 1.0f, 1.0f };
+  for (int round = 0; round < 8; round++)
+  {
+    float next[3], length = 0.0f;
+    for (int j = 0; j < 3; j++)
+    {
+      next[j] = covariance[j][0] * axis[0] + covariance[j][1] * axis[1] + covariance[j][2] * axis[2];
+      length += next[j] * next[j];
+    }
+    if (length < 1e-6f)
+      break;
+    length = sqrtf(length);
+    for (int j = 0; j < 3; j++)
+      axis[j] = next[j] / length;
+  }
+
+  float low = 1e9f, high = -1e9f;
+  for (int i = 0; i < 16; i++)
+  {
+    float t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+    if (t < low) low = t;
+    if (t > high) high = t;
+  }
+
+  float end0[3], end1[3];
+  for (int c = 0; c < 3; c++)
+  {
+    end0[c] = mean[c] + axis[c] * high;
+    end1[c] = mean[c] + axis[c] * low;
+  }
+  unsigned int color0 = EncodeRGB565(end0), color1 = EncodeRGB565(end1);
+  if (color0 < color1)
+  {
+    unsigned int swap = color0;
+    color0 = color1;
+    color1 = swap;
+  }
+
+  /* The palette as the decoder will see it */
+  GLubyte palette[4][4];
+  DecodeRGB565(color0, palette[0]);
+  DecodeRGB565(color1, palette[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    palette[2][c] = (GLubyte)((2 * palette[0][c] + palette[1][c]) / 3);
+    palette[3][c] = (GLubyte)((palette[0][c] + 2 * palette[1][c]) / 3);
+  }
+
+  unsigned long indexes = 0;
+  if (color0 != color1)  /* equal ends are the three color mode, where index 0 still works */
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0, bestDistance = 1 << 30;
+      for (int p = 0; p < 4; p++)
+      {
+        int dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < bestDistance)
+          best = p, bestDistance = distance;
+      }
+      indexes |= (unsigned long)best << (2 * i);
+    }
+
+  pBlock[0] = (GLubyte)color0;
+  pBlock[1] = (GLubyte)(color0 >> 8);
+  pBlock[2] = (GLubyte)color1;
+  pBlock[3] = (GLubyte)(color1 >> 8);
+  for (int b = 0; b < 4; b++)
+    pBlock[4 + b] = (GLubyte)(indexes >> (8 * b));
+}
+
+
+/* --------------------------------------------------------------- */
+/* Alpha end points at the block's extremes, eight values between. */
+
+void EncodeDXT5AlphaBlock(const GLubyte texels[16][4], GLubyte *pBlock)
+{
+  int high = 0, low = 255;
+  for (int i = 0; i < 16; i++)
+  {
+    if (texels[i][3] > high) high = texels[i][3];
+    if (texels[i][3] < low) low = texels[i][3];
+  }
+
+  memset(pBlock, 0, 8);
+  pBlock[0] = (GLubyte)high;
+  pBlock[1] = (GLubyte)low;
+  if (high == low)
+    return;
+
+  int alpha[8];
+  alpha[0] = high;
+  alpha[1] = low;
+  for (int i = 1; i < 7; i++)
+    alpha[i + 1] = ((7 - i) * high + i * low) / 7;
+
+  for (int i = 0; i < 16; i++)
+  {
+    int best = 0, bestDistance = 256;
+    for (int p = 0; p < 8; p++)
+    {
+      int distance = abs(texels[i][3] - alpha[p]);
+      if (distance < bestDistance)
+        best = p, bestDistance = distance;
+    }
+    int bit = 3 * i;
+    pBlock[2 + bit / 8] |= (GLubyte)(best << (bit % 8));
+    if (bit % 8 > 5)
+      pBlock[2 + bit / 8 + 1] |= (GLubyte)(best >> (8 - bit % 8));
+  }
+}
+
+
+/* ------------------------------------------------------------------------------- */
+/* One level in the file's layout: blocks in rows, or RGB rows padded to 4 bytes. */
+
+void EncodeLevel(const Image &image, GLenum internalFormat, std::vector<GLubyte> &data)
+{
+  if (internalFormat == GL_RGB8)
+  {
+    size_t rowStride = (3 * image.width + 3) & ~3;
+    data.assign(rowStride * image.height, 0);
+    for (int y = 0; y < image.height; y++)
+      for (int x = 0; x < image.width; x++)
+        memcpy(&data[y * rowStride + 3 * x], &image.texels[4 * (y * image.width + x)], 3);
+    return;
+  }
+
+  int blockSize = (internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ? DXT5_BLOCK_SIZE : DXT1_BLOCK_SIZE;
+  data.resize(((image.width + 3) / 4) * ((image.height + 3) / 4) * blockSize);
+  GLubyte *pBlock = &data[0];
+
+  /* Blocks over the edge repeat the last row and column */
+  GLubyte texels[16][4];
+  for (int y = 0; y < image.height; y += 4)
+    for (int x = 0; x < image.width; x += 4, pBlock += blockSize)
+    {
+      for (int row = 0; row < 4; row++)
+        for (int column = 0; column < 4; column++)
+        {
+          int texelX = (x + column < image.width) ? x + column : image.width - 1;
+          int texelY = (y + row < image.height) ? y + row : image.height - 1;
+          memcpy(texels[4 * row + column], &image.texels[4 * (texelY * image.width + texelX)], 4);
+        }
+
+      if (blockSize == DXT5_BLOCK_SIZE)
+      {
+        EncodeDXT5AlphaBlock(texels, pBlock);
+        EncodeDXT1Block(texels, pBlock + 8);
+      }
+      else
+        EncodeDXT1Block(texels, pBlock);
+    }
+}
+
+
+/* ----------------------------------- */
+/* KTX fields are written little endian */
+
+void WriteLong(FILE *pFile, unsigned long value)
+{
+  GLubyte bytes[4] = { (GLubyte)value, (GLubyte)(value >> 8), (GLubyte)(value >> 16), (GLubyte)(value >> 24) };
+  fwrite(bytes, 1, 4, pFile);
+}
+
+bool WriteKTX(const char *szFileName, GLenum internalFormat, const std::vector< std::vector<GLubyte> > &levels,
+              int width, int height)
+{
+  FILE *pFile = fopen(szFileName, "wb");
+  if (pFile == NULL)
+  {
+    fprintf(stderr, "%s: can't create\n", szFileName);
+    return false;
+  }
+
+  bool compressed = (internalFormat != GL_RGB8);
+  fwrite(KTX_IDENTIFIER, 1, sizeof(KTX_IDENTIFIER), pFile);
+  WriteLong(pFile, KTX_ENDIANNESS);
+  WriteLong(pFile, compressed ? 0 : GL_UNSIGNED_BYTE);     /* glType */
+  WriteLong(pFile, 1);                                     /* glTypeSize */
+  WriteLong(pFile, compressed ? 0 : GL_RGB);               /* glFormat */
+  WriteLong(pFile, internalFormat);
+  WriteLong(pFile, (internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ? GL_RGBA : GL_RGB);
+  WriteLong(pFile, width);
+  WriteLong(pFile, height);
+  WriteLong(pFile, 0);                                     /* depth */
+  WriteLong(pFile, 0);                                     /* array elements */
+  WriteLong(pFile, 1);                                     /* faces */
+  WriteLong(pFile, (unsigned long)levels.size());
+  WriteLong(pFile, 0);                                     /* key/value data */
+
+  const GLubyte padding[3] = { 0, 0, 0 };
+  for (size_t level = 0; level < levels.size(); level++)
+  {
+    WriteLong(pFile, (unsigned long)levels[level].size());
+    fwrite(&levels[level][0], 1, levels[level].size(), pFile);
+    fwrite(padding, 1, (4 - levels[level].size() % 4) % 4, pFile);
+  }
+
+  if (fclose(pFile) != 0)
+  {
+    fprintf(stderr, "%s: can't write\n", szFileName);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,164 @@
+//
+//  frustum_bench.cpp
+//  Firewheel
+//
+//  Times GLFrustum's batch tests, TestSpheres and TestBoxes, against a loop
+//  of single TestSphere calls over the same random objects, and checks that
+//  each returns the same visible set as testing the objects one at a time:
+//
+//    frustum_bench [objects]
+//
+//  The objects are scattered through a 200 unit cube around a camera with a
+//  35 degree field of view. Built on its own, from the Firewheel directory:
+//
+//    c++ -O2 -IGLTools/include -IGLTools/include/GL Tools/frustum_bench.cpp GLTools/src/math3d.cpp -o frustum_bench
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <GLTools.h>
+#include <GLFrustum.h>
+#include <StopWatch.h>
+
+/* ------------------------------- */
+
+/* Timed runs per test; the fastest counts */
+const int   NBR_RUNS = 20;
+
+const int   DEFAULT_NBR_OBJECTS = 100000;
+const float SCENE_HALF_WIDTH = 100.0f;
+const float MAX_OBJECT_SIZE = 2.0f;
+
+/* ------------------------------- */
+
+/* Structure-of-arrays bounds: centers, radii and box half widths */
+struct Objects
+{
+  std::vector<float> x, y, z, r, ex, ey, ez;
+};
+
+void MakeObjects(Objects &objects, int nbrObjects);
+bool TestBoxOneByOne(const M3DVector4f planes[6], const Objects &objects, int i);
+bool SameVisible(const std::vector<int> &a, int nbrA, const std::vector<int> &b, int nbrB);
+
+/* ------------------------------- */
+
+int main(int argc, char* argv[])
+{
+  int nbrObjects = (argc > 1) ? atoi(argv[1]) : DEFAULT_NBR_OBJECTS;
+  if (argc > 2 || nbrObjects <= 0)
+  {
+    fprintf(stderr, "usage: %s [objects]\n", argv[0]);
+    return 1;
+  }
+
+  Objects objects;
+  MakeObjects(objects, nbrObjects);
+
+  GLFrame camera;
+  camera.RotateWorld(m3dDegToRad(20.0f), 0.0f, 1.0f, 0.0f);
+  GLFrustum frustum(35.0f, 4.0f / 3.0f, 1.0f, SCENE_HALF_WIDTH);
+  frustum.Transform(camera);
+  M3DVector4f planes[6];
+  frustum.GetPlanes(planes);
+
+  /* The references, one object at a time */
+  std::vector<int> sphereReference(nbrObjects), boxReference(nbrObjects), visible(nbrObjects);
+  int nbrSphereReference = 0, nbrBoxReference = 0;
+  double scalarMs = 1.0e30;
+  for (int run = 0; run < NBR_RUNS; run++)
+  {
+    CStopWatch timer;
+    nbrSphereReference = 0;
+    for (int i = 0; i < nbrObjects; i++)
+      if (frustum.TestSphere(objects.x[i], objects.y[i], objects.z[i], objects.r[i]))
+        sphereReference[nbrSphereReference++] = i;
+    scalarMs = fmin(scalarMs, timer.GetElapsedMilliseconds());
+  }
+  for (int i = 0; i < nbrObjects; i++)
+    if (TestBoxOneByOne(planes, objects, i))
+      boxReference[nbrBoxReference++] = i;
+
+  double spheresMs = 1.0e30, boxesMs = 1.0e30;
+  int nbrVisible = 0;
+  bool spheresMatch = true, boxesMatch = true;
+  for (int run = 0; run < NBR_RUNS; run++)
+  {
+    CStopWatch timer;
+    nbrVisible = frustum.TestSpheres(&objects.x[0], &objects.y[0], &objects.z[0], &objects.r[0], nbrObjects, &visible[0]);
+    spheresMs = fmin(spheresMs, timer.GetElapsedMilliseconds());
+    spheresMatch = spheresMatch && SameVisible(visible, nbrVisible, sphereReference, nbrSphereReference);
+
+    timer.Reset();
+    nbrVisible = frustum.TestBoxes(&objects.x[0], &objects.y[0], &objects.z[0],
+                                   &objects.ex[0], &objects.ey[0], &objects.ez[0], nbrObjects, &visible[0]);
+    boxesMs = fmin(boxesMs, timer.GetElapsedMilliseconds());
+    boxesMatch = boxesMatch && SameVisible(visible, nbrVisible, boxReference, nbrBoxReference);
+  }
+
+#ifdef GLT_FRUSTUM_SSE
+  const char *szPath = "SSE";
+#else
+  const char *szPath = "scalar";
+#endif
+  printf("%d objects, %d spheres and %d boxes visible, ms per pass:\n", nbrObjects, nbrSphereReference, nbrBoxReference);
+  printf("  TestSphere loop    %.3f\n", scalarMs);
+  printf("  TestSpheres (%s)  %.3f, %s TestSphere\n", szPath, spheresMs, spheresMatch ? "matches" : "DIFFERS FROM");
+  printf("  TestBoxes (%s)    %.3f, %s one by one\n", szPath, boxesMs, boxesMatch ? "matches" : "DIFFERS FROM");
+  return (spheresMatch && boxesMatch) ? 0 : 1;
+}
+
+
+/* ---------------------------------------------------- */
+/* Random, but the same every run; each box bounds its  */
+/* sphere's center with half widths up to the radius.   */
+
+void MakeObjects(Objects &objects, int nbrObjects)
+{
+  std::vector<float> *components[7] = { &objects.x, &objects.y, &objects.z, &objects.r,
+                                        &objects.ex, &objects.ey, &objects.ez };
+  for (int c = 0; c < 7; c++)
+    components[c]->resize(nbrObjects);
+
+  srand(1);
+  for (int i = 0; i < nbrObjects; i++)
+  {
+    objects.x[i] = SCENE_HALF_WIDTH * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f);
+    objects.y[i] = SCENE_HALF_WIDTH * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f);
+    objects.z[i] = SCENE_HALF_WIDTH * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f);
+    objects.r[i] = MAX_OBJECT_SIZE * (float)rand() / (float)RAND_MAX;
+    objects.ex[i] = objects.r[i] * (float)rand() / (float)RAND_MAX;
+    objects.ey[i] = objects.r[i] * (float)rand() / (float)RAND_MAX;
+    objects.ez[i] = objects.r[i] * (float)rand() / (float)RAND_MAX;
+  }
+}
+
+
+/* ----------------------------------------------------------------- */
+/* A box is outside when its corner farthest along some plane's      */
+/* normal is still behind that plane, the same test as TestBoxes.    */
+
+bool TestBoxOneByOne(const M3DVector4f planes[6], const Objects &objects, int i)
+{
+  for (int p = 0; p < 6; p++)
+  {
+    float distance = objects.x[i] * planes[p][0] + objects.y[i] * planes[p][1] + objects.z[i] * planes[p][2] + planes[p][3];
+    float reach = objects.ex[i] * fabsf(planes[p][0]) + objects.ey[i] * fabsf(planes[p][1]) + objects.ez[i] * fabsf(planes[p][2]);
+    if (distance + reach <= 0.0f)
+      return false;
+  }
+  return true;
+}
+
+bool SameVisible(const std::vector<int> &a, int nbrA, const std::vector<int> &b, int nbrB)
+{
+  if (nbrA != nbrB)
+    return false;
+  for (int i = 0; i < nbrA; i++)
+    if (a[i] != b[i])
+      return false;
+  return true;
+}
@@ -0,0 +1,148 @@
+//
+//  sincos_bench.cpp
+//  Firewheel
+//
+//  Checks m3dSinCosf against double precision libm and times it against
+//  sinf/cosf and sin/cos:
+//
+//    sincos_bench [angles]
+//
+//  The error is measured over random angles within |x| < 1000 and < 10000,
+//  the timing over 1M angles (or as many as given) in [-2 pi, 2 pi], the
+//  range the mesh makers and rotations use. Built on its own, from the
+//  Firewheel directory, with the optimization the app ships with:
+//
+//    c++ -O3 -IGLTools/include Tools/sincos_bench.cpp GLTools/src/math3d.cpp -o sincos_bench
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <math3d.h>
+#include <StopWatch.h>
+
+/* ------------------------------- */
+
+/* Timed runs per method; the fastest counts */
+const int NBR_RUNS = 10;
+
+const int DEFAULT_NBR_ANGLES = 1000000;
+
+/* ------------------------------- */
+
+void FillAngles(std::vector<float> &angles, float range, unsigned int seed);
+void PrintError(const char *szName, const std::vector<float> &angles);
+double TimeSinCosArray(const std::vector<float> &angles, std::vector<float> &sines, std::vector<float> &cosines);
+double TimeSinCosFloat(const std::vector<float> &angles, std::vector<float> &sines, std::vector<float> &cosines);
+double TimeSinCosDouble(const std::vector<float> &angles, std::vector<float> &sines, std::vector<float> &cosines);
+
+/* ------------------------------- */
+
+int main(int argc, char* argv[])
+{
+  int nbrAngles = (argc > 1) ? atoi(argv[1]) : DEFAULT_NBR_ANGLES;
+  if (argc > 2 || nbrAngles <= 0)
+  {
+    fprintf(stderr, "usage: %s [angles]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<float> angles(nbrAngles), sines(nbrAngles), cosines(nbrAngles);
+
+  FillAngles(angles, 1000.0f, 1);
+  PrintError("|x| < 1000", angles);
+  FillAngles(angles, 10000.0f, 2);
+  PrintError("|x| < 10000", angles);
+
+  FillAngles(angles, M3D_2PIf, 3);
+  double arrayNs = TimeSinCosArray(angles, sines, cosines);
+  double floatNs = TimeSinCosFloat(angles, sines, cosines);
+  double doubleNs = TimeSinCosDouble(angles, sines, cosines);
+  printf("sin+cos over %d angles, ns per angle:\n", nbrAngles);
+  printf("  m3dSinCosArrayf  %6.2f\n", arrayNs);
+  printf("  sinf, cosf       %6.2f\n", floatNs);
+  printf("  sin, cos         %6.2f\n", doubleNs);
+  return 0;
+}
+
+
+/* --------------------------------------------------- */
+/* Uniform in [-range, range], the same for every seed */
+
+void FillAngles(std::vector<float> &angles, float range, unsigned int seed)
+{
+  srand(seed);
+  for (size_t i = 0; i < angles.size(); i++)
+    angles[i] = range * (2.0f * (float)rand() / (float)RAND_MAX - 1.0f);
+}
+
+
+/* ------------------------------------------------------------------ */
+/* Largest difference from double precision libm, of the approximation */
+/* and, for comparison, of libm's own single precision functions.      */
+
+void PrintError(const char *szName, const std::vector<float> &angles)
+{
+  double maxError = 0.0, maxLibmError = 0.0;
+  for (size_t i = 0; i < angles.size(); i++)
+  {
+    float s, c;
+    m3dSinCosf(angles[i], s, c);
+    double exactSin = sin((double)angles[i]), exactCos = cos((double)angles[i]);
+    double error = fmax(fabs(s - exactSin), fabs(c - exactCos));
+    double libmError = fmax(fabs(sinf(angles[i]) - exactSin), fabs(cosf(angles[i]) - exactCos));
+    maxError = fmax(maxError, error);
+    maxLibmError = fmax(maxLibmError, libmError);
+  }
+  printf("max abs error for %s: m3dSinCosf %.2g, sinf/cosf %.2g\n", szName, maxError, maxLibmError);
+}
+
+
+/* ------------------------------- */
+/* Best of NBR_RUNS, per angle     */
+
+double TimeSinCosArray(const std::vector<float> &angles, std::vector<float> &sines, std::vector<float> &cosines)
+{
+  double best = 1.0e30;
+  for (int run = 0; run < NBR_RUNS; run++)
+  {
+    CStopWatch timer;
+    m3dSinCosArrayf(&angles[0], &sines[0], &cosines[0], (int)angles.size());
+    best = fmin(best, (double)timer.GetElapsedNanoseconds());
+  }
+  return best / angles.size();
+}
+
+double TimeSinCosFloat(const std::vector<float> &angles, std::vector<float> &sines, std::vector<float> &cosines)
+{
+  double best = 1.0e30;
+  for (int run = 0; run < NBR_RUNS; run++)
+  {
+    CStopWatch timer;
+    for (size_t i = 0; i < angles.size(); i++)
+    {
+      sines[i] = sinf(angles[i]);
+      cosines[i] = cosf(angles[i]);
+    }
+    best = fmin(best, (double)timer.GetElapsedNanoseconds());
+  }
+  return best / angles.size();
+}
+
+double TimeSinCosDouble(const std::vector<float> &angles, std::vector<float> &sines, std::vector<float> &cosines)
+{
+  double best = 1.0e30;
+  for (int run = 0; run < NBR_RUNS; run++)
+  {
+    CStopWatch timer;
+    for (size_t i = 0; i < angles.size(); i++)
+    {
+      sines[i] = (float)sin((double)angles[i]);
+      cosines[i] = (float)cos((double)angles[i]);
+    }
+    best = fmin(best, (double)timer.GetElapsedNanoseconds());
+  }
+  return best / angles.size();
+}
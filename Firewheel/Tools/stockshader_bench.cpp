@@ -0,0 +1,187 @@
+//
+//  stockshader_bench.cpp
+//  Firewheel
+//
+//  Times GLT_SHADER_POINT_LIGHT_DIFF, which takes its modelview projection
+//  and normal matrices from UseStockShader, against the earlier version of
+//  the shader that rebuilt both for every vertex, and checks they draw the
+//  same picture:
+//
+//    stockshader_bench [slices]
+//
+//  A finely tessellated sphere is drawn into a small framebuffer, so the
+//  vertex stage is most of the work. gltMakeSphere merges vertices with a
+//  linear search, so much past 256 slices takes minutes to build.
+//  Runs offscreen through HeadlessContext;
+//  built on its own, from the Firewheel directory, for Mesa's EGL:
+//
+//    c++ -O2 -DFIREWHEEL_HEADLESS_EGL -IGLTools/include -IGLTools/include/GL Tools/stockshader_bench.cpp
+//        GLTools/src/*.cpp GLTools/src/glew.c -o stockshader_bench -lEGL -lGL
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include <GLTools.h>
+#include <GLShaderManager.h>
+#include <GLTriangleBatch.h>
+#include <StopWatch.h>
+
+#include "../HeadlessContext.h"
+
+/* ------------------------------- */
+
+const int   IMAGE_SIZE = 64;
+const int   DEFAULT_SLICES = 128;
+const int   DRAWS_PER_RUN = 100;
+const int   NBR_RUNS = 10;
+
+/* The point light shader as it was, normal matrix and MVP built per vertex */
+const char *szPerVertexVP = "uniform mat4 mvMatrix;"
+                            "uniform mat4 pMatrix;"
+                            "uniform vec3 vLightPos;"
+                            "uniform vec4 vColor;"
+                            "attribute vec4 vVertex;"
+                            "attribute vec3 vNormal;"
+                            "varying vec4 vFragColor;"
+                            "void main(void) { "
+                            " mat3 mNormalMatrix;"
+                            " mNormalMatrix[0] = normalize(mvMatrix[0].xyz);"
+                            " mNormalMatrix[1] = normalize(mvMatrix[1].xyz);"
+                            " mNormalMatrix[2] = normalize(mvMatrix[2].xyz);"
+                            " vec3 vNorm = normalize(mNormalMatrix * vNormal);"
+                            " vec4 ecPosition;"
+                            " vec3 ecPosition3;"
+                            " ecPosition = mvMatrix * vVertex;"
+                            " ecPosition3 = ecPosition.xyz /ecPosition.w;"
+                            " vec3 vLightDir = normalize(vLightPos - ecPosition3);"
+                            " float fDot = max(0.0, dot(vNorm, vLightDir)); "
+                            " vFragColor.rgb = vColor.rgb * fDot;"
+                            " vFragColor.a = vColor.a;"
+                            " mat4 mvpMatrix;"
+                            " mvpMatrix = pMatrix * mvMatrix;"
+                            " gl_Position = mvpMatrix * vVertex; "
+                            "}";
+
+const char *szPerVertexFP = "varying vec4 vFragColor; "
+                            "void main(void) { "
+                            " gl_FragColor = vFragColor; "
+                            "}";
+
+/* ------------------------------- */
+
+GLShaderManager shaderManager;
+GLTriangleBatch sphereBatch;
+GLuint          perVertexProgram;
+M3DMatrix44f    mModelView, mProjection;
+M3DVector3f     vLightPos = { 2.0f, 2.0f, 0.0f };
+M3DVector4f     vColor = { 1.0f, 0.8f, 0.4f, 1.0f };
+
+void UseStockShader();
+void UsePerVertexShader();
+double TimeDraws(void (*UseShader)());
+void ReadImage(std::vector<GLubyte> &pixels);
+
+/* ------------------------------- */
+
+int main(int argc, char* argv[])
+{
+  int slices = (argc > 1) ? atoi(argv[1]) : DEFAULT_SLICES;
+  if (argc > 2 || slices < 3)
+  {
+    fprintf(stderr, "usage: %s [slices]\n", argv[0]);
+    return 1;
+  }
+
+  HeadlessContext headless;
+  if (!headless.Create(IMAGE_SIZE, IMAGE_SIZE))
+    return 1;
+  glViewport(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+  glEnable(GL_DEPTH_TEST);
+
+  shaderManager.InitializeStockShaders();
+  perVertexProgram = gltLoadShaderPairSrcWithAttributes(szPerVertexVP, szPerVertexFP, 2,
+                                                        GLT_ATTRIBUTE_VERTEX, "vVertex", GLT_ATTRIBUTE_NORMAL, "vNormal");
+  gltMakeSphere(sphereBatch, 1.0f, slices, slices / 2);
+
+  /* Scaled down, so the normal matrix's columns do need normalizing */
+  M3DMatrix44f mTranslate, mRotate, mScale, mTemp;
+  m3dTranslationMatrix44(mTranslate, 0.0f, 0.0f, -3.0f);
+  m3dRotationMatrix44(mRotate, m3dDegToRad(30.0f), 1.0f, 1.0f, 0.0f);
+  m3dScaleMatrix44(mScale, 0.8f, 0.8f, 0.8f);
+  m3dMatrixMultiply44(mTemp, mTranslate, mRotate);
+  m3dMatrixMultiply44(mModelView, mTemp, mScale);
+  m3dMakePerspectiveMatrix(mProjection, m3dDegToRad(35.0f), 1.0f, 1.0f, 10.0f);
+
+  /* The first draws pay for the compiles */
+  std::vector<GLubyte> stockImage, perVertexImage;
+  TimeDraws(UseStockShader);
+  ReadImage(stockImage);
+  TimeDraws(UsePerVertexShader);
+  ReadImage(perVertexImage);
+
+  double stockMs = 1.0e30, perVertexMs = 1.0e30;
+  for (int run = 0; run < NBR_RUNS; run++)
+  {
+    stockMs = fmin(stockMs, TimeDraws(UseStockShader));
+    perVertexMs = fmin(perVertexMs, TimeDraws(UsePerVertexShader));
+  }
+
+  int maxDifference = 0;
+  for (size_t i = 0; i < stockImage.size(); i++)
+    maxDifference = std::max(maxDifference, abs((int)stockImage[i] - (int)perVertexImage[i]));
+
+  printf("%s\n", (const char*)glGetString(GL_RENDERER));
+  printf("sphere of %d triangles, ms per draw:\n", slices * (slices / 2) * 2);
+  printf("  precomputed matrices  %.3f\n", stockMs);
+  printf("  per vertex matrices   %.3f\n", perVertexMs);
+  printf("  largest channel difference between the images: %d\n", maxDifference);
+
+  glDeleteProgram(perVertexProgram);
+  headless.Destroy();
+  return 0;
+}
+
+
+/* ------------------------------- */
+
+void UseStockShader()
+{
+  shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, mModelView, mProjection, vLightPos, vColor);
+}
+
+void UsePerVertexShader()
+{
+  glUseProgram(perVertexProgram);
+  glUniformMatrix4fv(glGetUniformLocation(perVertexProgram, "mvMatrix"), 1, GL_FALSE, mModelView);
+  glUniformMatrix4fv(glGetUniformLocation(perVertexProgram, "pMatrix"), 1, GL_FALSE, mProjection);
+  glUniform3fv(glGetUniformLocation(perVertexProgram, "vLightPos"), 1, vLightPos);
+  glUniform4fv(glGetUniformLocation(perVertexProgram, "vColor"), 1, vColor);
+}
+
+
+/* ------------------------------------------------------- */
+/* DRAWS_PER_RUN draws, to the end of the last one, per draw */
+
+double TimeDraws(void (*UseShader)())
+{
+  glFinish();
+  CStopWatch timer;
+  for (int i = 0; i < DRAWS_PER_RUN; i++)
+  {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    UseShader();
+    sphereBatch.Draw();
+  }
+  glFinish();
+  return timer.GetElapsedMilliseconds() / DRAWS_PER_RUN;
+}
+
+void ReadImage(std::vector<GLubyte> &pixels)
+{
+  pixels.resize(4 * IMAGE_SIZE * IMAGE_SIZE);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, IMAGE_SIZE, IMAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+}
@@ -0,0 +1,180 @@
+//
+//  tga_fuzz.cpp
+//  Firewheel
+//
+//  Feeds TGAImage the corpus in Tools/tga_corpus, then random mutations of the
+//  files in it that decode:
+//
+//    tga_fuzz [-mutations count] [-seed n] file.tga ...
+//
+//  Files named bad_* must be turned away by Open(); any other file must open
+//  and decode. Mutants (truncated, or with a few bytes overwritten) may go
+//  either way, but must never read outside the mapping. That is what the
+//  sanitizers are for; built on its own, from the Firewheel directory:
+//
+//    c++ -g -O1 -fsanitize=address,undefined -IGLTools/include -IGLTools/include/GL Tools/tga_fuzz.cpp -o tga_fuzz
+//
+//  and run as tga_fuzz -mutations 100000 Tools/tga_corpus/*.tga 2>/dev/null,
+//  since Open() reports every file it rejects on stderr.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../TGAImage.h"
+
+/* ------------------------------- */
+
+const int DEFAULT_NBR_MUTATIONS = 10000;
+const unsigned int DEFAULT_SEED = 1;
+
+/* Where each mutant is written for TGAImage to map */
+const char MUTANT_FILENAME[] = "tga_fuzz_mutant.tga";
+
+/* Bytes overwritten in a mutant that isn't truncated */
+const int MAX_MUTATED_BYTES = 4;
+
+bool ReadFile(const char *szFileName, std::vector<unsigned char> &bytes);
+bool WriteFile(const char *szFileName, const std::vector<unsigned char> &bytes);
+bool IsBadFileName(const char *szFileName);
+bool OpenAndDecode(const char *szFileName, GLint *pWidth, GLint *pHeight);
+void Mutate(const std::vector<unsigned char> &original, std::vector<unsigned char> &mutant);
+
+/* ------------------------------- */
+
+int main(int argc, char* argv[])
+{
+  int nbrMutations = DEFAULT_NBR_MUTATIONS;
+  unsigned int seed = DEFAULT_SEED;
+  std::vector<const char*> fileNames;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-mutations") == 0 && i + 1 < argc)
+      nbrMutations = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+      seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+    else
+      fileNames.push_back(argv[i]);
+  }
+  if (fileNames.empty() || nbrMutations < 0)
+  {
+    fprintf(stderr, "usage: %s [-mutations count] [-seed n] file.tga ...\n", argv[0]);
+    return 1;
+  }
+
+  /* The corpus, each file as its name says */
+  int nbrUnexpected = 0;
+  std::vector<std::vector<unsigned char> > decodable;
+  for (size_t i = 0; i < fileNames.size(); i++)
+  {
+    GLint width = 0, height = 0;
+    bool decoded = OpenAndDecode(fileNames[i], &width, &height);
+    bool expected = (decoded != IsBadFileName(fileNames[i]));
+    if (decoded)
+      printf("%s: decoded %dx%d%s\n", fileNames[i], width, height, expected ? "" : "  UNEXPECTED");
+    else
+      printf("%s: rejected%s\n", fileNames[i], expected ? "" : "  UNEXPECTED");
+    if (!expected)
+      nbrUnexpected++;
+
+    std::vector<unsigned char> bytes;
+    if (decoded && ReadFile(fileNames[i], bytes))
+      decodable.push_back(bytes);
+  }
+
+  /* Mutants of the files that decode */
+  int nbrMutantsDecoded = 0;
+  if (!decodable.empty() && nbrMutations > 0)
+  {
+    srand(seed);
+    std::vector<unsigned char> mutant;
+    for (int i = 0; i < nbrMutations; i++)
+    {
+      Mutate(decodable[i % decodable.size()], mutant);
+      if (!WriteFile(MUTANT_FILENAME, mutant))
+      {
+        fprintf(stderr, "%s: can't write\n", MUTANT_FILENAME);
+        return 1;
+      }
+      if (OpenAndDecode(MUTANT_FILENAME, NULL, NULL))
+        nbrMutantsDecoded++;
+    }
+    remove(MUTANT_FILENAME);
+  }
+
+  printf("%d of %d files as expected\n", (int)fileNames.size() - nbrUnexpected, (int)fileNames.size());
+  if (nbrMutations > 0 && !decodable.empty())
+    printf("%d mutants of %d files: %d decoded, %d rejected\n", nbrMutations, (int)decodable.size(),
+           nbrMutantsDecoded, nbrMutations - nbrMutantsDecoded);
+  return (nbrUnexpected == 0) ? 0 : 1;
+}
+
+/* ------------------------------- */
+
+bool ReadFile(const char *szFileName, std::vector<unsigned char> &bytes)
+{
+  bytes.clear();
+  FILE *pFile = fopen(szFileName, "rb");
+  if (pFile == NULL)
+    return false;
+  unsigned char buffer[4096];
+  size_t nbrRead;
+  while ((nbrRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+    bytes.insert(bytes.end(), buffer, buffer + nbrRead);
+  fclose(pFile);
+  return true;
+}
+
+bool WriteFile(const char *szFileName, const std::vector<unsigned char> &bytes)
+{
+  FILE *pFile = fopen(szFileName, "wb");
+  if (pFile == NULL)
+    return false;
+  bool written = bytes.empty() || fwrite(&bytes[0], bytes.size(), 1, pFile) == 1;
+  return (fclose(pFile) == 0) && written;
+}
+
+bool IsBadFileName(const char *szFileName)
+{
+  const char *szBaseName = strrchr(szFileName, '/');
+  szBaseName = (szBaseName != NULL) ? szBaseName + 1 : szFileName;
+  return strncmp(szBaseName, "bad_", 4) == 0;
+}
+
+/* Decodes into a buffer of exactly the image's size, so an overrun is caught */
+bool OpenAndDecode(const char *szFileName, GLint *pWidth, GLint *pHeight)
+{
+  TGAImage image;
+  if (!image.Open(szFileName))
+    return false;
+
+  std::vector<GLubyte> texels((size_t)image.GetWidth() * image.GetHeight() * 4);
+  image.DecodeRGBA(&texels[0]);
+  if (pWidth != NULL)
+    *pWidth = image.GetWidth();
+  if (pHeight != NULL)
+    *pHeight = image.GetHeight();
+  return true;
+}
+
+/* Either cut short anywhere, or with a few bytes overwritten; the header and the
+   first packets are picked more often than the rest, as most checks are there. */
+void Mutate(const std::vector<unsigned char> &original, std::vector<unsigned char> &mutant)
+{
+  mutant = original;
+  if (rand() % 4 == 0)
+  {
+    mutant.resize(rand() % original.size());
+    return;
+  }
+
+  int nbrBytes = 1 + rand() % MAX_MUTATED_BYTES;
+  for (int i = 0; i < nbrBytes; i++)
+  {
+    size_t limit = (rand() % 2 == 0 && mutant.size() > (size_t)2 * TGA_HEADER_SIZE) ? 2 * TGA_HEADER_SIZE : mutant.size();
+    mutant[rand() % limit] = (unsigned char)(rand() % 256);
+  }
+}
@@ -20,6 +20,9 @@
 #include <cmath>
 #include <ctime>
 
+#include "Culling.h"
+#include "DrawList.h"
+
 #ifdef __APPLE__
 #include <glut/glut.h>
 #else
@@ -31,6 +34,9 @@ const GLfloat TURTLE_BODY_COLOR[] = { .375, 0.2, 0.067, 1.0 };
 const GLfloat TURTLE_LIMB_COLOR[] = { 0.25, 0.4, 0.25, 1.0 };
 const GLfloat TURTLE_SHELL_COLOR[] = { 0.4, 0.3, 0.1, 1.0 };
 
+/* Loose fit around the shell, head and tail, from the offsets used in Draw */
+const GLfloat TURTLE_BOUNDING_CENTER[] = { 0.0f, -0.1f, 0.0f };
+const GLfloat TURTLE_BOUNDING_RADIUS = 0.15f;
 
 class Turtle
 {
@@ -39,7 +45,8 @@ public:
   
   void SetupRenderingContext();
   void Update();
-  void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos);
+  void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos);
+  const BoundingSphere& GetBoundingSphere() const { return bounds; }
   
 private:
   GLTriangleBatch head;
@@ -48,6 +55,8 @@ private:
   GLTriangleBatch arm[2];
   GLTriangleBatch leg[2];
   GLTriangleBatch tail;
+
+  BoundingSphere bounds;
 };
 
 /* ------------------- */
@@ -55,7 +64,7 @@ private:
 
 Turtle::Turtle()
 {
-  
+  SetBoundingSphere(bounds, TURTLE_BOUNDING_CENTER[0], TURTLE_BOUNDING_CENTER[1], TURTLE_BOUNDING_CENTER[2], TURTLE_BOUNDING_RADIUS);
 }
 
 /* -------------------------------------------------- */
@@ -91,7 +100,7 @@ void Turtle::Update()
 /* ------------------------------------ */
 /* Render the components of the Turtle. */
 
-void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos)
+void Turtle::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos)
 {
 	// Get the light position in eye space
 	M3DVector4f	vLightTransformed;
@@ -108,9 +117,7 @@ void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager
 
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(90, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_BODY_COLOR, 0);
-      body.Draw();
+      drawList.AddLit(body, modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_BODY_COLOR);
     modelViewMatrix.PopMatrix();
     
     /* ------------------- */
@@ -119,18 +126,14 @@ void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager
     /* shell top */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(-90, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_SHELL_COLOR, 0);
-      shell[0].Draw();    
+      drawList.AddLit(shell[0], modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_SHELL_COLOR);    
     modelViewMatrix.PopMatrix();
 
     /* shell bottom */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Rotate(90, 1.0, 0.0, 0.0);
       modelViewMatrix.Translate(0.0, 0.0, 0.02);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(), 
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_SHELL_COLOR, 0);
-      shell[1].Draw();    
+      drawList.AddLit(shell[1], modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_SHELL_COLOR);    
     modelViewMatrix.PopMatrix();
 
     /* ------------------- */
@@ -138,9 +141,7 @@ void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager
         
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.11, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_LIMB_COLOR, 0);
-      head.Draw();
+      drawList.AddLit(head, modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_LIMB_COLOR);
     modelViewMatrix.PopMatrix();
     
     /* ----------------- */
@@ -148,17 +149,13 @@ void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager
 
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.04, -0.01, 0.08);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_LIMB_COLOR, 0);
-      arm[0].Draw();
+      drawList.AddLit(arm[0], modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_LIMB_COLOR);
     modelViewMatrix.PopMatrix();
 
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.04, -0.01, -0.08);
       modelViewMatrix.Rotate(180, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_LIMB_COLOR, 0);
-      arm[1].Draw();
+      drawList.AddLit(arm[1], modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_LIMB_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* ----------------- */
@@ -166,17 +163,13 @@ void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager
     
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(-0.04, -0.01, 0.08);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_LIMB_COLOR, 0);
-      leg[0].Draw();
+      drawList.AddLit(leg[0], modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_LIMB_COLOR);
     modelViewMatrix.PopMatrix();
   
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(-0.04, -0.01, -0.08);
       modelViewMatrix.Rotate(180, 1.0, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_LIMB_COLOR, 0);
-      leg[1].Draw();
+      drawList.AddLit(leg[1], modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_LIMB_COLOR);
     modelViewMatrix.PopMatrix();
 
     /* ----------------- */
@@ -185,9 +178,7 @@ void Turtle::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(-0.09, -0.01, 0.0);
       modelViewMatrix.Rotate(-90, 0.0, 1.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, TURTLE_LIMB_COLOR, 0);
-      tail.Draw();
+      drawList.AddLit(tail, modelViewMatrix.GetMatrix(), vLightTransformed, TURTLE_LIMB_COLOR);
     modelViewMatrix.PopMatrix();
     
   modelViewMatrix.PopMatrix();
@@ -23,6 +23,9 @@
 #include <cmath>
 #include <ctime>
 
+#include "Culling.h"
+#include "DrawList.h"
+
 #ifdef __APPLE__
 #include <glut/glut.h>
 #else
@@ -32,6 +35,10 @@
 
 const GLfloat UNICORN_COLOR[] = { .375, 0.2, 0.067, 1.0 };
 
+/* Loose fit around all the cubes, from the offsets used in Draw */
+const GLfloat UNICORN_BOUNDING_CENTER[] = { 0.2f, -0.1f, 0.0f };
+const GLfloat UNICORN_BOUNDING_RADIUS = 0.6f;
+
 class Unicorn
 {
   public:
@@ -39,7 +46,8 @@ class Unicorn
 
     void SetupRenderingContext();
     void Update();
-    void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos);
+    void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos);
+    const BoundingSphere& GetBoundingSphere() const { return bounds; }
 
   private:
     GLBatch head[3];
@@ -53,6 +61,8 @@ class Unicorn
 
     GLBatch tail;
     GLBatch horn;
+
+    BoundingSphere bounds;
 };
 
 /* ------------------- */
@@ -60,7 +70,7 @@ class Unicorn
 
 Unicorn::Unicorn()
 {
-  
+  SetBoundingSphere(bounds, UNICORN_BOUNDING_CENTER[0], UNICORN_BOUNDING_CENTER[1], UNICORN_BOUNDING_CENTER[2], UNICORN_BOUNDING_RADIUS);
 }
 
 /* --------------------------------------------------- */
@@ -90,7 +100,7 @@ void Unicorn::Update()
 /* ------------------------------------- */
 /* Render the components of the Unicorn. */
 
-void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos)
+void Unicorn::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos)
 {
 	// Get the light position in eye space
 	M3DVector4f	vLightTransformed;
@@ -111,9 +121,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix(); 
         modelViewMatrix.Rotate(45, 0.0, 0.0, 1.0);
         modelViewMatrix.Translate(0.4 + i * 0.05, 0.05, 0);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(), 
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-        kneck[i].Draw();
+        drawList.AddLit(kneck[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
       modelViewMatrix.PopMatrix();    
     modelViewMatrix.PopMatrix();
   }
@@ -127,9 +135,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix(); 
         modelViewMatrix.Rotate(-22, 0.0, 0.0, 1.0);
         modelViewMatrix.Translate(0.5 + i*0.045, 0.1, 0);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(), 
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-        head[i].Draw();
+        drawList.AddLit(head[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
       modelViewMatrix.PopMatrix();    
     modelViewMatrix.PopMatrix();
   }
@@ -141,9 +147,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
 
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate( i * 0.1, 0.0, 0.0);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-      body[i].Draw();
+      drawList.AddLit(body[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
     modelViewMatrix.PopMatrix();
   }
 
@@ -154,9 +158,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
     /* front leg right - top */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.3, -0.2 + i*0.02, 0.05);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-      front_leg_right[i].Draw();
+      drawList.AddLit(front_leg_right[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
     modelViewMatrix.PopMatrix();
   }
   for ( i = 4; i < 8; i++ ) {
@@ -166,9 +168,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Rotate(-22, 0.0, 0.0, 1.0);
         modelViewMatrix.Translate(0.3, -0.5 + i*0.02, 0.05);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-        front_leg_right[i].Draw();
+        drawList.AddLit(front_leg_right[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
   }
@@ -183,9 +183,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Rotate(22, 0.0, 0.0, 1.0);
         modelViewMatrix.Translate(0.3, -0.1 + i*0.02, -0.05);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-        front_leg_left[i].Draw();
+        drawList.AddLit(front_leg_left[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
   }
@@ -193,9 +191,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
     /* front leg right - bottom */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.375, -0.375 + i*0.02, -0.05);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-      hind_leg_right[i].Draw();
+      drawList.AddLit(hind_leg_right[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
     modelViewMatrix.PopMatrix();
   }
 
@@ -209,9 +205,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Rotate(22, 0.0, 0.0, 1.0);
         modelViewMatrix.Translate(0.3, -0.1 + i*0.02, 0.05);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-        hind_leg_right[i].Draw();
+        drawList.AddLit(hind_leg_right[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
   }
@@ -219,9 +213,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
     /* hind leg right - bottom */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.025, -0.375 + i*0.02, 0.05);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-      hind_leg_right[i].Draw();
+      drawList.AddLit(hind_leg_right[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
     modelViewMatrix.PopMatrix();
   }
 
@@ -232,9 +224,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
     /* hind leg left - top */
     modelViewMatrix.PushMatrix();
       modelViewMatrix.Translate(0.0, -0.2 + i*0.02, -0.05);
-      shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                   transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-      hind_leg_left[i].Draw();
+      drawList.AddLit(hind_leg_left[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
     modelViewMatrix.PopMatrix();
   }
   for ( i = 4; i < 8; i++ ) {
@@ -244,9 +234,7 @@ void Unicorn::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManage
       modelViewMatrix.PushMatrix();
         modelViewMatrix.Rotate(-22, 0.0, 0.0, 1.0);
         modelViewMatrix.Translate(0.3, -0.5 + i*0.02, -0.05);
-        shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-                                     transformPipeline.GetProjectionMatrix(), vLightTransformed, UNICORN_COLOR, 0);
-        hind_leg_left[i].Draw();
+        drawList.AddLit(hind_leg_left[i], modelViewMatrix.GetMatrix(), vLightTransformed, UNICORN_COLOR);
       modelViewMatrix.PopMatrix();
     modelViewMatrix.PopMatrix();
   }
@@ -19,8 +19,10 @@
 #include <GLFrame.h>
 #include <GLMatrixStack.h>
 #include <GLGeometryTransform.h>
+#include <GLLocalMatrixStack.h>
 #include <cmath>
 #include "CarTextured.h"
+#include "Threading.h"
 
 GLfloat WHITE_VECTOR[]   = { 1.0f, 1.0f, 1.0f, 1.0f };
 GLfloat LIGHT_LOCATION[] = { 2.0f, 8.0f, 5.0f, 1.0f };
@@ -72,15 +74,32 @@ const GLfloat STAND_STANDARD_Y_ROTATION = 135.0f;
 const GLfloat STAND_STANDARD_Y_OFFSET   = -0.05f;
 const GLfloat STAND_STANDARD_Z_OFFSET   = 0.04f;
 
+// Car placement is only handed to a worker pool once there are enough cars
+// per thread to pay for waking the workers. The stock 24-car wheel places all
+// of them in about a microsecond, well under one wake-up, so the park gives the
+// wheel no pool at all.
+const int CAR_MATRICES_PER_THREAD = 64;
+
+// The stand reaches farthest from the hub, further than the cars do.
+const GLfloat WHEEL_BOUNDING_RADIUS = STAND_LENGTH - STAND_STANDARD_Y_OFFSET + STAND_BASE_RADIUS;
+
 class Wheel
 {
 	public:
 		Wheel();
 		void SetupRenderingContext();
 		void Update();
-		void Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos,
+		void Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos,
 						GLuint capTexture[], GLuint wheelTexture[], GLuint wallTexture[][4], GLuint carTexture[], int currentTextureIndex);
+		void SetWorkerPool(WorkerPool *pool);
+		void SetCuller(SceneCuller *sceneCuller);
+		void SetDetailLevel(int level) { detailLevel = level; }
+		int GetDetailLevel() const { return detailLevel; }
+		void GetCarOffset(int car, M3DVector3f vOffset) const;
+		const BoundingSphere& GetBoundingSphere() const { return bounds; }
 	private:
+		static void ComputeCarMatrices(int first, int last, void *pContext);
+
 		GLTriangleBatch ringBatch[2];
 		GLTriangleBatch axleBatch;
 		GLTriangleBatch capBatch[2];
@@ -89,11 +108,60 @@ class Wheel
 		Car wheelCar[NBR_CARS];
 		float currentRotation;
 		float rotationIncrement;
+
+		// World matrix of each car's hanging point, filled in at the start of every Draw
+		GLMatrixBuffer carMatrices;
+		M3DMatrix44f carBaseMatrix;
+		WorkerPool *workers;
+
+		BoundingSphere bounds;
+		SceneCuller *culler;
+		int detailLevel;
+
+		// The stand never moves relative to the wheel, so its draws are recorded once
+		DrawCache standCache;
 };
 
 // Default Constructor
-Wheel::Wheel()
+Wheel::Wheel() : currentRotation(INITIAL_WHEEL_ROTATION), carMatrices(NBR_CARS), workers(NULL), culler(NULL), detailLevel(0)
+{
+	SetBoundingSphere(bounds, 0.0f, 0.0f, 0.0f, WHEEL_BOUNDING_RADIUS);
+}
+
+// Optional pool used to compute the car matrices in parallel.
+void Wheel::SetWorkerPool(WorkerPool *pool)
+{
+	workers = pool;
+}
+
+// Optional culler used to skip cars that are out of view.
+void Wheel::SetCuller(SceneCuller *sceneCuller)
+{
+	culler = sceneCuller;
+}
+
+// Worker body: place cars [first, last) relative to carBaseMatrix. Each call uses its
+// own local stack and writes only its own slots, so ranges can run concurrently.
+void Wheel::ComputeCarMatrices(int first, int last, void *pContext)
 {
+	Wheel *wheel = static_cast<Wheel*>(pContext);
+
+	for (int i = first; i < last; i++)
+	{
+		GLLocalMatrixStack<4> carStack(wheel->carBaseMatrix);
+		carStack.Rotate(i * 360.0f / NBR_CARS, 0.0f, 0.0f, 1.0f);
+		carStack.Translate(SPOKE_LENGTH, 0.0f, 0.0f);
+		wheel->carMatrices.SetMatrix(i, carStack.GetMatrix());
+	}
+}
+
+// Where a car hangs relative to the hub at the current rotation; matches the
+// placement done in ComputeCarMatrices.
+void Wheel::GetCarOffset(int car, M3DVector3f vOffset) const
+{
+	GLfloat sinRot, cosRot;
+	m3dSinCosf(m3dDegToRadf(currentRotation + car * 360.0f / NBR_CARS), sinRot, cosRot);
+	m3dLoadVector3(vOffset, SPOKE_LENGTH * cosRot, SPOKE_LENGTH * sinRot, 0.0f);
 }
 
 // Set up all structures needed to render the Ferris wheel objects.
@@ -132,7 +200,7 @@ void Wheel::Update()
 }
 
 // Render the components of the Ferris wheel.
-void Wheel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager, GLGeometryTransform &transformPipeline, M3DVector4f &vLightEyePos, 
+void Wheel::Draw(GLMatrixStack &modelViewMatrix, DrawList &drawList, M3DVector4f &vLightEyePos, 
 						GLuint capTexture[], GLuint wheelTexture[], GLuint wallTexture[][4], GLuint carTexture[], int currentTextureIndex)
 {
 	// Get the light position in eye space
@@ -149,12 +217,17 @@ void Wheel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
 		// Rotate everything in this Push/Pop section so that the wheel appears to spin.
 		modelViewMatrix.Rotate(currentRotation, 0.0f, 0.0f, 1.0f);
 
+		// Work out where every car hangs before any of the GL work starts.
+		modelViewMatrix.GetMatrix(carBaseMatrix);
+		if (workers != NULL)
+			workers->ParallelFor(NBR_CARS, ComputeCarMatrices, this, CAR_MATRICES_PER_THREAD);
+		else
+			ComputeCarMatrices(0, NBR_CARS, this);
+
 		// Draw the wheel's axle first (since it's the only part of the wheel that's not paired up).
 		modelViewMatrix.PushMatrix();
 			modelViewMatrix.Translate(0.0f, 0.0f, -0.5f * AXLE_LENGTH);
-			shaderManager.UseStockShader(GLT_SHADER_POINT_LIGHT_DIFF, transformPipeline.GetModelViewMatrix(), 
-							transformPipeline.GetProjectionMatrix(), vLightEyePos, AXLE_COLOR);
-			axleBatch.Draw();
+			drawList.AddLit(axleBatch, modelViewMatrix.GetMatrix(), vLightEyePos, AXLE_COLOR);
 		modelViewMatrix.PopMatrix();
 
 		// The rest of the wheel is drawn in pairs of objects.
@@ -162,32 +235,25 @@ void Wheel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
 		{
 			modelViewMatrix.PushMatrix();
 				// Move one ring of the wheel towards the initial viewer position, the other away.
-				glBindTexture(GL_TEXTURE_2D, wheelTexture[1]);
 				modelViewMatrix.PushMatrix();
 					if (i == 0)
 						modelViewMatrix.Translate(0.0f, 0.0f, -0.5f * WHEEL_WIDTH);
 					else
 						modelViewMatrix.Translate(0.0f, 0.0f, 0.5f * WHEEL_WIDTH);
-					shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-													transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_VECTOR, 0);
-					ringBatch[i].Draw();
+					drawList.AddTexturedLit(ringBatch[i], wheelTexture[1], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_VECTOR);
 				modelViewMatrix.PopMatrix();
 
 				// Draw the current ring cap (one slightly closer to the viewer's initial; position, the other slightly farther away.
-				glBindTexture(GL_TEXTURE_2D, capTexture[currentTextureIndex]);
 				modelViewMatrix.PushMatrix();
 					if (i == 0)
 						modelViewMatrix.Translate(0.0f, 0.0f, -CAP_ELEVATION);
 					else
 						modelViewMatrix.Translate(0.0f, 0.0f, CAP_ELEVATION);
 					modelViewMatrix.Rotate(-currentRotation, 0.0f, 0.0f, 1.0f);
-					shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-													transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_VECTOR, 0);
-					capBatch[i].Draw();
+					drawList.AddTexturedLit(capBatch[i], capTexture[currentTextureIndex], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_VECTOR);
 				modelViewMatrix.PopMatrix();
 
 				// Draw the spokes for the current ring.
-				glBindTexture(GL_TEXTURE_2D, wheelTexture[0]);
 				modelViewMatrix.PushMatrix();
 					if (i == 0)
 						modelViewMatrix.Translate(0.0f, 0.0f, -SPOKE_ELEVATION);
@@ -198,9 +264,7 @@ void Wheel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
 						modelViewMatrix.PushMatrix();
 							modelViewMatrix.Rotate(360.0f * j / NBR_CARS, 0.0f, 0.0f, 1.0f);
 							modelViewMatrix.Rotate(90.0f, 0.0f, 1.0f, 0.0f);
-							shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-														transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_VECTOR, 0);
-							spokeBatch[i][j].Draw();
+							drawList.AddTexturedLit(spokeBatch[i][j], wheelTexture[0], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_VECTOR);
 						modelViewMatrix.PopMatrix();
 					}
 				modelViewMatrix.PopMatrix();
@@ -211,30 +275,31 @@ void Wheel::Draw(GLMatrixStack &modelViewMatrix, GLShaderManager &shaderManager,
 		// Draw the wheel's cars at regular intervals.
 		for (i = 0; i < NBR_CARS; i++)
 		{
-			modelViewMatrix.PushMatrix();
+			if (culler != NULL && !culler->IsVisible(wheelCar[i].GetBoundingSphere(), carMatrices.GetMatrix(i)))
+				continue;
+
+			modelViewMatrix.PushMatrix(carMatrices.GetMatrix(i));
 				carRotation = i * 360.0f / NBR_CARS;
-				modelViewMatrix.Rotate(carRotation, 0.0f, 0.0f, 1.0f);
-				modelViewMatrix.Translate(SPOKE_LENGTH, 0.0f, 0.0f);
-				wheelCar[i].Draw(modelViewMatrix, shaderManager, transformPipeline, vLightEyePos, 
-									currentRotation + carRotation, wallTexture[currentTextureIndex][i%4], carTexture);
+				wheelCar[i].Draw(modelViewMatrix, drawList, vLightEyePos, 
+									currentRotation + carRotation, wallTexture[currentTextureIndex][i%4], carTexture, detailLevel);
 			modelViewMatrix.PopMatrix();
 		}
 	modelViewMatrix.PopMatrix();
 
-	// Draw the unrotated stand for the wheel.
+	// Draw the unrotated stand for the wheel, from its retained draws once they've been recorded.
+	if (drawList.UseCache(standCache, mCamera))
+		return;
 	for (i = 0; i < 2; i++)
 		for (j = 0; j < 2; j++)
 		{
-			glBindTexture(GL_TEXTURE_2D, wheelTexture[2]);
 			modelViewMatrix.PushMatrix();
 				modelViewMatrix.Translate(0.0f, STAND_STANDARD_Y_OFFSET, STAND_STANDARD_Z_OFFSET * (2 * i - 1));                  // Translate z -0.01 for i=0, +0.01 for i=1
 				modelViewMatrix.Rotate((STAND_STANDARD_Y_ROTATION - 90.0f * i) * (2 * j - 1), 0.0, 1.0, 0.0);  // Rotate -135 for (0,0), 135 for (0,1), -45 for (1,0), and 45 for (1,1)
 				modelViewMatrix.Rotate(STAND_STANDARD_X_ROTATION, 1.0f, 0.0f, 0.0f);
-				shaderManager.UseStockShader(GLT_SHADER_TEXTURE_POINT_LIGHT_DIFF, modelViewMatrix.GetMatrix(),
-												transformPipeline.GetProjectionMatrix(), vLightTransformed, WHITE_VECTOR, 0);
-				standBatch[i][j].Draw();
+				drawList.AddTexturedLit(standBatch[i][j], wheelTexture[2], modelViewMatrix.GetMatrix(), vLightTransformed, WHITE_VECTOR);
 			modelViewMatrix.PopMatrix();
 		}
+	drawList.EndCapture(standCache);
 }
 
 #endif
\ No newline at end of file
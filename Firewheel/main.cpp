@@ -9,6 +9,10 @@
 #include <GLGeometryTransform.h>
 #include <StopWatch.h>
 
+#include "HeadlessContext.h"
+#include "Benchmark.h"
+#include "GPUTimer.h"
+
 //#include <GL/glu.h>
 
 #ifdef __APPLE__
@@ -31,6 +35,14 @@ static GLfloat vGrey[]   = { 0.5f, 0.5f, 0.5f, 1.0f };
 #define USER_OIT   1 
 #define USER_BLEND 2
 
+// Timed on the GPU: the whole frame, drawing into the multisample FBO, and resolving it
+#define GPU_PASS_FRAME   0
+#define GPU_PASS_SCENE   1
+#define GPU_PASS_RESOLVE 2
+#define NBR_GPU_PASSES   3
+
+const char *gpuPassNames[NBR_GPU_PASSES] = { "frame", "scene", "resolve" };
+
 GLsizei	 screenWidth;			// Desired window or desktop width
 GLsizei  screenHeight;			// Desired window or desktop height
 
@@ -57,6 +69,7 @@ GLfloat             worldAngle;
 
 GLint               blendMode;
 GLint               mode;
+GLint               msSamples;      // 8: the background and each piece of glass get one with OIT
 
 GLuint              msFBO;
 GLuint              textures[2];
@@ -65,12 +78,17 @@ GLuint              depthTextureName;
 GLuint              msResolve;
 GLuint              oitResolve;
 GLuint              flatBlendProg;
+GLuint              windowFBO;      // 0, or the offscreen one when headless
+GPUTimers           gpuTimers;      // Averages of the passes' GPU times
 
 void DrawWorld();
 bool LoadBMPTexture(const char *szFileName, GLenum minFilter, GLenum magFilter, GLenum wrapMode);
 void GenerateOrtho2DMat(GLuint imageWidth, GLuint imageHeight);
 void SetupResolveProg();
 void SetupOITResolveProg();
+void DrawFrame();
+bool IsProgramLinked(GLuint program);
+int RunHeadless(const HeadlessOptions &options);
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -104,13 +122,6 @@ bool LoadBMPTexture(const char *szFileName, GLenum minFilter, GLenum magFilter,
 // OpenGL related startup code is safe to put here. Load textures, etc.
 void SetupRC(void)
 {
-  GLenum err = glewInit();
-  if (GLEW_OK != err)
-    {
-    /* Problem: glewInit failed, something is seriously wrong. */
-    fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
-    }
-  
   // Initialze Shader Manager
   shaderManager.InitializeStockShaders();
   glEnable(GL_DEPTH_TEST);
@@ -159,12 +170,12 @@ void SetupRC(void)
   // Create depth texture
   glGenTextures(1, &depthTextureName);
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTextureName);
-  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 8, GL_DEPTH_COMPONENT24, screenWidth, screenHeight, GL_FALSE);
+  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msSamples, GL_DEPTH_COMPONENT24, screenWidth, screenHeight, GL_FALSE);
   
   // Setup HDR render texture
   glGenTextures(1, msTexture);
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexture[0]);
-  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 8, GL_RGBA8, screenWidth, screenHeight, GL_FALSE);
+  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msSamples, GL_RGBA8, screenWidth, screenHeight, GL_FALSE);
   
   // Create and bind an FBO
   glGenFramebuffers(1, &msFBO);
@@ -175,7 +186,7 @@ void SetupRC(void)
   glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, depthTextureName, 0);
   
   // Reset framebuffer binding
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, windowFBO);
   
   // Load oit resolve shader
   oitResolve =  gltLoadShaderPairWithAttributes("basic.vs", "oitResolve.fs", 3, 
@@ -200,6 +211,8 @@ void SetupRC(void)
   
   int numMasks = 0;
   glGetIntegerv(GL_MAX_SAMPLE_MASK_WORDS, &numMasks);
+  
+  gpuTimers.SetupRenderingContext(gpuPassNames, NBR_GPU_PASSES);
 }
 
 
@@ -222,6 +235,7 @@ void ShutdownRC(void)
   // Cleanup FBOs
   glDeleteFramebuffers(1, &msFBO);
   
+  gpuTimers.ShutdownRenderingContext();
 }
 
 
@@ -246,10 +260,10 @@ void ChangeSize(int nWidth, int nHeight)
   
   // Resize textures
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTextureName);
-  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 8, GL_DEPTH_COMPONENT24, screenWidth, screenHeight, GL_FALSE);
+  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msSamples, GL_DEPTH_COMPONENT24, screenWidth, screenHeight, GL_FALSE);
   
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexture[0]);
-  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 8, GL_RGBA8, screenWidth, screenHeight, GL_FALSE);
+  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, msSamples, GL_RGBA8, screenWidth, screenHeight, GL_FALSE);
 }
 
 
@@ -259,8 +273,7 @@ void ChangeSize(int nWidth, int nHeight)
 void SpecialKeys(int key, int x, int y)
 { 
   static CStopWatch cameraTimer;
-  float fTime = cameraTimer.GetElapsedSeconds();
-  cameraTimer.Reset(); 
+  float fTime = cameraTimer.LapSeconds();
   
   float linear = fTime * 3.0f;
   float angular = fTime * float(m3dDegToRad(60.0f));
@@ -300,6 +313,10 @@ void ProcessKeys(unsigned char key, int x, int y)
     blendMode = 6;
   if(key == '7')
     blendMode = 7;
+  
+  // Averages over the last few dozen frames
+  if(key == 'g' || key == 'G')
+    gpuTimers.Print((mode == USER_OIT) ? "HDR Imaging (OIT)" : "HDR Imaging (blend)");
 }
 
 
@@ -377,7 +394,7 @@ void SetupResolveProg()
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, msTexture[0]);
   glUniform1i(glGetUniformLocation(msResolve, "origImage"), 0);
   
-  glUniform1i(glGetUniformLocation(msResolve, "sampleCount"), 8);
+  glUniform1i(glGetUniformLocation(msResolve, "sampleCount"), msSamples);
   
   glActiveTexture(GL_TEXTURE0);
   
@@ -405,7 +422,7 @@ void SetupOITResolveProg()
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTextureName);
   glUniform1i(glGetUniformLocation(oitResolve, "origDepth"), 1);
   
-  glUniform1f(glGetUniformLocation(oitResolve, "sampleCount"), 8);
+  glUniform1f(glGetUniformLocation(oitResolve, "sampleCount"), (GLfloat)msSamples);
   
   glActiveTexture(GL_TEXTURE0);
   gltCheckErrors(oitResolve);
@@ -468,6 +485,24 @@ void DrawWorld()
 // flushes, etc.
 void RenderScene(void)
 {
+  DrawFrame();
+  
+  // Do the buffer Swap
+  glutSwapBuffers();
+  
+  // Do it again
+  glutPostRedisplay();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Draw the scene into the multisample FBO, then resolve it into the window's
+// framebuffer, or the offscreen one standing in for it
+void DrawFrame(void)
+{
+  gpuTimers.BeginFrame();
+  gpuTimers.Begin(GPU_PASS_FRAME);
+  gpuTimers.Begin(GPU_PASS_SCENE);
+  
   // Bind the FBO with multisample buffers
   glBindFramebuffer(GL_DRAW_FRAMEBUFFER, msFBO);
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -556,14 +591,16 @@ void RenderScene(void)
   glDisable(GL_BLEND);
   glDisable(GL_SAMPLE_MASK);
   glSampleMaski(0, 0xffffffff);
+  gpuTimers.End(GPU_PASS_SCENE);
   
   // Resolve multisample buffer
+  gpuTimers.Begin(GPU_PASS_RESOLVE);
   projectionMatrix.PushMatrix();
   projectionMatrix.LoadMatrix(orthoMatrix);
   modelViewMatrix.PushMatrix();
   modelViewMatrix.LoadIdentity();
   // Setup and Clear the default framebuffer
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, windowFBO);
   glViewport(0, 0, screenWidth, screenHeight);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   
@@ -576,6 +613,9 @@ void RenderScene(void)
   screenQuad.Draw();
   modelViewMatrix.PopMatrix();
   projectionMatrix.PopMatrix();
+  gpuTimers.End(GPU_PASS_RESOLVE);
+  gpuTimers.End(GPU_PASS_FRAME);
+  gpuTimers.EndFrame();
   
 	// Reset texture state
   glEnable(GL_DEPTH_TEST);
@@ -583,12 +623,101 @@ void RenderScene(void)
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Render frames into an offscreen framebuffer, with no window, and time them.
+// The scene doesn't move on its own, so every frame is the same picture.
+///////////////////////////////////////////////////////////////////////////////
+// False for 0, which the shader loader returns when a file is missing or a
+// stage doesn't compile, and for a program that failed to link
+bool IsProgramLinked(GLuint program)
+{
+  if(program == 0 || !glIsProgram(program))
+    return false;
   
-  // Do the buffer Swap
-  glutSwapBuffers();
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  return linked == GL_TRUE;
+}
+
+int RunHeadless(const HeadlessOptions &options)
+{
+  HeadlessContext headless;
+  if (!headless.Create(options.width, options.height))
+    return -1;
+  
+  // Software rasterizers may have fewer samples than OIT's layers need (llvmpipe
+  // has 4); plain blending resolves however many there are
+  GLint colorSamples = 0, depthSamples = 0;
+  glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &colorSamples);
+  glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &depthSamples);
+  GLint maxSamples = (colorSamples < depthSamples) ? colorSamples : depthSamples;
+  if (maxSamples < msSamples)
+    {
+    fprintf(stderr, "Headless: %d samples per pixel, not %d; blending instead of OIT\n", maxSamples, msSamples);
+    msSamples = maxSamples;
+    mode = USER_BLEND;
+    }
   
-  // Do it again
-  glutPostRedisplay();
+  windowFBO = headless.GetFramebuffer();
+  SetupRC();
+  ChangeSize(options.width, options.height);
+  
+  // Without the resolve shaders every frame would come out blank
+  if (!IsProgramLinked(oitResolve) || !IsProgramLinked(msResolve))
+    {
+    fprintf(stderr, "Headless: the resolve shaders didn't build; basic.vs, msResolve.fs and oitResolve.fs "
+                    "must be in the working directory\n");
+    ShutdownRC();
+    return -1;
+    }
+  
+  // The same choices as at the keyboard, e.g. --keys b3 for blend mode 3
+  for (const char *pKey = options.szKeys; pKey != NULL && *pKey != '\0'; pKey++)
+    ProcessKeys((unsigned char)*pKey, 0, 0);
+  
+  // The first frame pays for the shaders' compiles, and isn't averaged
+  DrawFrame();
+  headless.Finish();
+  gpuTimers.Reset();
+  
+  // Only times for the benchmark; there's no draw list here to count from
+  BenchmarkRecorder recorder;
+  BenchmarkCounters counters = { 0, 0, 0, 0, 0, 0, 0 };
+  bool benchmark = (options.szBenchmarkFileName != NULL);
+  if (benchmark)
+    recorder.SetGPUTimers(&gpuTimers, GPU_PASS_FRAME);
+  
+  std::vector<float> frameSeconds;
+  frameSeconds.reserve(options.nbrFrames);
+  CStopWatch frameTimer;
+  for (int frame = 0; frame < options.nbrFrames; frame++)
+    {
+    frameTimer.Reset();
+    if (benchmark)
+      recorder.BeginFrame(0.0f);
+    DrawFrame();
+    if (benchmark)
+      recorder.EndSubmit();
+    headless.Finish();
+    frameSeconds.push_back(frameTimer.GetElapsedSeconds());
+    if (benchmark)
+      recorder.EndFrame(counters);
+    }
+  const char *szName = (mode == USER_OIT) ? "HDR Imaging (OIT)" : "HDR Imaging (blend)";
+  PrintFrameTimes(szName, frameSeconds);
+  gpuTimers.Finish();
+  gpuTimers.Print(szName);
+  
+  bool written = (options.szImageFileName == NULL) || headless.WriteImage(options.szImageFileName);
+  if (benchmark)
+    {
+    recorder.PrintSummary(szName);
+    written = recorder.Write(options.szBenchmarkFileName) && written;
+    }
+  ShutdownRC();
+  return written ? 0 : -1;
 }
 
 int main(int argc, char* argv[])
@@ -597,6 +726,8 @@ int main(int argc, char* argv[])
   screenWidth = 800;
   screenHeight = 600; 
   msFBO = 0;
+  windowFBO = 0;
+  msSamples = 8;
   depthTextureName = 0;
   worldAngle = 0;
   mode = 1;
@@ -604,12 +735,26 @@ int main(int argc, char* argv[])
   
 	gltSetWorkingDirectory(argv[0]);
   
+  // --headless renders into an offscreen framebuffer, with no window at all
+  HeadlessOptions headless;
+  if (!ParseHeadlessOptions(argc, argv, screenWidth, screenHeight, headless))
+    return -1;
+  if (headless.enabled)
+    return RunHeadless(headless);
+  
   glutInit(&argc, argv);
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
   glutInitWindowSize(screenWidth,screenHeight);
   
   glutCreateWindow("HDR Imaging");
   
+  GLenum err = glewInit();
+  if (GLEW_OK != err)
+    {
+    /* Problem: glewInit failed, something is seriously wrong. */
+    fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
+    }
+  
   glutReshapeFunc(ChangeSize);
   glutDisplayFunc(RenderScene);
   glutSpecialFunc(SpecialKeys);